@@ -0,0 +1,127 @@
+/*
+ * osc2midi - a bridge between OSC and (ALSA) MIDI.
+ * Copyright (C) 2018  Vilniaus Blokas UAB, https://blokas.io/
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2 of the
+ * License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include "alloc_guard.h"
+
+#ifdef OSC2MIDI_ALLOC_GUARD
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <execinfo.h>
+
+extern "C"
+{
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t count, size_t size);
+void *__libc_realloc(void *ptr, size_t size);
+void *__libc_memalign(size_t alignment, size_t size);
+void __libc_free(void *ptr);
+}
+
+static __thread bool t_armed;
+static __thread unsigned t_exempt;
+
+void alloc_guard_arm(bool armed)
+{
+	if (armed)
+	{
+		// The first call may load libgcc, which allocates.
+		void *frames[1];
+		backtrace(frames, 1);
+	}
+	t_armed = armed;
+}
+
+AllocGuardExempt::AllocGuardExempt()
+{
+	++t_exempt;
+}
+
+AllocGuardExempt::~AllocGuardExempt()
+{
+	--t_exempt;
+}
+
+static inline void check(const char *function, size_t size)
+{
+	if (!t_armed || t_exempt)
+		return;
+
+	t_armed = false;
+
+	char message[128];
+	int n = snprintf(message, sizeof(message), "%s(%zu) called in the steady state of the event loop!\n", function, size);
+	write(STDERR_FILENO, message, n);
+
+	void *frames[32];
+	int count = backtrace(frames, 32);
+	backtrace_symbols_fd(frames, count, STDERR_FILENO);
+
+	abort();
+}
+
+extern "C" void *malloc(size_t size)
+{
+	check("malloc", size);
+	return __libc_malloc(size);
+}
+
+extern "C" void *calloc(size_t count, size_t size)
+{
+	check("calloc", count * size);
+	return __libc_calloc(count, size);
+}
+
+extern "C" void *realloc(void *ptr, size_t size)
+{
+	check("realloc", size);
+	return __libc_realloc(ptr, size);
+}
+
+extern "C" void *memalign(size_t alignment, size_t size)
+{
+	check("memalign", size);
+	return __libc_memalign(alignment, size);
+}
+
+extern "C" void *aligned_alloc(size_t alignment, size_t size)
+{
+	check("aligned_alloc", size);
+	return __libc_memalign(alignment, size);
+}
+
+extern "C" int posix_memalign(void **ptr, size_t alignment, size_t size)
+{
+	check("posix_memalign", size);
+	void *p = __libc_memalign(alignment, size);
+	if (!p)
+		return ENOMEM;
+	*ptr = p;
+	return 0;
+}
+
+extern "C" void free(void *ptr)
+{
+	__libc_free(ptr);
+}
+
+#endif // OSC2MIDI_ALLOC_GUARD
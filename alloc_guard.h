@@ -0,0 +1,54 @@
+/*
+ * osc2midi - a bridge between OSC and (ALSA) MIDI.
+ * Copyright (C) 2018  Vilniaus Blokas UAB, https://blokas.io/
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2 of the
+ * License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef ALLOC_GUARD_H
+#define ALLOC_GUARD_H
+
+// Enforces the allocation free steady state of the event loop. Built with
+// OSC2MIDI_ALLOC_GUARD defined (make ALLOC_GUARD=1), the heap functions are
+// interposed, and any allocation made by an armed thread outside of an exempt
+// scope prints a backtrace and aborts. Otherwise it all compiles to nothing.
+
+#ifdef OSC2MIDI_ALLOC_GUARD
+
+// Arms or disarms the guard for the calling thread.
+void alloc_guard_arm(bool armed);
+
+// Allows allocating within its scope, for rare control operations, such as
+// writing out the trace.
+class AllocGuardExempt
+{
+public:
+	AllocGuardExempt();
+	~AllocGuardExempt();
+};
+
+#else // OSC2MIDI_ALLOC_GUARD
+
+static inline void alloc_guard_arm(bool) {}
+
+class AllocGuardExempt
+{
+public:
+	AllocGuardExempt() {}
+};
+
+#endif // OSC2MIDI_ALLOC_GUARD
+
+#endif // ALLOC_GUARD_H
@@ -0,0 +1,238 @@
+/*
+ * osc2midi - a bridge between OSC and (ALSA) MIDI.
+ * Copyright (C) 2018  Vilniaus Blokas UAB, https://blokas.io/
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2 of the
+ * License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include "capture.h"
+
+#include <stdio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+static uint64_t clockNs(clockid_t clock)
+{
+	timespec ts;
+	clock_gettime(clock, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+CaptureWriter::CaptureWriter()
+	:m_fd(-1)
+	,m_window(NULL)
+	,m_windowOffset(0)
+	,m_used(0)
+	,m_size(0)
+	,m_lost(0)
+	,m_failed(false)
+{
+}
+
+CaptureWriter::~CaptureWriter()
+{
+	close();
+}
+
+int CaptureWriter::open(const char *path)
+{
+	close();
+
+	int fd = ::open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0)
+	{
+		fprintf(stderr, "Failed to open '%s'! (%d)\n", path, errno);
+		return -errno;
+	}
+
+	if (ftruncate(fd, WINDOW_SIZE) < 0)
+		goto error;
+
+	m_window = (char*)mmap(NULL, WINDOW_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (m_window == MAP_FAILED)
+	{
+		m_window = NULL;
+		goto error;
+	}
+
+	m_fd = fd;
+	m_windowOffset = 0;
+	m_used = 0;
+	m_lost = 0;
+	m_failed = false;
+
+	CaptureHeader header;
+	header.m_magic = CAPTURE_MAGIC;
+	header.m_version = CAPTURE_VERSION;
+	header.m_realTime = clockNs(CLOCK_REALTIME);
+	header.m_monotonicTime = clockNs(CLOCK_MONOTONIC);
+	append(&header, sizeof(header));
+	m_size = sizeof(header);
+	return 0;
+
+error:
+	int result = -errno;
+	fprintf(stderr, "Failed to map '%s'! (%d)\n", path, -result);
+	::close(fd);
+	unlink(path);
+	return result;
+}
+
+void CaptureWriter::close()
+{
+	if (m_fd < 0)
+		return;
+
+	if (m_window)
+		munmap(m_window, WINDOW_SIZE);
+	if (ftruncate(m_fd, m_size) < 0)
+		fprintf(stderr, "Failed to truncate the capture! (%d)\n", errno);
+	::close(m_fd);
+
+	m_fd = -1;
+	m_window = NULL;
+}
+
+uint64_t CaptureWriter::getSize() const
+{
+	return m_size;
+}
+
+uint64_t CaptureWriter::getLost() const
+{
+	return m_lost;
+}
+
+void CaptureWriter::append(const void *data, size_t length)
+{
+	const char *p = (const char*)data;
+	while (length > 0 && !m_failed)
+	{
+		if (m_used == WINDOW_SIZE && !advance())
+		{
+			m_failed = true;
+			break;
+		}
+
+		size_t n = WINDOW_SIZE - m_used < length ? WINDOW_SIZE - m_used : length;
+		memcpy(m_window + m_used, p, n);
+		m_used += n;
+		p += n;
+		length -= n;
+	}
+}
+
+// Grows the file by a window and maps it in place of the full one.
+bool CaptureWriter::advance()
+{
+	munmap(m_window, WINDOW_SIZE);
+	m_window = NULL;
+
+	uint64_t offset = m_windowOffset + WINDOW_SIZE;
+	if (ftruncate(m_fd, offset + WINDOW_SIZE) < 0)
+		return false;
+
+	void *p = mmap(NULL, WINDOW_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, offset);
+	if (p == MAP_FAILED)
+		return false;
+
+	m_window = (char*)p;
+	m_windowOffset = offset;
+	m_used = 0;
+	return true;
+}
+
+CaptureReader::CaptureReader()
+	:m_data(NULL)
+	,m_size(0)
+	,m_offset(0)
+{
+}
+
+CaptureReader::~CaptureReader()
+{
+	close();
+}
+
+int CaptureReader::open(const char *path)
+{
+	close();
+
+	int fd = ::open(path, O_RDONLY);
+	if (fd < 0)
+		return -errno;
+
+	struct stat st;
+	if (fstat(fd, &st) < 0 || st.st_size < (off_t)sizeof(CaptureHeader))
+	{
+		::close(fd);
+		return -EPROTO;
+	}
+
+	void *p = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	::close(fd);
+	if (p == MAP_FAILED)
+		return -errno;
+
+	const CaptureHeader *header = (const CaptureHeader*)p;
+	if (header->m_magic != CAPTURE_MAGIC || header->m_version != CAPTURE_VERSION)
+	{
+		munmap(p, st.st_size);
+		return -EPROTO;
+	}
+
+	m_data = (const uint8_t*)p;
+	m_size = st.st_size;
+	m_offset = sizeof(CaptureHeader);
+	return 0;
+}
+
+void CaptureReader::close()
+{
+	if (!m_data)
+		return;
+
+	munmap((void*)m_data, m_size);
+	m_data = NULL;
+	m_size = 0;
+}
+
+const CaptureHeader &CaptureReader::getHeader() const
+{
+	return *(const CaptureHeader*)m_data;
+}
+
+bool CaptureReader::next(CaptureRecord &record, const uint8_t *&data)
+{
+	if (m_size - m_offset < sizeof(CaptureRecord))
+		return false;
+
+	memcpy(&record, m_data + m_offset, sizeof(record));
+	if (record.m_time == 0 || m_size - m_offset - sizeof(record) < record.m_length)
+		return false;
+
+	data = m_data + m_offset + sizeof(record);
+	m_offset += sizeof(record) + record.m_length;
+	return true;
+}
+
+void CaptureReader::rewind()
+{
+	m_offset = sizeof(CaptureHeader);
+}
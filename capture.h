@@ -0,0 +1,151 @@
+/*
+ * osc2midi - a bridge between OSC and (ALSA) MIDI.
+ * Copyright (C) 2018  Vilniaus Blokas UAB, https://blokas.io/
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2 of the
+ * License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+enum
+{
+	CAPTURE_MAGIC   = 0x434d324f, // "O2MC" in little endian.
+	CAPTURE_VERSION = 1,
+};
+
+enum CaptureKind
+{
+	CAPTURE_UDP_IN,  // A datagram received from a peer.
+	CAPTURE_UDP_OUT, // A datagram sent to a peer.
+	CAPTURE_SEQ_IN,  // An event read from the ALSA port, as MIDI bytes.
+	CAPTURE_SEQ_OUT, // An event written to the ALSA port, as MIDI bytes.
+
+	CAPTURE_KIND_COUNT
+};
+
+// Starts the capture file.
+struct CaptureHeader
+{
+	uint32_t m_magic;
+	uint32_t m_version;
+	uint64_t m_realTime;      // CLOCK_REALTIME ns when the capture started.
+	uint64_t m_monotonicTime; // CLOCK_MONOTONIC ns at the same moment.
+};
+
+// Precedes the data of every record, unaligned. A record with a 0 time marks the
+// end of the records, if the capture was cut short before the file got truncated.
+struct CaptureRecord
+{
+	uint64_t m_time;   // CLOCK_MONOTONIC ns.
+	uint32_t m_addr;   // UDP: peer IPv4 address. ALSA: client << 8 | port. Network order.
+	uint16_t m_port;   // UDP: peer port, network order. 0 for ALSA.
+	uint16_t m_length; // Of the data following the record.
+	uint8_t m_kind;    // CaptureKind.
+} __attribute__((packed));
+
+// Appends the records to a file through a memory mapped window, the file grows by
+// WINDOW_SIZE at a time and gets truncated to the records written when closed.
+// Writing a record is a couple of copies, with a remap once per window.
+class CaptureWriter
+{
+public:
+	enum { WINDOW_SIZE = 4 * 1024 * 1024 };
+
+	CaptureWriter();
+	~CaptureWriter();
+
+	// Returns 0 on success, negative error code otherwise.
+	int open(const char *path);
+	void close();
+
+	inline bool isOpen() const;
+
+	inline void write(CaptureKind kind, uint64_t time, uint32_t addr, uint16_t port, const void *data, size_t length);
+
+	// Bytes written, and records lost to a failure to grow the file.
+	uint64_t getSize() const;
+	uint64_t getLost() const;
+
+private:
+	void append(const void *data, size_t length);
+	bool advance();
+
+	int m_fd;
+	char *m_window;
+	uint64_t m_windowOffset; // File offset of the window.
+	size_t m_used;           // Bytes used in the window.
+	uint64_t m_size;         // Of the complete records.
+	uint64_t m_lost;
+	bool m_failed;
+};
+
+inline bool CaptureWriter::isOpen() const
+{
+	return m_fd >= 0;
+}
+
+inline void CaptureWriter::write(CaptureKind kind, uint64_t time, uint32_t addr, uint16_t port, const void *data, size_t length)
+{
+	if (m_failed || length > 0xffff)
+	{
+		++m_lost;
+		return;
+	}
+
+	CaptureRecord r;
+	r.m_time = time;
+	r.m_addr = addr;
+	r.m_port = port;
+	r.m_length = length;
+	r.m_kind = kind;
+
+	append(&r, sizeof(r));
+	append(data, length);
+
+	if (!m_failed)
+		m_size += sizeof(r) + length;
+}
+
+// Iterates over the records of a capture file, mapped in whole.
+class CaptureReader
+{
+public:
+	CaptureReader();
+	~CaptureReader();
+
+	// Returns 0 on success, negative error code otherwise.
+	int open(const char *path);
+	void close();
+
+	const CaptureHeader &getHeader() const;
+
+	// Returns false past the last record. data points into the mapping.
+	bool next(CaptureRecord &record, const uint8_t *&data);
+
+	// Starts over from the first record.
+	void rewind();
+
+private:
+	const uint8_t *m_data;
+	size_t m_size;
+	size_t m_offset;
+};
+
+#endif // CAPTURE_H
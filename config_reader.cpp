@@ -0,0 +1,222 @@
+/*
+ * osc2midi - a bridge between OSC and (ALSA) MIDI.
+ * Copyright (C) 2018  Vilniaus Blokas UAB, https://blokas.io/
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2 of the
+ * License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include "config_reader.h"
+
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+static ConfigReader::Reporter g_reporter;
+
+static void reportText(const char *text)
+{
+	if (g_reporter)
+		g_reporter(text);
+	else
+		fputs(text, stderr);
+}
+
+ConfigReader::ConfigReader()
+	:m_fd(-1)
+	,m_fileName(NULL)
+	,m_lineNumber(0)
+	,m_pos(0)
+	,m_length(0)
+{
+	m_line[0] = '\0';
+}
+
+ConfigReader::~ConfigReader()
+{
+	close();
+}
+
+int ConfigReader::open(const char *fileName)
+{
+	close();
+
+	m_fd = ::open(fileName, O_RDONLY | O_CLOEXEC);
+	if (m_fd < 0)
+	{
+		int err = errno;
+		report("Failed opening '%s'! (%d)\n", fileName, err);
+		return -err;
+	}
+
+	m_fileName = fileName;
+	m_lineNumber = 0;
+	m_pos = 0;
+	m_length = 0;
+	return 0;
+}
+
+void ConfigReader::close()
+{
+	if (m_fd >= 0)
+	{
+		::close(m_fd);
+		m_fd = -1;
+	}
+}
+
+bool ConfigReader::getLine()
+{
+	unsigned n = 0;
+	while (n < sizeof(m_line) - 1)
+	{
+		if (m_pos == m_length)
+		{
+			ssize_t result;
+			do
+				result = read(m_fd, m_buffer, sizeof(m_buffer));
+			while (result < 0 && errno == EINTR);
+
+			if (result <= 0)
+				break;
+
+			m_pos = 0;
+			m_length = result;
+		}
+
+		char c = m_buffer[m_pos++];
+		m_line[n++] = c;
+		if (c == '\n')
+			break;
+	}
+
+	m_line[n] = '\0';
+	return n > 0;
+}
+
+int ConfigReader::readLine(char *tokens[MAX_TOKENS])
+{
+	if (m_fd < 0)
+		return 0;
+
+	while (getLine())
+	{
+		++m_lineNumber;
+
+		char *comment = strchr(m_line, '#');
+		if (comment)
+			*comment = '\0';
+
+		int n = 0;
+		char *save;
+		for (char *t = strtok_r(m_line, " \t\r\n", &save); t && n < MAX_TOKENS; t = strtok_r(NULL, " \t\r\n", &save))
+			tokens[n++] = t;
+
+		if (n > 0)
+			return n;
+	}
+
+	return 0;
+}
+
+void ConfigReader::error(const char *format, ...) const
+{
+	char text[512];
+	size_t size = sizeof(text) - 1; // Room for the newline.
+	int n = snprintf(text, size, "%s:%d: ", m_fileName ? m_fileName : "?", m_lineNumber);
+	if (n < 0)
+		n = 0;
+	else if ((size_t)n >= size)
+		n = size - 1;
+
+	va_list args;
+	va_start(args, format);
+	vsnprintf(text + n, size - n, format, args);
+	va_end(args);
+
+	strcat(text, "\n");
+	reportText(text);
+}
+
+void ConfigReader::report(const char *format, ...)
+{
+	char text[512];
+	va_list args;
+	va_start(args, format);
+	vsnprintf(text, sizeof(text), format, args);
+	va_end(args);
+	reportText(text);
+}
+
+void ConfigReader::setReporter(Reporter reporter)
+{
+	g_reporter = reporter;
+}
+
+bool ConfigReader::splitKeyValue(char *token, char *&key, char *&value)
+{
+	char *eq = strchr(token, '=');
+	if (!eq)
+		return false;
+
+	*eq = '\0';
+	key = token;
+	value = eq + 1;
+	return true;
+}
+
+bool ConfigReader::parseInt(const char *str, int min, int max, int &result)
+{
+	char *endPtr;
+	long v = strtol(str, &endPtr, 0);
+	if (endPtr == str || *endPtr != '\0' || v < min || v > max)
+		return false;
+
+	result = (int)v;
+	return true;
+}
+
+bool ConfigReader::parseRange(const char *str, int min, int max, int &lo, int &hi)
+{
+	char *endPtr;
+	long a = strtol(str, &endPtr, 0);
+	if (endPtr == str)
+		return false;
+
+	long b = a;
+	if (*endPtr == '-')
+	{
+		const char *s = endPtr + 1;
+		b = strtol(s, &endPtr, 0);
+		if (endPtr == s)
+			return false;
+	}
+
+	if (*endPtr != '\0' || a < min || b > max || a > b)
+		return false;
+
+	lo = (int)a;
+	hi = (int)b;
+	return true;
+}
+
+bool ConfigReader::parseFloat(const char *str, float &result)
+{
+	char *endPtr;
+	result = strtof(str, &endPtr);
+	return endPtr != str && *endPtr == '\0';
+}
@@ -0,0 +1,79 @@
+/*
+ * osc2midi - a bridge between OSC and (ALSA) MIDI.
+ * Copyright (C) 2018  Vilniaus Blokas UAB, https://blokas.io/
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2 of the
+ * License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef CONFIG_READER_H
+#define CONFIG_READER_H
+
+#include <stdio.h>
+
+// Line based reader shared by all of the configuration files. Everything after
+// '#' is a comment, the rest of the line is split into whitespace separated tokens.
+// Reads through a fixed buffer, so reloading doesn't touch the heap.
+class ConfigReader
+{
+public:
+	enum { MAX_TOKENS = 32 };
+
+	ConfigReader();
+	~ConfigReader();
+
+	int open(const char *fileName);
+	void close();
+
+	// Returns the number of tokens on the next non-empty line, 0 at the end of file.
+	int readLine(char *tokens[MAX_TOKENS]);
+
+	// Reports "file:line: message".
+	void error(const char *format, ...) const __attribute__((format(printf, 2, 3)));
+
+	// Reports a message not tied to a line, such as of a file failing to open.
+	static void report(const char *format, ...) __attribute__((format(printf, 1, 2)));
+
+	// Receives the reported messages, newline terminated. They go to stderr unless set,
+	// NULL restores it.
+	typedef void (*Reporter)(const char *text);
+	static void setReporter(Reporter reporter);
+
+	// Splits "key=value" in place. Returns false if there's no '='.
+	static bool splitKeyValue(char *token, char *&key, char *&value);
+
+	// Parses "n" or "lo-hi", both ends inclusive and within [min; max].
+	static bool parseRange(const char *str, int min, int max, int &lo, int &hi);
+
+	static bool parseInt(const char *str, int min, int max, int &result);
+	static bool parseFloat(const char *str, float &result);
+
+private:
+	ConfigReader(const ConfigReader &);
+	ConfigReader &operator=(const ConfigReader &);
+
+	// Fills m_line with the next line, like fgets. Returns false at the end of file.
+	bool getLine();
+
+	int m_fd;
+	const char *m_fileName;
+	int m_lineNumber;
+	char m_line[512];
+
+	char m_buffer[4096];
+	unsigned m_pos;
+	unsigned m_length;
+};
+
+#endif // CONFIG_READER_H
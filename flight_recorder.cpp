@@ -0,0 +1,189 @@
+/*
+ * osc2midi - a bridge between OSC and (ALSA) MIDI.
+ * Copyright (C) 2018  Vilniaus Blokas UAB, https://blokas.io/
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2 of the
+ * License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include "flight_recorder.h"
+#include "stats.h"
+
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+
+// Minimal async-signal-safe formatting, printf family functions aren't.
+class LineWriter
+{
+public:
+	explicit LineWriter(int fd)
+		:m_fd(fd)
+		,m_n(0)
+		,m_failed(false)
+	{
+	}
+
+	void str(const char *s)
+	{
+		while (*s)
+			put(*s++);
+	}
+
+	void dec(uint64_t v, unsigned width = 0)
+	{
+		char digits[20];
+		unsigned n = 0;
+		do
+		{
+			digits[n++] = '0' + v % 10;
+			v /= 10;
+		} while (v);
+
+		while (width > n)
+		{
+			put('0');
+			--width;
+		}
+		while (n)
+			put(digits[--n]);
+	}
+
+	void hex(uint32_t v)
+	{
+		static const char HEX[] = "0123456789abcdef";
+		for (int shift=28; shift>=0; shift-=4)
+			put(HEX[(v >> shift) & 0xf]);
+	}
+
+	bool flush()
+	{
+		const char *p = m_buffer;
+		while (m_n > 0 && !m_failed)
+		{
+			ssize_t n = write(m_fd, p, m_n);
+			if (n < 0 && errno == EINTR)
+				continue;
+			if (n <= 0)
+			{
+				m_failed = true;
+				break;
+			}
+			p += n;
+			m_n -= n;
+		}
+		m_n = 0;
+		return !m_failed;
+	}
+
+private:
+	void put(char c)
+	{
+		if (m_n == sizeof(m_buffer))
+			flush();
+		m_buffer[m_n++] = c;
+	}
+
+	int m_fd;
+	size_t m_n;
+	bool m_failed;
+	char m_buffer[4096];
+};
+
+FlightRecorder::FlightRecorder()
+	:m_head(0)
+	,m_windowStart(0)
+	,m_windowDrops(0)
+	,m_burstReported(false)
+{
+	memset(m_ring, 0, sizeof(m_ring));
+}
+
+bool FlightRecorder::isDropBurst(uint64_t nowMs, unsigned threshold)
+{
+	if (nowMs - m_windowStart >= 1000)
+	{
+		m_windowStart = nowMs;
+		m_windowDrops = 0;
+		m_burstReported = false;
+		return false;
+	}
+
+	if (m_burstReported || m_windowDrops < threshold)
+		return false;
+
+	m_burstReported = true;
+	return true;
+}
+
+int FlightRecorder::dump(const char *path, const char *reason) const
+{
+	int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_NOFOLLOW | O_CLOEXEC, 0644);
+	if (fd < 0)
+		return -errno;
+
+	uint32_t head = m_head;
+	uint32_t count = head < (uint32_t)SIZE ? head : (uint32_t)SIZE;
+
+	LineWriter w(fd);
+	w.str("# osc2midi flight recorder, ");
+	w.str(reason);
+	w.str(", ");
+	w.dec(count);
+	w.str(" events\n# time direction peer event outcome\n");
+
+	for (uint32_t i = head - count; i != head; ++i)
+	{
+		const Entry &e = m_ring[i % SIZE];
+		const uint8_t *a = (const uint8_t*)&e.m_addr;
+
+		w.dec(e.m_time / 1000000000);
+		w.str(".");
+		w.dec(e.m_time % 1000000000, 9);
+		w.str(e.m_dir == MIDI_DIR_IN ? " in " : " out ");
+		w.dec(a[0]);
+		w.str(".");
+		w.dec(a[1]);
+		w.str(".");
+		w.dec(a[2]);
+		w.str(".");
+		w.dec(a[3]);
+		w.str(":");
+		w.dec(ntohs(e.m_port));
+		w.str(" ");
+		w.hex(e.m_event);
+
+		if (e.m_outcome == FLIGHT_SENT)
+		{
+			w.str(" sent\n");
+		}
+		else if (e.m_outcome == FLIGHT_HELD)
+		{
+			w.str(" held\n");
+		}
+		else
+		{
+			unsigned reason = e.m_outcome - FLIGHT_DROPPED;
+			w.str(" dropped ");
+			w.str(reason < DROP_REASON_COUNT ? stat_get_drop_name((StatDrop)reason) : "?");
+			w.str("\n");
+		}
+	}
+
+	int result = w.flush() ? 0 : -EIO;
+	close(fd);
+	return result;
+}
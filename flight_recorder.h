@@ -0,0 +1,86 @@
+/*
+ * osc2midi - a bridge between OSC and (ALSA) MIDI.
+ * Copyright (C) 2018  Vilniaus Blokas UAB, https://blokas.io/
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2 of the
+ * License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef FLIGHT_RECORDER_H
+#define FLIGHT_RECORDER_H
+
+#include <stdint.h>
+
+enum FlightOutcome
+{
+	FLIGHT_SENT,    // Written to ALSA, or sent over OSC.
+	FLIGHT_HELD,    // Held back by the rate limiter, to be coalesced.
+	FLIGHT_DROPPED, // Dropped, FLIGHT_DROPPED + StatDrop tells the reason.
+};
+
+// Keeps the last SIZE events of both directions with their time, peer and outcome,
+// overwriting the oldest. Recording is a few stores, with no allocation or locking.
+// Dumping only uses async-signal-safe calls, so it can be done from a crash handler.
+class FlightRecorder
+{
+public:
+	enum { SIZE = 4096 };
+
+	FlightRecorder();
+
+	// dir is a MidiDirection, event the USB MIDI event as a 32 bit int, addr and port
+	// of the sender or the receiver in network byte order, time in CLOCK_REALTIME ns.
+	inline void record(uint64_t time, unsigned dir, uint32_t event, uint32_t addr, uint16_t port, unsigned outcome);
+
+	// Returns true once per second in which over threshold events were dropped.
+	bool isDropBurst(uint64_t nowMs, unsigned threshold);
+
+	// Writes the events as text, oldest first, to path. Returns 0 on success,
+	// negative error code otherwise. Async-signal-safe.
+	int dump(const char *path, const char *reason) const;
+
+private:
+	struct Entry
+	{
+		uint64_t m_time;
+		uint32_t m_event;
+		uint32_t m_addr;
+		uint16_t m_port;
+		uint8_t m_dir;
+		uint8_t m_outcome;
+	};
+
+	uint32_t m_head; // Total events recorded.
+	Entry m_ring[SIZE];
+
+	uint64_t m_windowStart;
+	unsigned m_windowDrops;
+	bool m_burstReported;
+};
+
+inline void FlightRecorder::record(uint64_t time, unsigned dir, uint32_t event, uint32_t addr, uint16_t port, unsigned outcome)
+{
+	Entry &e = m_ring[m_head++ % SIZE];
+	e.m_time = time;
+	e.m_event = event;
+	e.m_addr = addr;
+	e.m_port = port;
+	e.m_dir = dir;
+	e.m_outcome = outcome;
+
+	if (outcome >= FLIGHT_DROPPED)
+		++m_windowDrops;
+}
+
+#endif // FLIGHT_RECORDER_H
@@ -0,0 +1,74 @@
+/*
+ * osc2midi - a bridge between OSC and (ALSA) MIDI.
+ * Copyright (C) 2018  Vilniaus Blokas UAB, https://blokas.io/
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2 of the
+ * License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef HEX32_H
+#define HEX32_H
+
+#include <stdint.h>
+
+// The hex text format of the events in /osc2midi/event messages, the packed
+// USB-MIDI event as 8 hex digits.
+
+// Writes 8 lowercase hex digits and a terminating '\0'. Returns a pointer to the '\0'.
+static inline char *encodeHex32(char *dst, uint32_t d)
+{
+	static const char HEX[16] = {
+		'0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'a', 'b', 'c', 'd', 'e', 'f'
+	};
+	for (int i=0; i<7; ++i)
+	{
+		*dst++ = HEX[(d & 0xf0000000) >> 28];
+		d <<= 4;
+	}
+	*dst++ = HEX[(d & 0xf0000000) >> 28];
+	*dst = '\0';
+	return dst;
+}
+
+// Parses up to 8 hex digits of either case. Returns false on any other character.
+static inline bool decodeHex32(uint32_t &result, const char *src)
+{
+	result = 0;
+
+	for (int i=0; i<8 && src[i]; ++i)
+	{
+		char c = src[i];
+		if (c >= '0' && c <= '9')
+		{
+			result = (result << 4) | (c - '0');
+		}
+		else if (c >= 'a' && c <= 'f')
+		{
+			result = (result << 4) | (c - 'a' + 10);
+		}
+		else if (c >= 'A' && c <= 'F')
+		{
+			result = (result << 4) | (c - 'A' + 10);
+		}
+		else
+		{
+			result = 0;
+			return false;
+		}
+	}
+
+	return true;
+}
+
+#endif // HEX32_H
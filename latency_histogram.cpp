@@ -0,0 +1,77 @@
+/*
+ * osc2midi - a bridge between OSC and (ALSA) MIDI.
+ * Copyright (C) 2018  Vilniaus Blokas UAB, https://blokas.io/
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2 of the
+ * License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include "latency_histogram.h"
+
+#include <string.h>
+
+LatencyHistogram::LatencyHistogram()
+{
+	reset();
+}
+
+void LatencyHistogram::reset()
+{
+	m_count = 0;
+	m_max = 0;
+	memset(m_buckets, 0, sizeof(m_buckets));
+}
+
+uint64_t LatencyHistogram::getCount() const
+{
+	return m_count;
+}
+
+uint64_t LatencyHistogram::getMax() const
+{
+	return m_max;
+}
+
+uint64_t LatencyHistogram::upperBoundOf(unsigned index)
+{
+	if (index < SUB_COUNT)
+		return index;
+
+	unsigned shift = index / SUB_COUNT - 1;
+	uint64_t sub = index % SUB_COUNT + SUB_COUNT;
+	return ((sub + 1) << shift) - 1;
+}
+
+uint64_t LatencyHistogram::getPercentile(double percent) const
+{
+	if (m_count == 0)
+		return 0;
+
+	uint64_t target = (uint64_t)(percent / 100.0 * m_count + 0.5);
+	if (target == 0)
+		target = 1;
+
+	uint64_t seen = 0;
+	for (unsigned i=0; i<BUCKET_COUNT; ++i)
+	{
+		seen += m_buckets[i];
+		if (seen >= target)
+		{
+			uint64_t bound = upperBoundOf(i);
+			return bound < m_max ? bound : m_max;
+		}
+	}
+
+	return m_max;
+}
@@ -0,0 +1,77 @@
+/*
+ * osc2midi - a bridge between OSC and (ALSA) MIDI.
+ * Copyright (C) 2018  Vilniaus Blokas UAB, https://blokas.io/
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2 of the
+ * License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef LATENCY_HISTOGRAM_H
+#define LATENCY_HISTOGRAM_H
+
+#include <stdint.h>
+
+// Log-linear histogram in the spirit of HdrHistogram: every power of 2 range is split
+// into 32 linear sub-buckets, so any recorded value is known within ~3%, from
+// nanoseconds up to hours, in a fixed 15KB table. Recording is a few instructions.
+class LatencyHistogram
+{
+public:
+	LatencyHistogram();
+
+	void reset();
+
+	inline void record(uint64_t value);
+
+	uint64_t getCount() const;
+	uint64_t getMax() const;
+
+	// Returns the value at or below which the given percentage (0.0 - 100.0) of
+	// the recorded values are, rounded up to the bucket's upper bound.
+	uint64_t getPercentile(double percent) const;
+
+private:
+	enum
+	{
+		SUB_BITS     = 5,
+		SUB_COUNT    = 1 << SUB_BITS,
+		BUCKET_COUNT = (64 - SUB_BITS + 1) * SUB_COUNT,
+	};
+
+	static inline unsigned indexOf(uint64_t value);
+	static uint64_t upperBoundOf(unsigned index);
+
+	uint64_t m_count;
+	uint64_t m_max;
+	uint64_t m_buckets[BUCKET_COUNT];
+};
+
+inline unsigned LatencyHistogram::indexOf(uint64_t value)
+{
+	if (value < SUB_COUNT)
+		return value;
+
+	unsigned shift = 63 - __builtin_clzll(value) - SUB_BITS;
+	return (shift + 1) * SUB_COUNT + (unsigned)(value >> shift) - SUB_COUNT;
+}
+
+inline void LatencyHistogram::record(uint64_t value)
+{
+	++m_buckets[indexOf(value)];
+	++m_count;
+	if (value > m_max)
+		m_max = value;
+}
+
+#endif // LATENCY_HISTOGRAM_H
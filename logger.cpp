@@ -0,0 +1,598 @@
+/*
+ * osc2midi - a bridge between OSC and (ALSA) MIDI.
+ * Copyright (C) 2018  Vilniaus Blokas UAB, https://blokas.io/
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2 of the
+ * License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include "logger.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <time.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+
+static uint64_t realtime_ns()
+{
+	timespec ts;
+	clock_gettime(CLOCK_REALTIME, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void futex_wait(uint32_t *word, uint32_t value, unsigned ms)
+{
+	timespec ts = { (time_t)(ms / 1000), (long)(ms % 1000) * 1000000 };
+	syscall(SYS_futex, word, FUTEX_WAIT_PRIVATE, value, &ts, NULL, 0);
+}
+
+static void futex_wake(uint32_t *word)
+{
+	__atomic_add_fetch(word, 1, __ATOMIC_RELEASE);
+	syscall(SYS_futex, word, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+}
+
+// Parses the conversion specification following a '%', returns a pointer to its
+// conversion character. longs is the count of 'l' modifiers, or 2 for the other
+// modifiers wider than int.
+static const char *parse_spec(const char *p, unsigned &longs, unsigned &stars)
+{
+	longs = 0;
+	stars = 0;
+
+	p += strspn(p, "-+ #0");
+	if (*p == '*')
+	{
+		++stars;
+		++p;
+	}
+	p += strspn(p, "0123456789");
+	if (*p == '.')
+	{
+		++p;
+		if (*p == '*')
+		{
+			++stars;
+			++p;
+		}
+		p += strspn(p, "0123456789");
+	}
+
+	for (;; ++p)
+	{
+		switch (*p)
+		{
+		case 'h':
+			continue;
+		case 'l':
+			++longs;
+			continue;
+		case 'z': case 'j': case 't':
+			longs = 2;
+			continue;
+		}
+		break;
+	}
+
+	return p;
+}
+
+AsyncLogger::AsyncLogger()
+	:m_target(TARGET_STDERR)
+	,m_fd(-1)
+	,m_started(false)
+	,m_stop(false)
+	,m_head(0)
+	,m_dropped(0)
+	,m_wake(0)
+	,m_tail(0)
+	,m_droppedReported(0)
+{
+	memset(m_repeats, 0, sizeof(m_repeats));
+}
+
+AsyncLogger::~AsyncLogger()
+{
+	stop();
+}
+
+int AsyncLogger::start(const char *target)
+{
+	if (m_started)
+		return -EALREADY;
+
+	if (!target || strcmp(target, "stderr") == 0)
+	{
+		m_target = TARGET_STDERR;
+	}
+	else if (strcmp(target, "syslog") == 0)
+	{
+		m_target = TARGET_SYSLOG;
+		openlog("osc2midi", LOG_PID, LOG_DAEMON);
+	}
+	else
+	{
+		m_fd = open(target, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+		if (m_fd < 0)
+		{
+			int err = errno;
+			fprintf(stderr, "Failed to open '%s'! (%d)\n", target, err);
+			return -err;
+		}
+		m_target = TARGET_FILE;
+	}
+
+	// The signals are meant for the event loop, such as the watchdog's timer.
+	sigset_t all, old;
+	sigfillset(&all);
+	pthread_sigmask(SIG_SETMASK, &all, &old);
+
+	m_stop = false;
+	int result = pthread_create(&m_thread, NULL, &threadMain, this);
+
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+	if (result != 0)
+	{
+		fprintf(stderr, "Failed starting the logger thread! (%d)\n", result);
+		if (m_fd >= 0)
+		{
+			close(m_fd);
+			m_fd = -1;
+		}
+		return -result;
+	}
+
+	__atomic_store_n(&m_started, true, __ATOMIC_RELEASE);
+	return 0;
+}
+
+void AsyncLogger::stop()
+{
+	if (!m_started)
+		return;
+
+	__atomic_store_n(&m_stop, true, __ATOMIC_RELEASE);
+	futex_wake(&m_wake);
+	pthread_join(m_thread, NULL);
+	m_started = false;
+
+	if (m_target == TARGET_SYSLOG)
+		closelog();
+	if (m_fd >= 0)
+	{
+		close(m_fd);
+		m_fd = -1;
+	}
+	m_target = TARGET_STDERR;
+}
+
+void AsyncLogger::write(int priority, const char *format, ...)
+{
+	va_list args;
+	va_start(args, format);
+
+	if (!m_started)
+	{
+		vfprintf(stderr, format, args);
+		va_end(args);
+		return;
+	}
+
+	uint32_t head = m_head;
+	if (head - __atomic_load_n(&m_tail, __ATOMIC_ACQUIRE) >= RING_SIZE)
+	{
+		__atomic_store_n(&m_dropped, m_dropped + 1, __ATOMIC_RELAXED);
+		va_end(args);
+		return;
+	}
+
+	Entry &e = m_ring[head & (RING_SIZE-1)];
+	e.m_time = realtime_ns();
+	e.m_priority = priority;
+	capture(e, format, args);
+	va_end(args);
+
+	__atomic_store_n(&m_head, head + 1, __ATOMIC_RELEASE);
+
+	// The background thread may be sleeping for up to IDLE_MS, wake it before
+	// a burst could fill up the ring. Once per half a ring at most.
+	if (head + 1 - __atomic_load_n(&m_tail, __ATOMIC_ACQUIRE) == RING_SIZE / 2)
+		futex_wake(&m_wake);
+}
+
+bool AsyncLogger::post(Task task, void *arg)
+{
+	if (!m_started)
+		return false;
+
+	uint32_t head = m_head;
+	if (head - __atomic_load_n(&m_tail, __ATOMIC_ACQUIRE) >= RING_SIZE)
+	{
+		__atomic_store_n(&m_dropped, m_dropped + 1, __ATOMIC_RELAXED);
+		return false;
+	}
+
+	Entry &e = m_ring[head & (RING_SIZE-1)];
+	e.m_format = NULL;
+	e.m_time = realtime_ns();
+	e.m_args[0] = (uintptr_t)task;
+	e.m_args[1] = (uintptr_t)arg;
+
+	__atomic_store_n(&m_head, head + 1, __ATOMIC_RELEASE);
+
+	// Tasks are rare, run them without waiting for the poll.
+	futex_wake(&m_wake);
+	return true;
+}
+
+void AsyncLogger::capture(Entry &e, const char *format, va_list args)
+{
+	e.m_format = format;
+	e.m_argCount = 0;
+	e.m_truncated = false;
+
+	unsigned used = 0;
+
+	for (const char *p = format; *p; ++p)
+	{
+		if (*p != '%')
+			continue;
+		if (*++p == '%')
+			continue;
+
+		unsigned longs, stars;
+		p = parse_spec(p, longs, stars);
+
+		if (e.m_argCount + stars + 1 > MAX_ARGS)
+		{
+			e.m_truncated = true;
+			return;
+		}
+
+		for (unsigned i=0; i<stars; ++i)
+		{
+			e.m_types[e.m_argCount] = ARG_INT;
+			e.m_args[e.m_argCount++] = va_arg(args, int);
+		}
+
+		uint8_t &type = e.m_types[e.m_argCount];
+		uint64_t &value = e.m_args[e.m_argCount];
+
+		switch (*p)
+		{
+		case 'd': case 'i': case 'c':
+			type = ARG_INT;
+			value = longs >= 2 ? va_arg(args, long long) : longs ? va_arg(args, long) : va_arg(args, int);
+			break;
+		case 'u': case 'x': case 'X': case 'o':
+			type = ARG_UINT;
+			value = longs >= 2 ? va_arg(args, unsigned long long) : longs ? va_arg(args, unsigned long) : va_arg(args, unsigned);
+			break;
+		case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+			{
+				type = ARG_DOUBLE;
+				double d = va_arg(args, double);
+				memcpy(&value, &d, sizeof(d));
+			}
+			break;
+		case 's':
+			{
+				// Strings are copied, the caller's buffer may be gone by the time it's formatted.
+				type = ARG_STRING;
+				const char *s = va_arg(args, const char*);
+				if (!s)
+					s = "(null)";
+				size_t n = strlen(s);
+				if (n >= STRING_SPACE - used)
+				{
+					n = used < STRING_SPACE ? STRING_SPACE - used - 1 : 0;
+					e.m_truncated = true;
+				}
+				if (used < STRING_SPACE)
+				{
+					memcpy(e.m_strings + used, s, n);
+					e.m_strings[used + n] = '\0';
+					value = used;
+					used += n + 1;
+				}
+				else
+				{
+					value = STRING_SPACE;
+				}
+			}
+			break;
+		case 'p':
+			type = ARG_POINTER;
+			value = (uintptr_t)va_arg(args, void*);
+			break;
+		default:
+			// Unsupported conversion, formatting stops here. Any '*' widths
+			// captured for it are left out of m_argCount.
+			e.m_argCount -= stars;
+			e.m_truncated = true;
+			return;
+		}
+
+		++e.m_argCount;
+	}
+}
+
+void AsyncLogger::format(char *buffer, size_t size, const Entry &e)
+{
+	char *out = buffer;
+	char *end = buffer + size - 1;
+	unsigned arg = 0;
+
+	const char *p = e.m_format;
+	while (*p && out < end)
+	{
+		if (*p != '%')
+		{
+			*out++ = *p++;
+			continue;
+		}
+
+		if (p[1] == '%')
+		{
+			*out++ = '%';
+			p += 2;
+			continue;
+		}
+
+		// Rebuild the specification with the '*'s substituted and the length
+		// modifiers normalized to the captured width of the value.
+		const char *start = p++;
+		unsigned longs, stars;
+		const char *conv = parse_spec(p, longs, stars);
+
+		if (arg + stars >= e.m_argCount)
+			break;
+
+		char spec[48];
+		char *s = spec;
+		for (const char *q = start; q < conv && s < spec + sizeof(spec) - 24; ++q)
+		{
+			if (*q == '*')
+				s += snprintf(s, 12, "%d", (int)e.m_args[arg++]);
+			else if (!strchr("hlzjt", *q))
+				*s++ = *q;
+		}
+
+		ArgType type = (ArgType)e.m_types[arg];
+		uint64_t value = e.m_args[arg++];
+
+		if ((type == ARG_INT || type == ARG_UINT) && *conv != 'c')
+		{
+			*s++ = 'l';
+			*s++ = 'l';
+		}
+		*s++ = *conv;
+		*s = '\0';
+
+		size_t left = end - out + 1;
+		int n;
+		switch (type)
+		{
+		case ARG_INT:
+			n = *conv == 'c' ? snprintf(out, left, spec, (int)value) : snprintf(out, left, spec, (long long)value);
+			break;
+		case ARG_UINT:
+			n = snprintf(out, left, spec, (unsigned long long)value);
+			break;
+		case ARG_DOUBLE:
+			{
+				double d;
+				memcpy(&d, &value, sizeof(d));
+				n = snprintf(out, left, spec, d);
+			}
+			break;
+		case ARG_STRING:
+			n = snprintf(out, left, spec, value < STRING_SPACE ? e.m_strings + value : "");
+			break;
+		case ARG_POINTER:
+		default:
+			n = snprintf(out, left, spec, (void*)(uintptr_t)value);
+			break;
+		}
+
+		if (n < 0)
+			break;
+		out += (size_t)n < left ? (size_t)n : left - 1;
+		p = conv + 1;
+	}
+
+	// Mark truncated messages, either cut short when captured or by the size
+	// of the buffer, and keep their line ending.
+	if (e.m_truncated || *p)
+	{
+		static const char marker[] = " [truncated]";
+		size_t n = strlen(e.m_format);
+		bool newline = n && e.m_format[n-1] == '\n';
+		size_t need = sizeof(marker) - 1 + newline;
+		if ((size_t)(end - out) < need)
+			out = end - need;
+		memcpy(out, marker, sizeof(marker) - 1);
+		out += sizeof(marker) - 1;
+		if (newline)
+			*out++ = '\n';
+	}
+
+	*out = '\0';
+}
+
+void *AsyncLogger::threadMain(void *arg)
+{
+	static_cast<AsyncLogger*>(arg)->run();
+	return NULL;
+}
+
+void AsyncLogger::run()
+{
+	unsigned sleepMs = POLL_MS;
+
+	for (;;)
+	{
+		// Read before checking the ring, so a wake up in between cuts the sleep short.
+		uint32_t wake = __atomic_load_n(&m_wake, __ATOMIC_ACQUIRE);
+		bool stopping = __atomic_load_n(&m_stop, __ATOMIC_ACQUIRE);
+
+		uint32_t head = __atomic_load_n(&m_head, __ATOMIC_ACQUIRE);
+		if (m_tail != head)
+			sleepMs = POLL_MS;
+		else if ((sleepMs *= 2) > IDLE_MS)
+			sleepMs = IDLE_MS;
+
+		while (m_tail != head)
+		{
+			handle(m_ring[m_tail & (RING_SIZE-1)]);
+			__atomic_store_n(&m_tail, m_tail + 1, __ATOMIC_RELEASE);
+		}
+
+		uint64_t now = realtime_ns();
+
+		uint32_t dropped = __atomic_load_n(&m_dropped, __ATOMIC_RELAXED);
+		if (dropped != m_droppedReported)
+		{
+			char text[64];
+			snprintf(text, sizeof(text), "Log ring full, %u messages were lost!\n", dropped - m_droppedReported);
+			output(LOG_WARNING, now, text);
+			m_droppedReported = dropped;
+		}
+
+		sweepRepeats(stopping ? ~(uint64_t)0 : now / 1000000000);
+
+		if (stopping)
+			break;
+
+		// Polling keeps write() free of wake up syscalls, except when the ring gets
+		// half full. The poll slows down while the ring stays empty.
+		futex_wait(&m_wake, wake, sleepMs);
+	}
+}
+
+void AsyncLogger::handle(const Entry &e)
+{
+	char text[512];
+
+	if (!e.m_format)
+	{
+		Task task = (Task)(uintptr_t)e.m_args[0];
+		text[0] = '\0';
+		int priority = task((void*)(uintptr_t)e.m_args[1], text, sizeof(text));
+		if (text[0])
+			output(priority, realtime_ns(), text);
+		return;
+	}
+
+	format(text, sizeof(text), e);
+
+	uint64_t second = e.m_time / 1000000000;
+
+	Repeats *r = NULL;
+	for (unsigned i=0; i<MAX_FORMATS; ++i)
+	{
+		if (m_repeats[i].m_format == e.m_format)
+		{
+			r = &m_repeats[i];
+			break;
+		}
+		if (!r && m_repeats[i].m_format == NULL)
+			r = &m_repeats[i];
+	}
+
+	if (!r)
+	{
+		// Out of slots, not rate limited.
+		output(e.m_priority, e.m_time, text);
+		return;
+	}
+
+	if (r->m_format != e.m_format || r->m_second != second)
+	{
+		if (r->m_format == e.m_format)
+			sweepRepeats(second);
+		r->m_format = e.m_format;
+		r->m_second = second;
+		r->m_count = 0;
+		r->m_suppressed = 0;
+	}
+
+	if (++r->m_count > MAX_REPEATS)
+	{
+		++r->m_suppressed;
+		r->m_priority = e.m_priority;
+		snprintf(r->m_last, sizeof(r->m_last), "%.*s", (int)sizeof(r->m_last) - 1, text);
+		return;
+	}
+
+	output(e.m_priority, e.m_time, text);
+}
+
+void AsyncLogger::sweepRepeats(uint64_t second)
+{
+	for (unsigned i=0; i<MAX_FORMATS; ++i)
+	{
+		Repeats &r = m_repeats[i];
+		if (r.m_format == NULL || r.m_second >= second)
+			continue;
+
+		if (r.m_suppressed)
+		{
+			size_t n = strlen(r.m_last);
+			if (n && r.m_last[n-1] == '\n')
+				r.m_last[n-1] = '\0';
+
+			char text[192];
+			snprintf(text, sizeof(text), "Suppressed %u more messages like: %s\n", r.m_suppressed, r.m_last);
+			output(r.m_priority, realtime_ns(), text);
+		}
+
+		r.m_format = NULL;
+	}
+}
+
+void AsyncLogger::output(int priority, uint64_t time, const char *text)
+{
+	size_t n = strlen(text);
+
+	switch (m_target)
+	{
+	case TARGET_STDERR:
+		::write(STDERR_FILENO, text, n);
+		break;
+	case TARGET_SYSLOG:
+		if (n && text[n-1] == '\n')
+			--n;
+		syslog(priority, "%.*s", (int)n, text);
+		break;
+	case TARGET_FILE:
+		{
+			char line[600];
+			time_t seconds = time / 1000000000;
+			tm t;
+			localtime_r(&seconds, &t);
+			size_t prefix = strftime(line, sizeof(line), "%Y-%m-%d %H:%M:%S", &t);
+			int len = snprintf(line + prefix, sizeof(line) - prefix, ".%03u %s", (unsigned)(time / 1000000 % 1000), text);
+			if (len > 0)
+				::write(m_fd, line, prefix + ((size_t)len < sizeof(line) - prefix ? (size_t)len : sizeof(line) - prefix - 1));
+		}
+		break;
+	}
+}
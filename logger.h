@@ -0,0 +1,145 @@
+/*
+ * osc2midi - a bridge between OSC and (ALSA) MIDI.
+ * Copyright (C) 2018  Vilniaus Blokas UAB, https://blokas.io/
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2 of the
+ * License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef LOGGER_H
+#define LOGGER_H
+
+#include <stdint.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <pthread.h>
+#include <syslog.h>
+
+// Logs without ever waiting for I/O: write() only captures the format string and
+// the binary arguments into a lock-free ring, the formatting and the output happen
+// on a background thread. When the ring is full, messages get dropped and counted.
+// Messages repeated with the same format more than a few times per second are
+// suppressed and summarized. Messages with more than MAX_ARGS arguments, counting
+// the '*' widths, or with unsupported conversions, are output up to that point and
+// marked as truncated, as are the ones whose strings don't fit STRING_SPACE. Before
+// start() and after stop(), messages are written to stderr directly.
+//
+// write() may be called only from a single thread, the event loop.
+class AsyncLogger
+{
+public:
+	enum
+	{
+		RING_SIZE    = 256, // Power of 2.
+		MAX_ARGS     = 8,
+		STRING_SPACE = 128,
+
+		POLL_MS      = 10,  // While messages keep coming.
+		IDLE_MS      = 500, // Longest sleep with the ring empty.
+
+		MAX_REPEATS  = 10, // Per format per second.
+		MAX_FORMATS  = 32, // Tracked for suppressing the repeats.
+	};
+
+	AsyncLogger();
+	~AsyncLogger();
+
+	// target is "stderr", "syslog" or a file path to append to. Returns 0 on success,
+	// negative error code otherwise.
+	int start(const char *target);
+
+	// Writes out the messages still in the ring and stops the background thread.
+	void stop();
+
+	// priority is a syslog priority, such as LOG_ERR.
+	void write(int priority, const char *format, ...) __attribute__((format(printf, 3, 4)));
+
+	// Runs on the background thread, may format a message into text to be logged with
+	// the returned priority.
+	typedef int (*Task)(void *arg, char *text, size_t size);
+
+	// Runs task on the background thread after the messages written so far, for work
+	// waiting for I/O. Returns false if the logger isn't started or the ring is full.
+	bool post(Task task, void *arg);
+
+private:
+	enum ArgType
+	{
+		ARG_INT,
+		ARG_UINT,
+		ARG_DOUBLE,
+		ARG_STRING, // Offset into m_strings.
+		ARG_POINTER,
+	};
+
+	struct Entry
+	{
+		const char *m_format; // NULL for tasks, m_args holding the Task and its arg.
+		uint64_t m_time; // CLOCK_REALTIME ns.
+		uint8_t m_priority;
+		uint8_t m_argCount;
+		bool m_truncated; // Arguments past m_argCount were not captured.
+		uint8_t m_types[MAX_ARGS];
+		uint64_t m_args[MAX_ARGS];
+		char m_strings[STRING_SPACE];
+	};
+
+	struct Repeats
+	{
+		const char *m_format;
+		uint64_t m_second;
+		unsigned m_count;
+		unsigned m_suppressed;
+		int m_priority;
+		char m_last[128];
+	};
+
+	static void *threadMain(void *arg);
+	void run();
+
+	void capture(Entry &e, const char *format, va_list args);
+	static void format(char *buffer, size_t size, const Entry &e);
+
+	void handle(const Entry &e);
+	void sweepRepeats(uint64_t second);
+	void output(int priority, uint64_t time, const char *text);
+
+	enum Target
+	{
+		TARGET_STDERR,
+		TARGET_SYSLOG,
+		TARGET_FILE,
+	};
+
+	Target m_target;
+	int m_fd;
+
+	bool m_started;
+	volatile bool m_stop;
+	pthread_t m_thread;
+
+	// m_head is advanced by write(), m_tail by the background thread.
+	uint32_t m_head __attribute__((aligned(64)));
+	uint32_t m_dropped;
+	// Bumped to wake the background thread early, see write() and stop().
+	uint32_t m_wake;
+	uint32_t m_tail __attribute__((aligned(64)));
+	uint32_t m_droppedReported;
+
+	Repeats m_repeats[MAX_FORMATS];
+
+	Entry m_ring[RING_SIZE];
+};
+
+#endif // LOGGER_H
@@ -0,0 +1,92 @@
+/*
+ * osc2midi - a bridge between OSC and (ALSA) MIDI.
+ * Copyright (C) 2018  Vilniaus Blokas UAB, https://blokas.io/
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2 of the
+ * License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include "loop_detector.h"
+
+#include <string.h>
+
+LoopDetector::LoopDetector()
+	:m_window(0)
+	,m_lastReport(0)
+	,m_count(0)
+	,m_total(0)
+{
+	memset(m_slots, 0, sizeof(m_slots));
+}
+
+void LoopDetector::setWindow(unsigned ms)
+{
+	m_window = ms;
+}
+
+// The 0x80 bit of the status byte is always set, so 0 never matches a fingerprint.
+inline uint32_t LoopDetector::fingerprint(const uint8_t msg[3], unsigned len)
+{
+	return (msg[0] << 16) | (len > 1 ? msg[1] << 8 : 0) | (len > 2 ? msg[2] : 0);
+}
+
+inline unsigned LoopDetector::slotOf(uint32_t fingerprint)
+{
+	return (fingerprint * 2654435761u) >> 24;
+}
+
+void LoopDetector::emitted(const uint8_t msg[3], unsigned len, uint64_t now)
+{
+	if (m_window == 0)
+		return;
+
+	uint32_t f = fingerprint(msg, len);
+	Slot &slot = m_slots[slotOf(f)];
+	slot.m_fingerprint = f;
+	slot.m_time = (uint32_t)now;
+}
+
+bool LoopDetector::isEcho(const uint8_t msg[3], unsigned len, uint64_t now) const
+{
+	if (m_window == 0)
+		return false;
+
+	uint32_t f = fingerprint(msg, len);
+	const Slot &slot = m_slots[slotOf(f)];
+	return slot.m_fingerprint == f && (uint32_t)now - slot.m_time <= m_window;
+}
+
+bool LoopDetector::looped(uint64_t now)
+{
+	++m_count;
+	++m_total;
+
+	if (now - m_lastReport < 1000)
+		return false;
+
+	m_lastReport = now;
+	return true;
+}
+
+unsigned LoopDetector::takeCount()
+{
+	unsigned count = m_count;
+	m_count = 0;
+	return count;
+}
+
+uint64_t LoopDetector::getTotal() const
+{
+	return m_total;
+}
@@ -0,0 +1,68 @@
+/*
+ * osc2midi - a bridge between OSC and (ALSA) MIDI.
+ * Copyright (C) 2018  Vilniaus Blokas UAB, https://blokas.io/
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2 of the
+ * License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef LOOP_DETECTOR_H
+#define LOOP_DETECTOR_H
+
+#include <stdint.h>
+
+// Remembers the messages recently sent to ALSA in a small direct mapped hash
+// window. A message coming back from ALSA within the window is most likely our
+// own output routed back to us, which would otherwise be amplified into a storm.
+class LoopDetector
+{
+public:
+	LoopDetector();
+
+	// 0 disables the detection.
+	void setWindow(unsigned ms);
+
+	void emitted(const uint8_t msg[3], unsigned len, uint64_t now);
+
+	bool isEcho(const uint8_t msg[3], unsigned len, uint64_t now) const;
+
+	// Counts a detected loop event, returns true when it's time to report the
+	// accumulated count, at most once a second.
+	bool looped(uint64_t now);
+
+	// Returns and resets the count of loop events since the last report.
+	unsigned takeCount();
+
+	uint64_t getTotal() const;
+
+private:
+	enum { SLOTS = 256 };
+
+	struct Slot
+	{
+		uint32_t m_fingerprint;
+		uint32_t m_time;
+	};
+
+	static inline uint32_t fingerprint(const uint8_t msg[3], unsigned len);
+	static inline unsigned slotOf(uint32_t fingerprint);
+
+	unsigned m_window;
+	Slot m_slots[SLOTS];
+	uint64_t m_lastReport;
+	unsigned m_count;
+	uint64_t m_total;
+};
+
+#endif // LOOP_DETECTOR_H
@@ -0,0 +1,210 @@
+/*
+ * osc2midi - a bridge between OSC and (ALSA) MIDI.
+ * Copyright (C) 2018  Vilniaus Blokas UAB, https://blokas.io/
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2 of the
+ * License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include "metrics.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+MetricsPublisher::MetricsPublisher()
+	:m_path(NULL)
+	,m_fd(-1)
+	,m_segment(NULL)
+{
+}
+
+MetricsPublisher::~MetricsPublisher()
+{
+	close();
+}
+
+int MetricsPublisher::open(const char *path)
+{
+	close();
+
+	// Truncating would pull the pages from under the bridge or the readers mapping it.
+	int fd = ::open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+	if (fd < 0)
+	{
+		fprintf(stderr, "Failed to open '%s'! (%d)\n", path, errno);
+		return -errno;
+	}
+
+	// The lock is held while the file is published, only a file left behind by a
+	// bridge which is gone gets reused.
+	if (flock(fd, LOCK_EX | LOCK_NB) < 0)
+	{
+		int err = errno;
+		if (err == EWOULDBLOCK)
+			fprintf(stderr, "'%s' is in use by another bridge!\n", path);
+		else
+			fprintf(stderr, "Failed to lock '%s'! (%d)\n", path, err);
+		::close(fd);
+		return err == EWOULDBLOCK ? -EBUSY : -err;
+	}
+
+	int result = 0;
+	void *p = MAP_FAILED;
+	struct stat st;
+
+	if (fstat(fd, &st) < 0 || (st.st_size != sizeof(MetricsSegment) && ftruncate(fd, sizeof(MetricsSegment)) < 0))
+	{
+		result = -errno;
+		goto error;
+	}
+
+	p = mmap(NULL, sizeof(MetricsSegment), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (p == MAP_FAILED)
+	{
+		result = -errno;
+		goto error;
+	}
+
+	m_path = path;
+	m_fd = fd;
+	m_segment = (MetricsSegment*)p;
+
+	// A monitor may still have the file of the previous bridge mapped, reset the
+	// contents under the seqlock, making the sequence odd first in case it crashed
+	// mid-write.
+	__atomic_store_n(&m_segment->m_sequence, m_segment->m_sequence | 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	memset(&m_segment->m_data, 0, sizeof(m_segment->m_data));
+	m_segment->m_magic = METRICS_MAGIC;
+	m_segment->m_version = METRICS_VERSION;
+	m_segment->m_size = sizeof(MetricsSegment);
+	m_segment->m_pid = getpid();
+	endWrite();
+	return 0;
+
+error:
+	fprintf(stderr, "Failed to map '%s'! (%d)\n", path, -result);
+	unlink(path);
+	::close(fd);
+	return result;
+}
+
+void MetricsPublisher::close()
+{
+	if (!m_segment)
+		return;
+
+	munmap(m_segment, sizeof(MetricsSegment));
+	unlink(m_path);
+	::close(m_fd);
+	m_segment = NULL;
+	m_fd = -1;
+	m_path = NULL;
+}
+
+bool MetricsPublisher::isOpen() const
+{
+	return m_segment != NULL;
+}
+
+MetricsData *MetricsPublisher::beginWrite()
+{
+	__atomic_store_n(&m_segment->m_sequence, m_segment->m_sequence + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	return &m_segment->m_data;
+}
+
+void MetricsPublisher::endWrite()
+{
+	__atomic_store_n(&m_segment->m_sequence, m_segment->m_sequence + 1, __ATOMIC_RELEASE);
+}
+
+MetricsReader::MetricsReader()
+	:m_segment(NULL)
+{
+}
+
+MetricsReader::~MetricsReader()
+{
+	close();
+}
+
+int MetricsReader::open(const char *path)
+{
+	close();
+
+	int fd = ::open(path, O_RDONLY);
+	if (fd < 0)
+		return -errno;
+
+	struct stat st;
+	if (fstat(fd, &st) < 0 || st.st_size != sizeof(MetricsSegment))
+	{
+		::close(fd);
+		return -EPROTO;
+	}
+
+	void *p = mmap(NULL, sizeof(MetricsSegment), PROT_READ, MAP_SHARED, fd, 0);
+	::close(fd);
+	if (p == MAP_FAILED)
+		return -errno;
+
+	const MetricsSegment *segment = (const MetricsSegment*)p;
+	if (segment->m_magic != METRICS_MAGIC || segment->m_version != METRICS_VERSION || segment->m_size != sizeof(MetricsSegment))
+	{
+		munmap(p, sizeof(MetricsSegment));
+		return -EPROTO;
+	}
+
+	m_segment = segment;
+	return 0;
+}
+
+void MetricsReader::close()
+{
+	if (!m_segment)
+		return;
+
+	munmap((void*)m_segment, sizeof(MetricsSegment));
+	m_segment = NULL;
+}
+
+bool MetricsReader::read(MetricsData &out) const
+{
+	for (int attempt=0; attempt<1000; ++attempt)
+	{
+		uint32_t sequence = __atomic_load_n(&m_segment->m_sequence, __ATOMIC_ACQUIRE);
+		if (sequence & 1)
+			continue;
+
+		memcpy(&out, (const void*)&m_segment->m_data, sizeof(out));
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+		if (__atomic_load_n(&m_segment->m_sequence, __ATOMIC_RELAXED) == sequence)
+			return true;
+	}
+
+	return false;
+}
+
+uint32_t MetricsReader::getPid() const
+{
+	return m_segment->m_pid;
+}
@@ -0,0 +1,112 @@
+/*
+ * osc2midi - a bridge between OSC and (ALSA) MIDI.
+ * Copyright (C) 2018  Vilniaus Blokas UAB, https://blokas.io/
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2 of the
+ * License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdint.h>
+
+#include "stats.h"
+
+#define METRICS_DEFAULT_PATH "/dev/shm/osc2midi"
+
+enum
+{
+	METRICS_MAGIC     = 0x4d4d324f, // "O2MM" in little endian.
+	METRICS_VERSION   = 1,
+	METRICS_MAX_PEERS = 32,
+};
+
+struct MetricsPeer
+{
+	char m_address[24]; // "a.b.c.d:port"
+	PeerStats m_stats;
+};
+
+struct MetricsData
+{
+	uint64_t m_timestamp; // Of the last update, milliseconds, CLOCK_MONOTONIC.
+	uint64_t m_startTime;
+	uint32_t m_shedLevel; // OverloadShedder::Level.
+	uint32_t m_peerCount;
+	Stats m_stats;
+	MetricsPeer m_peers[METRICS_MAX_PEERS];
+};
+
+// Layout of the metrics file. The header never changes within a version, the data
+// is protected by a seqlock: the sequence is odd while the data is being written,
+// readers copy the data and retry if the sequence was odd or changed meanwhile.
+struct MetricsSegment
+{
+	uint32_t m_magic;
+	uint32_t m_version;
+	uint32_t m_size; // sizeof(MetricsSegment)
+	uint32_t m_pid;
+	uint32_t m_sequence __attribute__((aligned(CACHE_LINE_SIZE)));
+	MetricsData m_data __attribute__((aligned(CACHE_LINE_SIZE)));
+};
+
+// Publishes the metrics of the bridge in a memory mapped file, normally under /dev/shm,
+// so they can be monitored without any syscalls or messages to the bridge.
+class MetricsPublisher
+{
+public:
+	MetricsPublisher();
+	~MetricsPublisher();
+
+	// Returns 0 on success, -EBUSY if another bridge publishes to path, negative
+	// error code otherwise.
+	int open(const char *path);
+
+	// Unmaps and removes the file.
+	void close();
+
+	bool isOpen() const;
+
+	// Returns the data to update, must be followed by endWrite.
+	MetricsData *beginWrite();
+	void endWrite();
+
+private:
+	const char *m_path;
+	int m_fd; // Holds the lock on the file.
+	MetricsSegment *m_segment;
+};
+
+class MetricsReader
+{
+public:
+	MetricsReader();
+	~MetricsReader();
+
+	// Returns 0 on success, negative error code otherwise.
+	int open(const char *path);
+
+	void close();
+
+	// Takes a consistent copy of the data, returns false if it kept changing meanwhile.
+	bool read(MetricsData &out) const;
+
+	uint32_t getPid() const;
+
+private:
+	const MetricsSegment *m_segment;
+};
+
+#endif // METRICS_H
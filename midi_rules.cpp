@@ -0,0 +1,377 @@
+/*
+ * osc2midi - a bridge between OSC and (ALSA) MIDI.
+ * Copyright (C) 2018  Vilniaus Blokas UAB, https://blokas.io/
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2 of the
+ * License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include "midi_rules.h"
+#include "config_reader.h"
+
+#include <string.h>
+#include <errno.h>
+
+struct MidiTypeName
+{
+	const char *m_name;
+	uint32_t m_mask;
+};
+
+// Bits 0-6 are the channel message types 0x8n-0xen, bits 7-22 are the system statuses 0xf0-0xff.
+static inline uint32_t status_type_bit(uint8_t status)
+{
+	return status < 0xf0 ? 1u << ((status >> 4) - 8) : 1u << (7 + (status - 0xf0));
+}
+
+#define SYS_BIT(status) (1u << (7 + ((status) - 0xf0)))
+
+static const MidiTypeName MIDI_TYPE_NAMES[] = {
+	{ "note",         (1u << 0) | (1u << 1) },
+	{ "noteoff",      1u << 0 },
+	{ "noteon",       1u << 1 },
+	{ "polypressure", 1u << 2 },
+	{ "cc",           1u << 3 },
+	{ "program",      1u << 4 },
+	{ "chanpressure", 1u << 5 },
+	{ "pitchbend",    1u << 6 },
+	{ "voice",        0x7f },
+	{ "sysex",        SYS_BIT(0xf0) },
+	{ "mtc",          SYS_BIT(0xf1) },
+	{ "songpos",      SYS_BIT(0xf2) },
+	{ "songsel",      SYS_BIT(0xf3) },
+	{ "tune",         SYS_BIT(0xf6) },
+	{ "clock",        SYS_BIT(0xf8) },
+	{ "start",        SYS_BIT(0xfa) },
+	{ "continue",     SYS_BIT(0xfb) },
+	{ "stop",         SYS_BIT(0xfc) },
+	{ "sensing",      SYS_BIT(0xfe) },
+	{ "reset",        SYS_BIT(0xff) },
+	{ "realtime",     SYS_BIT(0xf8) | SYS_BIT(0xfa) | SYS_BIT(0xfb) | SYS_BIT(0xfc) | SYS_BIT(0xfe) | SYS_BIT(0xff) },
+	{ "system",       0xffffu << 7 },
+	{ "any",          0x7fffffu },
+};
+
+static bool parseTypes(char *str, uint32_t &mask)
+{
+	mask = 0;
+	char *save;
+	for (char *t = strtok_r(str, ",", &save); t; t = strtok_r(NULL, ",", &save))
+	{
+		unsigned i;
+		for (i=0; i<sizeof(MIDI_TYPE_NAMES)/sizeof(MIDI_TYPE_NAMES[0]); ++i)
+		{
+			if (strcmp(t, MIDI_TYPE_NAMES[i].m_name) == 0)
+			{
+				mask |= MIDI_TYPE_NAMES[i].m_mask;
+				break;
+			}
+		}
+		if (i == sizeof(MIDI_TYPE_NAMES)/sizeof(MIDI_TYPE_NAMES[0]))
+			return false;
+	}
+	return mask != 0;
+}
+
+MidiRules::MidiRules()
+{
+	clear();
+}
+
+void MidiRules::clear()
+{
+	memset(m_table, 0, sizeof(m_table));
+	memset(m_actions, 0, sizeof(m_actions));
+	m_actions[0].m_op = OP_PASS;
+	m_actions[0].m_channel = 0xff;
+	m_actions[0].m_cable = 0xff;
+	m_actionCount = 1;
+	m_valueTableCount = 0;
+}
+
+bool MidiRules::isEmpty() const
+{
+	return m_actionCount == 1;
+}
+
+int MidiRules::addAction(const Action &action)
+{
+	for (unsigned i=0; i<m_actionCount; ++i)
+	{
+		if (memcmp(&m_actions[i], &action, sizeof(action)) == 0)
+			return i;
+	}
+
+	if (m_actionCount >= MAX_ACTIONS)
+		return -ENOSPC;
+
+	m_actions[m_actionCount] = action;
+	return m_actionCount++;
+}
+
+int MidiRules::addValueTable(const uint8_t values[128])
+{
+	for (unsigned i=0; i<m_valueTableCount; ++i)
+	{
+		if (memcmp(m_values[i], values, 128) == 0)
+			return i;
+	}
+
+	if (m_valueTableCount >= MAX_VALUE_TABLES)
+		return -ENOSPC;
+
+	memcpy(m_values[m_valueTableCount], values, 128);
+	return m_valueTableCount++;
+}
+
+int MidiRules::compile(const Rule &rule)
+{
+	int action = addAction(rule.m_action);
+	if (action < 0)
+		return action;
+
+	bool fullRange = !rule.m_hasValue || (rule.m_valueLo == 0 && rule.m_valueHi == 127);
+
+	for (int dir=0; dir<MIDI_DIR_COUNT; ++dir)
+	{
+		if ((rule.m_dirMask & (1 << dir)) == 0)
+			continue;
+
+		for (int cable=rule.m_cableLo; cable<=rule.m_cableHi; ++cable)
+		{
+			for (int status=0x80; status<=0xff; ++status)
+			{
+				if ((rule.m_typeMask & status_type_bit(status)) == 0)
+					continue;
+
+				if (midi_is_channel_status(status))
+				{
+					int channel = status & 0x0f;
+					if (channel < rule.m_channelLo || channel > rule.m_channelHi)
+						continue;
+				}
+				else if (rule.m_channelLo != 0 || rule.m_channelHi != 15 || rule.m_hasValue)
+				{
+					continue;
+				}
+
+				uint16_t &entry = m_table[dir][cable][status & 0x7f];
+
+				if (fullRange)
+				{
+					entry = action;
+					continue;
+				}
+
+				uint8_t values[128];
+				if (entry & VALUE_TABLE)
+					memcpy(values, m_values[entry & ~VALUE_TABLE], sizeof(values));
+				else
+					memset(values, entry, sizeof(values));
+
+				memset(values + rule.m_valueLo, action, rule.m_valueHi - rule.m_valueLo + 1);
+
+				int table = addValueTable(values);
+				if (table < 0)
+					return table;
+
+				entry = VALUE_TABLE | table;
+			}
+		}
+	}
+
+	return 0;
+}
+
+int MidiRules::load(const char *fileName)
+{
+	clear();
+
+	ConfigReader reader;
+	int result = reader.open(fileName);
+	if (result < 0)
+		return result;
+
+	static Rule rules[MAX_RULES];
+	unsigned count = 0;
+
+	char *tokens[ConfigReader::MAX_TOKENS];
+	int n;
+	while ((n = reader.readLine(tokens)) > 0)
+	{
+		if (count >= MAX_RULES)
+		{
+			reader.error("Too many rules, at most %d are supported!", MAX_RULES);
+			return -ENOSPC;
+		}
+
+		Rule &rule = rules[count];
+		memset(&rule, 0, sizeof(rule));
+		rule.m_cableHi = 15;
+		rule.m_channelHi = 15;
+		rule.m_typeMask = 0x7fffffu;
+		rule.m_action.m_channel = 0xff;
+		rule.m_action.m_cable = 0xff;
+
+		if (strcmp(tokens[0], "in") == 0)
+			rule.m_dirMask = 1 << MIDI_DIR_IN;
+		else if (strcmp(tokens[0], "out") == 0)
+			rule.m_dirMask = 1 << MIDI_DIR_OUT;
+		else if (strcmp(tokens[0], "any") == 0)
+			rule.m_dirMask = (1 << MIDI_DIR_IN) | (1 << MIDI_DIR_OUT);
+		else
+		{
+			reader.error("Expected 'in', 'out' or 'any', got '%s'!", tokens[0]);
+			return -EINVAL;
+		}
+
+		bool haveAction = false;
+		for (int i=1; i<n; ++i)
+		{
+			char *key, *value;
+			int lo, hi;
+
+			if (!ConfigReader::splitKeyValue(tokens[i], key, value))
+			{
+				if (haveAction)
+				{
+					reader.error("Only one action is allowed per rule!");
+					return -EINVAL;
+				}
+
+				haveAction = true;
+				if (strcmp(tokens[i], "drop") == 0)
+					rule.m_action.m_op = OP_DROP;
+				else if (strcmp(tokens[i], "pass") == 0)
+					rule.m_action.m_op = OP_PASS;
+				else if (strcmp(tokens[i], "route") == 0)
+					rule.m_action.m_op = OP_ROUTE;
+				else if (strcmp(tokens[i], "split") == 0)
+					rule.m_action.m_op = OP_SPLIT;
+				else
+				{
+					reader.error("Unknown action '%s'!", tokens[i]);
+					return -EINVAL;
+				}
+				continue;
+			}
+
+			if (haveAction)
+			{
+				if (strcmp(key, "channel") == 0 && ConfigReader::parseInt(value, 1, 16, lo))
+					rule.m_action.m_channel = lo - 1;
+				else if (strcmp(key, "cable") == 0 && ConfigReader::parseInt(value, 0, 15, lo))
+					rule.m_action.m_cable = lo;
+				else
+				{
+					reader.error("Invalid action argument '%s=%s'!", key, value);
+					return -EINVAL;
+				}
+			}
+			else if (strcmp(key, "cable") == 0 && ConfigReader::parseRange(value, 0, 15, lo, hi))
+			{
+				rule.m_cableLo = lo;
+				rule.m_cableHi = hi;
+			}
+			else if (strcmp(key, "channel") == 0 && ConfigReader::parseRange(value, 1, 16, lo, hi))
+			{
+				rule.m_channelLo = lo - 1;
+				rule.m_channelHi = hi - 1;
+			}
+			else if (strcmp(key, "value") == 0 && ConfigReader::parseRange(value, 0, 127, lo, hi))
+			{
+				rule.m_hasValue = true;
+				rule.m_valueLo = lo;
+				rule.m_valueHi = hi;
+			}
+			else if (strcmp(key, "type") == 0 && parseTypes(value, rule.m_typeMask))
+			{
+			}
+			else
+			{
+				reader.error("Invalid match '%s=%s'!", key, value);
+				return -EINVAL;
+			}
+		}
+
+		if (!haveAction)
+		{
+			reader.error("Rule has no action!");
+			return -EINVAL;
+		}
+
+		if ((rule.m_action.m_op == OP_ROUTE || rule.m_action.m_op == OP_SPLIT) &&
+			rule.m_action.m_channel == 0xff && rule.m_action.m_cable == 0xff)
+		{
+			reader.error("'route' and 'split' need a channel or cable argument!");
+			return -EINVAL;
+		}
+
+		++count;
+	}
+
+	// Compiling in reverse order lets the earlier rules overwrite the later ones, so the first match wins.
+	while (count-- > 0)
+	{
+		result = compile(rules[count]);
+		if (result < 0)
+		{
+			ConfigReader::report("%s: Rules too complex to compile! (%d)\n", fileName, result);
+			clear();
+			return result;
+		}
+	}
+
+	return 0;
+}
+
+void MidiRules::rewrite(const Action &action, const midi_event_t &in, midi_event_t &out)
+{
+	out = in;
+	if (action.m_cable != 0xff)
+		out.m_event = (action.m_cable << 4) | (in.m_event & 0x0f);
+	if (action.m_channel != 0xff && midi_is_channel_status(midi_event_status(in)))
+		out.m_data[0] = (in.m_data[0] & 0xf0) | action.m_channel;
+}
+
+unsigned MidiRules::apply(MidiDirection dir, const midi_event_t &in, midi_event_t out[2]) const
+{
+	uint8_t status = midi_event_status(in);
+	uint16_t entry = m_table[dir][in.m_event >> 4][status & 0x7f];
+
+	const Action &action = m_actions[(entry & VALUE_TABLE) ? m_values[entry & ~VALUE_TABLE][in.m_data[1] & 0x7f] : entry];
+
+	switch (action.m_op)
+	{
+	case OP_DROP:
+		return 0;
+	case OP_ROUTE:
+		rewrite(action, in, out[0]);
+		return 1;
+	case OP_SPLIT:
+		out[0] = in;
+		rewrite(action, in, out[1]);
+		return 2;
+	case OP_PASS:
+	default:
+		out[0] = in;
+		return 1;
+	}
+}
+
+bool MidiRules::dropsStatus(MidiDirection dir, int cable, uint8_t status) const
+{
+	uint16_t entry = m_table[dir][cable & 0x0f][status & 0x7f];
+	return (entry & VALUE_TABLE) == 0 && m_actions[entry].m_op == OP_DROP;
+}
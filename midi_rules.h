@@ -0,0 +1,116 @@
+/*
+ * osc2midi - a bridge between OSC and (ALSA) MIDI.
+ * Copyright (C) 2018  Vilniaus Blokas UAB, https://blokas.io/
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2 of the
+ * License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef MIDI_RULES_H
+#define MIDI_RULES_H
+
+#include <stdint.h>
+
+#include "midi_serialization.h"
+
+// Drop / route / split rules, compiled into a table indexed by direction,
+// cable and status byte, so applying them costs a single lookup per event.
+//
+// Rules file format, one rule per line, the first matching rule wins:
+//
+// <in|out|any> [cable=N[-M]] [channel=N[-M]] [type=T[,T...]] [value=N[-M]] <action>
+//
+// Actions:
+//
+// drop
+// pass
+// route [channel=N] [cable=N]  - rewrite the event.
+// split [channel=N] [cable=N]  - pass the event and also emit a rewritten copy.
+//
+// Channels are 1-16, cables are 0-15, value is the first data byte of a
+// channel message (note, controller, program, pressure).
+//
+// Example:
+//
+// out type=sensing,clock drop
+// in channel=1 type=note value=0-59 route channel=2
+class MidiRules
+{
+public:
+	MidiRules();
+
+	void clear();
+
+	// Returns 0 on success, negative error code otherwise.
+	int load(const char *fileName);
+
+	// Writes the resulting events to out, returns their count, 0 if dropped.
+	unsigned apply(MidiDirection dir, const midi_event_t &in, midi_event_t out[2]) const;
+
+	// True if all of the events with the given status get dropped, regardless of their data.
+	bool dropsStatus(MidiDirection dir, int cable, uint8_t status) const;
+
+	bool isEmpty() const;
+
+private:
+	enum Op
+	{
+		OP_PASS,
+		OP_DROP,
+		OP_ROUTE,
+		OP_SPLIT,
+	};
+
+	struct Action
+	{
+		uint8_t m_op;
+		uint8_t m_channel; // 0xff - keep.
+		uint8_t m_cable;   // 0xff - keep.
+	};
+
+	struct Rule
+	{
+		uint8_t m_dirMask;
+		uint8_t m_cableLo, m_cableHi;
+		uint8_t m_channelLo, m_channelHi;
+		uint32_t m_typeMask;
+		bool m_hasValue;
+		uint8_t m_valueLo, m_valueHi;
+		Action m_action;
+	};
+
+	enum
+	{
+		MAX_RULES        = 256,
+		MAX_ACTIONS      = 256,
+		MAX_VALUE_TABLES = 256,
+		VALUE_TABLE      = 0x8000,
+	};
+
+	int compile(const Rule &rule);
+	int addAction(const Action &action);
+	int addValueTable(const uint8_t values[128]);
+
+	static void rewrite(const Action &action, const midi_event_t &in, midi_event_t &out);
+
+	// Index 0 is always the implicit pass action. Entries with VALUE_TABLE bit
+	// set refer to m_values, which are indexed by the first data byte.
+	uint16_t m_table[MIDI_DIR_COUNT][16][128];
+	Action m_actions[MAX_ACTIONS];
+	uint8_t m_values[MAX_VALUE_TABLES][128];
+	unsigned m_actionCount;
+	unsigned m_valueTableCount;
+};
+
+#endif // MIDI_RULES_H
@@ -30,6 +30,44 @@ struct midi_event_t
 
 #ifdef __cplusplus
 
+enum MidiDirection
+{
+	MIDI_DIR_IN  = 0, // OSC -> ALSA.
+	MIDI_DIR_OUT = 1, // ALSA -> OSC.
+
+	MIDI_DIR_COUNT
+};
+
+// Returns the MIDI status byte the event belongs to. All of the SysEx packets,
+// including the continuation ones and the one carrying 0xf7, map to 0xf0.
+static inline uint8_t midi_event_status(const midi_event_t &ev)
+{
+	switch (ev.m_event & 0x0f)
+	{
+	case 0x2:
+	case 0x3:
+	case 0x5:
+	case 0x8:
+	case 0x9:
+	case 0xA:
+	case 0xB:
+	case 0xC:
+	case 0xD:
+	case 0xE:
+	case 0xF:
+		if ((ev.m_data[0] & 0x80) && ev.m_data[0] != 0xf0 && ev.m_data[0] != 0xf7)
+			return ev.m_data[0];
+		return 0xf0;
+	default:
+		return 0xf0;
+	}
+}
+
+static inline bool midi_is_channel_status(uint8_t status)
+{
+	return status >= 0x80 && status < 0xf0;
+}
+
 class MidiToUsb
 {
 public:
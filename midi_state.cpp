@@ -0,0 +1,140 @@
+/*
+ * osc2midi - a bridge between OSC and (ALSA) MIDI.
+ * Copyright (C) 2018  Vilniaus Blokas UAB, https://blokas.io/
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2 of the
+ * License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include "midi_state.h"
+
+#include <string.h>
+
+MidiState::MidiState()
+{
+	clear();
+}
+
+void MidiState::clear()
+{
+	m_version = 0;
+	memset(m_channels, 0, sizeof(m_channels));
+}
+
+uint32_t MidiState::getVersion() const
+{
+	return m_version;
+}
+
+inline void MidiState::set(Channel &c, unsigned slot, uint8_t value)
+{
+	if (c.m_versions[slot] != 0 && c.m_values[slot] == value)
+		return;
+
+	c.m_values[slot] = value;
+	c.m_versions[slot] = c.m_version = ++m_version;
+}
+
+void MidiState::update(int cable, const uint8_t msg[3])
+{
+	Channel &c = m_channels[cable & 0x0f][msg[0] & 0x0f];
+
+	switch (msg[0] & 0xf0)
+	{
+	case 0xb0:
+		set(c, msg[1] & 0x7f, msg[2] & 0x7f);
+		break;
+	case 0xc0:
+		set(c, SLOT_PROGRAM, msg[1] & 0x7f);
+		break;
+	case 0xd0:
+		set(c, SLOT_PRESSURE, msg[1] & 0x7f);
+		break;
+	case 0xe0:
+		// The MSB is stored separately, the LSB slot carries the version of both.
+		if (c.m_bendMsb != (msg[2] & 0x7f))
+		{
+			c.m_bendMsb = msg[2] & 0x7f;
+			c.m_versions[SLOT_PITCHBEND] = 0;
+		}
+		set(c, SLOT_PITCHBEND, msg[1] & 0x7f);
+		break;
+	}
+}
+
+bool MidiState::isCurrent(int cable, const uint8_t msg[3]) const
+{
+	if ((msg[0] & 0xf0) != 0xb0)
+		return false;
+
+	const Channel &c = m_channels[cable & 0x0f][msg[0] & 0x0f];
+	unsigned slot = msg[1] & 0x7f;
+	return c.m_versions[slot] != 0 && c.m_values[slot] == (msg[2] & 0x7f);
+}
+
+unsigned MidiState::collect(uint32_t since, unsigned &cursor, midi_event_t *out, unsigned max) const
+{
+	unsigned n = 0;
+
+	while (cursor < END && n < max)
+	{
+		unsigned cable = cursor / (16 * SLOT_COUNT);
+		unsigned channel = (cursor / SLOT_COUNT) & 0x0f;
+		unsigned slot = cursor % SLOT_COUNT;
+		const Channel &c = m_channels[cable][channel];
+
+		if (slot == 0 && c.m_version <= since)
+		{
+			cursor += SLOT_COUNT;
+			continue;
+		}
+
+		++cursor;
+
+		if (c.m_versions[slot] <= since)
+			continue;
+
+		midi_event_t &ev = out[n++];
+		uint8_t value = c.m_values[slot];
+		switch (slot)
+		{
+		case SLOT_PROGRAM:
+			ev.m_event = (cable << 4) | 0x0c;
+			ev.m_data[0] = 0xc0 | channel;
+			ev.m_data[1] = value;
+			ev.m_data[2] = 0;
+			break;
+		case SLOT_PRESSURE:
+			ev.m_event = (cable << 4) | 0x0d;
+			ev.m_data[0] = 0xd0 | channel;
+			ev.m_data[1] = value;
+			ev.m_data[2] = 0;
+			break;
+		case SLOT_PITCHBEND:
+			ev.m_event = (cable << 4) | 0x0e;
+			ev.m_data[0] = 0xe0 | channel;
+			ev.m_data[1] = value;
+			ev.m_data[2] = c.m_bendMsb;
+			break;
+		default:
+			ev.m_event = (cable << 4) | 0x0b;
+			ev.m_data[0] = 0xb0 | channel;
+			ev.m_data[1] = slot;
+			ev.m_data[2] = value;
+			break;
+		}
+	}
+
+	return n;
+}
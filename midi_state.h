@@ -0,0 +1,75 @@
+/*
+ * osc2midi - a bridge between OSC and (ALSA) MIDI.
+ * Copyright (C) 2018  Vilniaus Blokas UAB, https://blokas.io/
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2 of the
+ * License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef MIDI_STATE_H
+#define MIDI_STATE_H
+
+#include <stdint.h>
+
+#include "midi_serialization.h"
+
+// Last known controller, program, channel pressure and pitch bend values per
+// cable and channel. Every change bumps the version, so the values changed since
+// a version the client already has can be collected without replaying traffic.
+class MidiState
+{
+public:
+	enum { END = 16 * 16 * 131 };
+
+	MidiState();
+
+	void clear();
+
+	// Updates the state from a raw MIDI message, other than channel state messages are ignored.
+	void update(int cable, const uint8_t msg[3]);
+
+	// Returns true if the message is a Control Change to the value already in the state.
+	bool isCurrent(int cable, const uint8_t msg[3]) const;
+
+	uint32_t getVersion() const;
+
+	// Writes up to max of the values changed after since to out as events, starting
+	// at cursor, which should be 0 initially. Returns the number of events written,
+	// the cursor is END once everything is collected.
+	unsigned collect(uint32_t since, unsigned &cursor, midi_event_t *out, unsigned max) const;
+
+private:
+	enum
+	{
+		SLOT_PROGRAM   = 128,
+		SLOT_PRESSURE  = 129,
+		SLOT_PITCHBEND = 130,
+		SLOT_COUNT     = 131,
+	};
+
+	struct Channel
+	{
+		uint32_t m_version; // Latest version of any of the slots.
+		uint32_t m_versions[SLOT_COUNT]; // 0 - never set.
+		uint8_t m_values[SLOT_COUNT];
+		uint8_t m_bendMsb;
+	};
+
+	inline void set(Channel &c, unsigned slot, uint8_t value);
+
+	uint32_t m_version;
+	Channel m_channels[16][16];
+};
+
+#endif // MIDI_STATE_H
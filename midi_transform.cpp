@@ -0,0 +1,322 @@
+/*
+ * osc2midi - a bridge between OSC and (ALSA) MIDI.
+ * Copyright (C) 2018  Vilniaus Blokas UAB, https://blokas.io/
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2 of the
+ * License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include "midi_transform.h"
+#include "config_reader.h"
+
+#include <new>
+#include <math.h>
+#include <string.h>
+#include <errno.h>
+
+void MidiTransform::Tables::reset()
+{
+	for (int dir=0; dir<MIDI_DIR_COUNT; ++dir)
+	{
+		for (int ch=0; ch<16; ++ch)
+		{
+			m_channel[dir][ch] = ch;
+			for (int i=0; i<128; ++i)
+			{
+				m_note[dir][ch][i] = i;
+				m_velocity[dir][ch][i] = i;
+			}
+		}
+	}
+	memset(m_cc, 0, sizeof(m_cc));
+	for (int i=0; i<128; ++i)
+		m_curves[0][i] = i;
+	m_curveCount = 1;
+}
+
+int MidiTransform::Tables::addCurve(const uint8_t curve[128])
+{
+	for (unsigned i=0; i<m_curveCount; ++i)
+	{
+		if (memcmp(m_curves[i], curve, 128) == 0)
+			return i;
+	}
+
+	if (m_curveCount >= MAX_CURVES)
+		return -ENOSPC;
+
+	memcpy(m_curves[m_curveCount], curve, 128);
+	return m_curveCount++;
+}
+
+void MidiTransform::buildCurve(uint8_t curve[128], float gamma, int min, int max)
+{
+	for (int i=0; i<128; ++i)
+	{
+		float v = min + (max - min) * powf(i / 127.0f, gamma);
+		int r = (int)lrintf(v);
+		curve[i] = r < 0 ? 0 : r > 127 ? 127 : r;
+	}
+}
+
+MidiTransform::MidiTransform()
+	:m_tables(NULL)
+	,m_spare(NULL)
+{
+}
+
+MidiTransform::~MidiTransform()
+{
+	clear();
+}
+
+void MidiTransform::clear()
+{
+	delete m_tables;
+	m_tables = NULL;
+	delete m_spare;
+	m_spare = NULL;
+}
+
+static int parseDirection(const ConfigReader &reader, const char *str, int &dirMask)
+{
+	if (strcmp(str, "in") == 0)
+		dirMask = 1 << MIDI_DIR_IN;
+	else if (strcmp(str, "out") == 0)
+		dirMask = 1 << MIDI_DIR_OUT;
+	else if (strcmp(str, "any") == 0)
+		dirMask = (1 << MIDI_DIR_IN) | (1 << MIDI_DIR_OUT);
+	else
+	{
+		reader.error("Expected 'in', 'out' or 'any', got '%s'!", str);
+		return -EINVAL;
+	}
+	return 0;
+}
+
+// Parses the optional gamma=, min= and max= arguments.
+static int parseCurveArgs(const ConfigReader &reader, char *tokens[], int n, float &gamma, int &min, int &max)
+{
+	for (int i=0; i<n; ++i)
+	{
+		char *key, *value;
+		if (!ConfigReader::splitKeyValue(tokens[i], key, value))
+		{
+			reader.error("Expected key=value, got '%s'!", tokens[i]);
+			return -EINVAL;
+		}
+
+		if (strcmp(key, "gamma") == 0 && ConfigReader::parseFloat(value, gamma) && gamma > 0.0f)
+			continue;
+		if (strcmp(key, "min") == 0 && ConfigReader::parseInt(value, 0, 127, min))
+			continue;
+		if (strcmp(key, "max") == 0 && ConfigReader::parseInt(value, 0, 127, max))
+			continue;
+
+		reader.error("Invalid argument '%s=%s'!", key, value);
+		return -EINVAL;
+	}
+	return 0;
+}
+
+int MidiTransform::load(const char *fileName)
+{
+	ConfigReader reader;
+	int result = reader.open(fileName);
+	if (result < 0)
+		return result;
+
+	Tables *t = m_spare ? m_spare : new (std::nothrow) Tables;
+	m_spare = NULL;
+	if (!t)
+		return -ENOMEM;
+
+	t->reset();
+
+	char *tokens[ConfigReader::MAX_TOKENS];
+	int n;
+	while ((n = reader.readLine(tokens)) > 0)
+	{
+		int dirMask;
+		result = parseDirection(reader, tokens[0], dirMask);
+		if (result < 0)
+			goto error;
+
+		int i = 1;
+		int chLo = 1, chHi = 16;
+		char *key, *value;
+		if (i < n && ConfigReader::splitKeyValue(tokens[i], key, value))
+		{
+			if (strcmp(key, "channel") != 0 || !ConfigReader::parseRange(value, 1, 16, chLo, chHi))
+			{
+				reader.error("Invalid match '%s=%s'!", key, value);
+				result = -EINVAL;
+				goto error;
+			}
+			++i;
+		}
+
+		if (i >= n)
+		{
+			reader.error("Missing transform!");
+			result = -EINVAL;
+			goto error;
+		}
+
+		const char *what = tokens[i++];
+		int semitones = 0, ccLo = 0, ccHi = -1, target = 0;
+		uint8_t curve[128];
+
+		if (strcmp(what, "transpose") == 0)
+		{
+			if (i + 1 != n || !ConfigReader::parseInt(tokens[i], -127, 127, semitones))
+			{
+				reader.error("Expected 'transpose <semitones>'!");
+				result = -EINVAL;
+				goto error;
+			}
+		}
+		else if (strcmp(what, "velocity") == 0 || strcmp(what, "cc") == 0)
+		{
+			bool velocity = what[0] == 'v';
+			if (!velocity && (i >= n || !ConfigReader::parseRange(tokens[i++], 0, 127, ccLo, ccHi)))
+			{
+				reader.error("Expected 'cc <controller[-controller]>'!");
+				result = -EINVAL;
+				goto error;
+			}
+
+			float gamma = 1.0f;
+			int min = velocity ? 1 : 0, max = 127;
+			result = parseCurveArgs(reader, tokens + i, n - i, gamma, min, max);
+			if (result < 0)
+				goto error;
+
+			buildCurve(curve, gamma, min, max);
+		}
+		else if (strcmp(what, "remap") == 0)
+		{
+			if (i + 1 != n || !ConfigReader::parseInt(tokens[i], 1, 16, target))
+			{
+				reader.error("Expected 'remap <channel>'!");
+				result = -EINVAL;
+				goto error;
+			}
+		}
+		else
+		{
+			reader.error("Unknown transform '%s'!", what);
+			result = -EINVAL;
+			goto error;
+		}
+
+		for (int dir=0; dir<MIDI_DIR_COUNT; ++dir)
+		{
+			if ((dirMask & (1 << dir)) == 0)
+				continue;
+
+			for (int ch=chLo-1; ch<chHi; ++ch)
+			{
+				switch (what[0])
+				{
+				case 't':
+					{
+						uint8_t *notes = t->m_note[dir][ch];
+						for (int k=0; k<128; ++k)
+						{
+							int note = notes[k] + semitones;
+							if (notes[k] != NOTE_DROP)
+								notes[k] = note >= 0 && note < 128 ? note : NOTE_DROP;
+						}
+					}
+					break;
+				case 'v':
+					{
+						// Velocity 0 is Note Off and must stay that way, the rest must not turn into it.
+						uint8_t *velocity = t->m_velocity[dir][ch];
+						for (int k=1; k<128; ++k)
+							velocity[k] = curve[velocity[k]] ? curve[velocity[k]] : 1;
+					}
+					break;
+				case 'c':
+					for (int cc=ccLo; cc<=ccHi; ++cc)
+					{
+						const uint8_t *prev = t->m_curves[t->m_cc[dir][ch][cc]];
+						uint8_t combined[128];
+						for (int k=0; k<128; ++k)
+							combined[k] = curve[prev[k]];
+
+						result = t->addCurve(combined);
+						if (result < 0)
+						{
+							reader.error("Too many distinct controller curves, at most %d are supported!", MAX_CURVES);
+							goto error;
+						}
+						t->m_cc[dir][ch][cc] = result;
+					}
+					break;
+				case 'r':
+					t->m_channel[dir][ch] = target - 1;
+					break;
+				}
+			}
+		}
+	}
+
+	// The event loop is single threaded, so the old tables are not in use once the pointer is replaced.
+	m_spare = m_tables;
+	__atomic_store_n(&m_tables, t, __ATOMIC_RELEASE);
+
+	// Reserve the tables for the reloads up front.
+	if (!m_spare)
+		m_spare = new (std::nothrow) Tables;
+	return 0;
+
+error:
+	m_spare = t;
+	return result;
+}
+
+bool MidiTransform::apply(MidiDirection dir, uint8_t msg[3]) const
+{
+	const Tables *t = __atomic_load_n(&m_tables, __ATOMIC_ACQUIRE);
+	if (!t)
+		return true;
+
+	uint8_t status = msg[0];
+	if (!midi_is_channel_status(status))
+		return true;
+
+	uint8_t ch = status & 0x0f;
+
+	switch (status & 0xf0)
+	{
+	case 0x90:
+		if (msg[2] != 0)
+			msg[2] = t->m_velocity[dir][ch][msg[2] & 0x7f];
+		// Fall through.
+	case 0x80:
+	case 0xa0:
+		msg[1] = t->m_note[dir][ch][msg[1] & 0x7f];
+		if (msg[1] == NOTE_DROP)
+			return false;
+		break;
+	case 0xb0:
+		msg[2] = t->m_curves[t->m_cc[dir][ch][msg[1] & 0x7f]][msg[2] & 0x7f];
+		break;
+	}
+
+	msg[0] = (status & 0xf0) | t->m_channel[dir][ch];
+	return true;
+}
@@ -0,0 +1,92 @@
+/*
+ * osc2midi - a bridge between OSC and (ALSA) MIDI.
+ * Copyright (C) 2018  Vilniaus Blokas UAB, https://blokas.io/
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2 of the
+ * License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef MIDI_TRANSFORM_H
+#define MIDI_TRANSFORM_H
+
+#include <stdint.h>
+
+#include "midi_serialization.h"
+
+// Per channel transforms of channel messages, precomputed into 128 entry tables,
+// so any combination of them costs a fixed number of lookups per event.
+//
+// Transform file format, one transform per line, transforms on the same channel
+// are composed in the order they're listed:
+//
+// <in|out|any> [channel=N[-M]] transpose <semitones>
+// <in|out|any> [channel=N[-M]] velocity [gamma=G] [min=N] [max=N]
+// <in|out|any> [channel=N[-M]] cc <controller[-controller]> [gamma=G] [min=N] [max=N]
+// <in|out|any> [channel=N[-M]] remap <channel>
+//
+// Notes transposed out of range get dropped. Velocity of Note On and the
+// controller values get mapped to min + (max - min) * (v / 127) ^ gamma,
+// min may be greater than max to invert the range. Remapping the channel
+// is done last, all the other transforms select the original channel.
+//
+// Example:
+//
+// in channel=1 transpose -12
+// in velocity gamma=0.6 min=20
+// out channel=10 cc 7 max=100
+class MidiTransform
+{
+public:
+	MidiTransform();
+	~MidiTransform();
+
+	// Builds the new tables and swaps them in only if the whole file is valid.
+	// The replaced tables are kept to build the next reload in, so only the
+	// first load allocates. Returns 0 on success, negative error code otherwise.
+	int load(const char *fileName);
+
+	void clear();
+
+	// Transforms a raw channel message in place, other messages are left intact.
+	// Returns false if the message should be dropped.
+	bool apply(MidiDirection dir, uint8_t msg[3]) const;
+
+private:
+	MidiTransform(const MidiTransform &);
+	MidiTransform &operator=(const MidiTransform &);
+
+	enum { MAX_CURVES = 256 };
+
+	enum { NOTE_DROP = 0xff };
+
+	struct Tables
+	{
+		uint8_t m_channel[MIDI_DIR_COUNT][16];
+		uint8_t m_note[MIDI_DIR_COUNT][16][128];
+		uint8_t m_velocity[MIDI_DIR_COUNT][16][128];
+		uint8_t m_cc[MIDI_DIR_COUNT][16][128]; // Index into m_curves, 0 is identity.
+		uint8_t m_curves[MAX_CURVES][128];
+		unsigned m_curveCount;
+
+		void reset();
+		int addCurve(const uint8_t curve[128]);
+	};
+
+	static void buildCurve(uint8_t curve[128], float gamma, int min, int max);
+
+	Tables *m_tables;
+	Tables *m_spare;
+};
+
+#endif // MIDI_TRANSFORM_H
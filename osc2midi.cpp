@@ -21,19 +21,49 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <assert.h>
-#include <alsa/asoundlib.h>
 #include <errno.h>
 #include <poll.h>
+#include <getopt.h>
+#include <signal.h>
+#include <time.h>
 
 #include <sys/socket.h>
 #include <arpa/inet.h>
 #include <fcntl.h>
 
+#include "seq_backend.h"
 #include "midi_serialization.h"
+#include "hex32.h"
+#include "config_reader.h"
+#include "midi_rules.h"
+#include "midi_transform.h"
+#include "semantic_osc.h"
+#include "osc_message.h"
+#include "osc_mapping.h"
+#include "osc_pattern.h"
+#include "midi_state.h"
+#include "peers.h"
+#include "loop_detector.h"
+#include "rate_limiter.h"
+#include "overload_shedder.h"
+#include "stats.h"
+#include "metrics.h"
+#include "latency_histogram.h"
+#include "tracer.h"
+#include "probes.h"
+#include "flight_recorder.h"
+#include "watchdog.h"
+#include "perf_counters.h"
+#include "logger.h"
+#include "alloc_guard.h"
+#include "capture.h"
 
 #define HOMEPAGE_URL "https://blokas.io/"
 #define OSC2MIDI_VERSION 0x0101
 
+// Tag of the ALSA events sent by osc2midi, to recognize them if they get routed back.
+#define SEQ_EVENT_TAG 0x4f
+
 // Sent to the provided host in the command line arguments.
 // The first argument is the port number, the 2nd is the given port name
 // (also provided on command line).
@@ -68,11 +98,194 @@ static const char MSG_BYE[] = {
 	'/', 'o', 's', 'c', '2', 'm', 'i', 'd', 'i', '/', 'b', 'y', 'e', '\0', '\0', '\0'
 };
 
-static snd_seq_t *g_seq;
+// Can be sent by a host to get the current controller, program, channel pressure and
+// pitch bend state. The optional argument is the version from an earlier reply, to get
+// only the values changed since then. The values are sent back to the querying host
+// in bundles of events, in the same format as MIDI Input, followed by MSG_SNAPSHOT_END.
+//
+// Example:
+//
+// /osc2midi/snapshot
+// /osc2midi/snapshot i 1234
+static const char MSG_SNAPSHOT[] = {
+	'/', 'o', 's', 'c', '2', 'm', 'i', 'd', 'i', '/', 's', 'n', 'a', 'p', 's', 'h',
+	'o', 't', '\0', '\0'
+};
+
+// Ends the reply to MSG_SNAPSHOT, the argument is the current state version.
+//
+// Example:
+//
+// /osc2midi/snapshot/end i 1234
+static const char MSG_SNAPSHOT_END[] = {
+	'/', 'o', 's', 'c', '2', 'm', 'i', 'd', 'i', '/', 's', 'n', 'a', 'p', 's', 'h',
+	'o', 't', '/', 'e', 'n', 'd', '\0', '\0', ',', 'i', '\0', '\0'
+};
+
+// Can be sent by a host to get the counters of the bridge. They are sent back to the
+// querying host in bundles of the following messages, ending with /osc2midi/stats/end.
+// <dir> is in or out, <type> is noteoff, noteon, polypressure, cc, program, chanpressure,
+// pitchbend, sysex, system or realtime, <reason> is rules, transform, rate, shed or loop.
+//
+// /osc2midi/stats/<dir>/<type> h events
+// /osc2midi/stats/<dir>/dropped/<reason> h events
+// /osc2midi/stats/<dir>/sysexbytes h bytes
+// /osc2midi/stats/packets h datagrams
+// /osc2midi/stats/parseerrors h messages
+// /osc2midi/stats/queue ii current max
+// /osc2midi/stats/peer shhhh "address:port" packets events dropped parseerrors
+// /osc2midi/stats/end
+//
+// Example:
+//
+// /osc2midi/stats
+static const char MSG_STATS[] = {
+	'/', 'o', 's', 'c', '2', 'm', 'i', 'd', 'i', '/', 's', 't', 'a', 't', 's', '\0'
+};
+
+// Can be sent by a host to get the latency percentiles in nanoseconds, from the kernel
+// receiving a datagram to its events written to ALSA (in), and from ALSA timestamping
+// an event to it being sent out (out). Replied in a bundle of /osc2midi/latency/in and
+// /osc2midi/latency/out messages. An int argument other than 0 resets the histograms.
+//
+// /osc2midi/latency/<in|out> hhhhh count p50 p99 p99.9 max
+//
+// Example:
+//
+// /osc2midi/latency
+// /osc2midi/latency i 1
+static const char MSG_LATENCY[] = {
+	'/', 'o', 's', 'c', '2', 'm', 'i', 'd', 'i', '/', 'l', 'a', 't', 'e', 'n', 'c',
+	'y', '\0', '\0', '\0'
+};
+
+static const char BUNDLE_HEADER[] = {
+	'#', 'b', 'u', 'n', 'd', 'l', 'e', '\0',
+	0, 0, 0, 0, 0, 0, 0, 1 // Time tag, immediately.
+};
+
+struct Options
+{
+	const char *m_rulesFile;
+	const char *m_transformFile;
+	const char *m_mappingFile;
+	const char *m_rateLimitsFile;
+	const char *m_metricsFile;
+	const char *m_traceFile;
+	const char *m_flightFile;
+	const char *m_logTarget;
+	const char *m_captureFile;
+	unsigned m_traceRate;
+	bool m_semantic;
+	SemanticOsc::Format m_semanticFormat;
+	unsigned m_sessionTimeoutMs;
+	unsigned m_loopWindowMs;
+	unsigned m_budgetUs;
+	unsigned m_queueWatermark;
+	unsigned m_stallBudgetUs;
+	unsigned m_perfWindow;
+};
+
+static Options g_options = {
+	NULL,                    // m_rulesFile
+	NULL,                    // m_transformFile
+	NULL,                    // m_mappingFile
+	NULL,                    // m_rateLimitsFile
+	NULL,                    // m_metricsFile
+	NULL,                    // m_traceFile
+	NULL,                    // m_flightFile, /tmp/osc2midi-<pid>.flight if not set.
+	NULL,                    // m_logTarget, stderr if not set.
+	NULL,                    // m_captureFile
+	1,                       // m_traceRate
+	false,                   // m_semantic
+	SemanticOsc::FORMAT_INT, // m_semanticFormat
+	30000,                   // m_sessionTimeoutMs
+	10,                      // m_loopWindowMs
+	5000,                    // m_budgetUs
+	256,                     // m_queueWatermark
+	0,                       // m_stallBudgetUs
+	0,                       // m_perfWindow
+};
+
+static MidiRules g_rules;
+static MidiTransform g_transform;
+static SemanticOsc g_semanticOsc;
+static OscMapping g_mapping;
+static MidiState g_state;
+static PeerTable g_peers;
+static LoopDetector g_loopDetector;
+static RateLimits g_rateLimits;
+static OverloadShedder g_shedder;
+static Stats g_stats;
+static MetricsPublisher g_metrics;
+static LatencyHistogram g_latency[MIDI_DIR_COUNT];
+static Tracer g_tracer;
+static FlightRecorder g_flightRecorder;
+static FlightRecorder g_flightSnapshot; // Being written by the logger thread while g_flightWriting.
+static const char *g_flightReason;
+static bool g_flightWriting;
+static Watchdog g_watchdog;
+static PerfCounters g_perf;
+static uint64_t g_perfLoopDrops; // ALSA events dropped as looped back before being decoded.
+static AsyncLogger g_log;
+static CaptureWriter g_capture;
+static char g_flightFile[256];
+
+// Events dropped within a second, and the duration of a loop iteration, considered anomalies.
+static const unsigned FLIGHT_DROP_BURST = 1000;
+static const unsigned FLIGHT_STALL_US = 100000;
+
+// Kernel receive time of the datagram being handled, CLOCK_REALTIME ns, 0 if unknown.
+static uint64_t g_recvTime;
+
+// How often the metrics file gets updated.
+static const unsigned METRICS_INTERVAL_MS = 100;
+
+// Time of the current event loop iteration, in milliseconds.
+static uint64_t g_now;
+
+// The addresses incoming patterns are matched against: /osc2midi/event and the mapped
+// ones. The control messages, such as /osc2midi/bye, only act on an exact match.
+static const char *g_addressSpace[OscAddressSet::MAX_ADDRESSES];
+static OscPatternCache g_patternCache;
+
+static volatile sig_atomic_t g_reload;
+static volatile sig_atomic_t g_dumpTrace;
+static volatile sig_atomic_t g_dumpFlight;
+
+static SeqBackend g_seq;
+static int g_clientId;
 static int g_port;
+static int g_queue = -1;
+static uint64_t g_queueStart; // CLOCK_MONOTONIC ns the timestamping queue was started at.
 static snd_midi_event_t *g_encoder;
 static snd_midi_event_t *g_decoder;
 
+static uint64_t clockNs(clockid_t clock)
+{
+	timespec ts;
+	clock_gettime(clock, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// Records a datagram, or the MIDI bytes of a sequencer event, if capturing.
+static inline void capture(CaptureKind kind, uint32_t addr, uint16_t port, const void *data, size_t length)
+{
+	if (g_capture.isOpen())
+		g_capture.write(kind, clockNs(CLOCK_MONOTONIC), addr, port, data, length);
+}
+
+static inline void captureSeq(CaptureKind kind, int client, int port, const void *data, size_t length)
+{
+	capture(kind, htonl((client << 8) | port), 0, data, length);
+}
+
+static ssize_t udpSend(int socket, const void *buffer, size_t length, const sockaddr_in &addr)
+{
+	capture(CAPTURE_UDP_OUT, addr.sin_addr.s_addr, addr.sin_port, buffer, length);
+	return sendto(socket, buffer, length, 0, (const sockaddr*)&addr, sizeof(addr));
+}
+
 static void seqUninit()
 {
 	if (g_encoder)
@@ -87,40 +300,63 @@ static void seqUninit()
 	}
 	if (g_port)
 	{
-		snd_seq_delete_simple_port(g_seq, g_port);
+		g_seq.deletePort(g_port);
 		g_port = 0;
 	}
-	if (g_seq)
+	if (g_queue >= 0)
+	{
+		g_seq.freeQueue(g_queue);
+		g_queue = -1;
+	}
+	g_seq.close();
+}
+
+// Makes ALSA stamp the events delivered to the port with the real time of a queue, to
+// measure the outbound latency. Failing that, the latency is simply not recorded.
+static void seqInitTimestamping(SeqBackend &seq, int port)
+{
+	int queue = seq.allocQueue("osc2midi");
+	if (queue < 0)
+	{
+		fprintf(stderr, "Failed allocating a queue, outbound latency won't be measured! (%d)\n", queue);
+		return;
+	}
+
+	int result = seq.setTimestamping(port, queue);
+	if (result < 0)
 	{
-		snd_seq_close(g_seq);
-		g_seq = NULL;
+		fprintf(stderr, "Failed setting up timestamping, outbound latency won't be measured! (%d)\n", result);
+		seq.freeQueue(queue);
+		return;
 	}
+
+	g_queue = queue;
+	g_queueStart = clockNs(CLOCK_MONOTONIC);
 }
 
 static int seqInit(const char *portName)
 {
-	if (g_seq != NULL)
+	if (g_seq.isOpen())
 	{
 		fprintf(stderr, "Already initialized!\n");
 		return -EINVAL;
 	}
 
-	int result = snd_seq_open(&g_seq, "default", SND_SEQ_OPEN_DUPLEX, 0);
+	int result = g_seq.open();
 	if (result < 0)
 	{
 		fprintf(stderr, "Couldn't open ALSA sequencer! (%d)\n", result);
 		goto error;
 	}
 
-	result = snd_seq_set_client_name(g_seq, portName);
+	result = g_seq.setClientName(portName);
 	if (result < 0)
 	{
 		fprintf(stderr, "Failed setting client name! (%d)\n", result);
 		goto error;
 	}
 
-	result = snd_seq_create_simple_port(
-		g_seq,
+	result = g_seq.createPort(
 		portName,
 		SND_SEQ_PORT_CAP_WRITE | SND_SEQ_PORT_CAP_SUBS_WRITE |
 		SND_SEQ_PORT_CAP_READ | SND_SEQ_PORT_CAP_SUBS_READ |
@@ -135,6 +371,9 @@ static int seqInit(const char *portName)
 	}
 
 	g_port = result;
+	g_clientId = g_seq.getClientId();
+
+	seqInitTimestamping(g_seq, g_port);
 
 	result = snd_midi_event_new(32, &g_decoder);
 	if (result < 0)
@@ -157,6 +396,88 @@ error:
 	return result;
 }
 
+struct SeqEventStatus
+{
+	snd_seq_event_type_t m_type;
+	uint8_t m_statusLo;
+	uint8_t m_statusHi;
+};
+
+// The MIDI statuses that snd_midi_event_decode may produce for each of the event types.
+static const SeqEventStatus SEQ_EVENT_STATUSES[] = {
+	{ SND_SEQ_EVENT_NOTE,         0x90, 0x9f },
+	{ SND_SEQ_EVENT_NOTEON,       0x90, 0x9f },
+	{ SND_SEQ_EVENT_NOTEOFF,      0x80, 0x8f },
+	{ SND_SEQ_EVENT_KEYPRESS,     0xa0, 0xaf },
+	{ SND_SEQ_EVENT_CONTROLLER,   0xb0, 0xbf },
+	{ SND_SEQ_EVENT_CONTROL14,    0xb0, 0xbf },
+	{ SND_SEQ_EVENT_NONREGPARAM,  0xb0, 0xbf },
+	{ SND_SEQ_EVENT_REGPARAM,     0xb0, 0xbf },
+	{ SND_SEQ_EVENT_PGMCHANGE,    0xc0, 0xcf },
+	{ SND_SEQ_EVENT_CHANPRESS,    0xd0, 0xdf },
+	{ SND_SEQ_EVENT_PITCHBEND,    0xe0, 0xef },
+	{ SND_SEQ_EVENT_SYSEX,        0xf0, 0xf0 },
+	{ SND_SEQ_EVENT_QFRAME,       0xf1, 0xf1 },
+	{ SND_SEQ_EVENT_SONGPOS,      0xf2, 0xf2 },
+	{ SND_SEQ_EVENT_SONGSEL,      0xf3, 0xf3 },
+	{ SND_SEQ_EVENT_TUNE_REQUEST, 0xf6, 0xf6 },
+	{ SND_SEQ_EVENT_CLOCK,        0xf8, 0xf8 },
+	{ SND_SEQ_EVENT_START,        0xfa, 0xfa },
+	{ SND_SEQ_EVENT_CONTINUE,     0xfb, 0xfb },
+	{ SND_SEQ_EVENT_STOP,         0xfc, 0xfc },
+	{ SND_SEQ_EVENT_SENSING,      0xfe, 0xfe },
+	{ SND_SEQ_EVENT_RESET,        0xff, 0xff },
+};
+
+// Event types that are dropped by the rules entirely are filtered out in the kernel,
+// so they never wake up the poll loop.
+static int seqSetEventFilter(const MidiRules &rules, int cable)
+{
+	bool dropped[sizeof(SEQ_EVENT_STATUSES)/sizeof(SEQ_EVENT_STATUSES[0])];
+	bool anyDropped = false;
+
+	for (unsigned i=0; i<sizeof(SEQ_EVENT_STATUSES)/sizeof(SEQ_EVENT_STATUSES[0]); ++i)
+	{
+		dropped[i] = true;
+		for (int status=SEQ_EVENT_STATUSES[i].m_statusLo; status<=SEQ_EVENT_STATUSES[i].m_statusHi; ++status)
+		{
+			if (!rules.dropsStatus(MIDI_DIR_OUT, cable, status))
+			{
+				dropped[i] = false;
+				break;
+			}
+		}
+		anyDropped = anyDropped || dropped[i];
+	}
+
+	// Start over from no filtering, in case the rules got reloaded.
+	int result = g_seq.clearEventFilter();
+	if (result < 0)
+	{
+		g_log.write(LOG_ERR, "Failed clearing the event filter! (%d)\n", result);
+		return result;
+	}
+
+	if (!anyDropped)
+		return 0;
+
+	// Once the filter is set, only the listed event types get delivered.
+	for (unsigned i=0; i<sizeof(SEQ_EVENT_STATUSES)/sizeof(SEQ_EVENT_STATUSES[0]); ++i)
+	{
+		if (dropped[i])
+			continue;
+
+		result = g_seq.addEventFilter(SEQ_EVENT_STATUSES[i].m_type);
+		if (result < 0)
+		{
+			g_log.write(LOG_ERR, "Failed setting the event filter! (%d)\n", result);
+			return result;
+		}
+	}
+
+	return 0;
+}
+
 static size_t seqDecodeToMIDI(uint8_t *buffer, size_t bufferSize, const snd_seq_event_t *event)
 {
 	if (event->type == SND_SEQ_EVENT_PORT_SUBSCRIBED || event->type == SND_SEQ_EVENT_PORT_UNSUBSCRIBED)
@@ -187,67 +508,328 @@ static int sendHello(int socket, const sockaddr_in &addr, const char *name)
 	while ((intptr_t)p & 0x3)
 		*p++ = '\0';
 
-	return sendto(socket, buffer, p - buffer, 0, (const sockaddr*)&addr, sizeof(addr));
+	return udpSend(socket, buffer, p - buffer, addr);
+}
+
+static uint32_t packMidiEvent(const midi_event_t &event)
+{
+	return (event.m_event << 24) | (event.m_data[0] << 16) | (event.m_data[1] << 8) | event.m_data[2];
+}
+
+enum { MAX_EVENT_MESSAGE_SIZE = SemanticOsc::MAX_MESSAGE_SIZE };
+
+// Writes the event as an OSC message in the selected format, returns its length.
+// Events without a semantic address are still encoded as /osc2midi/event.
+static size_t encodeMidiEvent(char buffer[MAX_EVENT_MESSAGE_SIZE], const midi_event_t &event)
+{
+	if (g_options.m_semantic)
+	{
+		size_t n = g_semanticOsc.encode(buffer, event);
+		if (n != 0)
+			return n;
+	}
+
+	memcpy(buffer, MSG_MIDI_EVENT, sizeof(MSG_MIDI_EVENT));
+
+	char *p = encodeHex32(buffer + sizeof(MSG_MIDI_EVENT), packMidiEvent(event)) + 1;
+
+	*p++ = '\0';
+	*p++ = '\0';
+	*p++ = '\0';
+
+	assert(p-buffer == 32);
+
+	return p - buffer;
+}
+
+static int sendMidiEvent(int socket, const sockaddr_in &addr, const midi_event_t &event)
+{
+	uint64_t t = g_tracer.begin();
+	char buffer[MAX_EVENT_MESSAGE_SIZE];
+	size_t n = encodeMidiEvent(buffer, event);
+	g_tracer.end(TRACE_ENCODE, t, event.m_data[0]);
+
+	t = g_tracer.begin();
+	int result = udpSend(socket, buffer, n, addr);
+	g_tracer.end(TRACE_SEND, t, n);
+	PROBE_OSC_SEND(packMidiEvent(event), n, result);
+	return result;
+}
+
+// Sends the state values changed after since, in bundles that fit in a single Ethernet frame.
+static void sendSnapshot(int socket, const sockaddr_in &addr, uint32_t since)
+{
+	enum
+	{
+		MAX_BUNDLE_SIZE   = 1472,
+		EVENTS_PER_BUNDLE = (MAX_BUNDLE_SIZE - sizeof(BUNDLE_HEADER)) / (sizeof(uint32_t) + MAX_EVENT_MESSAGE_SIZE),
+	};
+
+	uint32_t version = g_state.getVersion();
+	unsigned cursor = 0;
+
+	while (cursor < MidiState::END)
+	{
+		midi_event_t events[EVENTS_PER_BUNDLE];
+		unsigned count = g_state.collect(since, cursor, events, EVENTS_PER_BUNDLE);
+		if (count == 0)
+			break;
+
+		char buffer[MAX_BUNDLE_SIZE];
+		memcpy(buffer, BUNDLE_HEADER, sizeof(BUNDLE_HEADER));
+		char *p = buffer + sizeof(BUNDLE_HEADER);
+
+		for (unsigned i=0; i<count; ++i)
+		{
+			size_t n = encodeMidiEvent(p + sizeof(uint32_t), events[i]);
+			*((uint32_t*)p) = htonl(n);
+			p += sizeof(uint32_t) + n;
+		}
+
+		udpSend(socket, buffer, p - buffer, addr);
+	}
+
+	char buffer[sizeof(MSG_SNAPSHOT_END) + sizeof(uint32_t)];
+	memcpy(buffer, MSG_SNAPSHOT_END, sizeof(MSG_SNAPSHOT_END));
+	*((uint32_t*)(buffer + sizeof(MSG_SNAPSHOT_END))) = htonl(version);
+
+	udpSend(socket, buffer, sizeof(buffer), addr);
+}
+
+static char *writeOscString(char *p, const char *s)
+{
+	size_t n = strlen(s) + 1;
+	memcpy(p, s, n);
+	p += n;
+	while (n++ & 0x3)
+		*p++ = '\0';
+	return p;
+}
+
+static char *writeOscInt32(char *p, uint32_t value)
+{
+	*((uint32_t*)p) = htonl(value);
+	return p + sizeof(uint32_t);
+}
+
+static char *writeOscInt64(char *p, uint64_t value)
+{
+	p = writeOscInt32(p, value >> 32);
+	return writeOscInt32(p, value & 0xffffffff);
+}
+
+static char *writeOscFloat(char *p, float value)
+{
+	uint32_t bits;
+	memcpy(&bits, &value, sizeof(bits));
+	return writeOscInt32(p, bits);
 }
 
-static char * encodeHex32(char *dst, uint32_t d)
+// Collects OSC messages into bundles that fit in a single Ethernet frame.
+class BundleSender
 {
-	static const char HEX[16] = {
-		'0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'a', 'b', 'c', 'd', 'e', 'f'
+public:
+	enum
+	{
+		MAX_BUNDLE_SIZE  = 1472,
+		MAX_MESSAGE_SIZE = 256,
 	};
-	for (int i=0; i<7; ++i)
+
+	BundleSender(int socket, const sockaddr_in &addr)
+		:m_socket(socket)
+		,m_addr(addr)
+		,m_p(m_buffer + sizeof(BUNDLE_HEADER))
+	{
+		memcpy(m_buffer, BUNDLE_HEADER, sizeof(BUNDLE_HEADER));
+	}
+
+	// Returns where to write the next message, up to MAX_MESSAGE_SIZE bytes long.
+	char *begin()
+	{
+		if (m_p + sizeof(uint32_t) + MAX_MESSAGE_SIZE > m_buffer + MAX_BUNDLE_SIZE)
+			flush();
+		return m_p + sizeof(uint32_t);
+	}
+
+	void end(char *messageEnd)
+	{
+		writeOscInt32(m_p, messageEnd - m_p - sizeof(uint32_t));
+		m_p = messageEnd;
+	}
+
+	void flush()
 	{
-		*dst++ = HEX[(d & 0xf0000000) >> 28];
-		d <<= 4;
+		if (m_p == m_buffer + sizeof(BUNDLE_HEADER))
+			return;
+
+		udpSend(m_socket, m_buffer, m_p - m_buffer, m_addr);
+		m_p = m_buffer + sizeof(BUNDLE_HEADER);
 	}
-	*dst++ = HEX[(d & 0xf0000000) >> 28];
-	*dst = '\0';
-	return dst;
+
+private:
+	int m_socket;
+	sockaddr_in m_addr;
+	char *m_p;
+	char m_buffer[MAX_BUNDLE_SIZE];
+};
+
+static void sendStatsCounter(BundleSender &sender, const char *address, uint64_t value)
+{
+	char *p = sender.begin();
+	p = writeOscString(p, address);
+	p = writeOscString(p, ",h");
+	p = writeOscInt64(p, value);
+	sender.end(p);
 }
 
-static bool decodeHex32(uint32_t &result, const char *src)
+static void sendStats(int socket, const sockaddr_in &addr)
 {
-	result = 0;
+	static const char *const DIRECTIONS[MIDI_DIR_COUNT] = { "in", "out" };
 
-	for (int i=0; i<8 && src[i]; ++i)
+	BundleSender sender(socket, addr);
+	char address[64];
+
+	for (unsigned d=0; d<MIDI_DIR_COUNT; ++d)
 	{
-		char c = src[i];
-		if (c >= '0' && c <= '9')
+		const DirectionStats &stats = g_stats.m_dir[d];
+
+		for (unsigned i=0; i<STAT_TYPE_COUNT; ++i)
 		{
-			result = (result << 4) | (c - '0');
+			snprintf(address, sizeof(address), "%s/%s/%s", MSG_STATS, DIRECTIONS[d], stat_get_type_name((StatType)i));
+			sendStatsCounter(sender, address, stats.m_events[i]);
 		}
-		else if (c >= 'a' && c <= 'f')
+		for (unsigned i=0; i<DROP_REASON_COUNT; ++i)
+		{
+			snprintf(address, sizeof(address), "%s/%s/dropped/%s", MSG_STATS, DIRECTIONS[d], stat_get_drop_name((StatDrop)i));
+			sendStatsCounter(sender, address, stats.m_dropped[i]);
+		}
+		snprintf(address, sizeof(address), "%s/%s/sysexbytes", MSG_STATS, DIRECTIONS[d]);
+		sendStatsCounter(sender, address, stats.m_sysexBytes);
+	}
+
+	snprintf(address, sizeof(address), "%s/packets", MSG_STATS);
+	sendStatsCounter(sender, address, g_stats.m_input.m_packets);
+	snprintf(address, sizeof(address), "%s/parseerrors", MSG_STATS);
+	sendStatsCounter(sender, address, g_stats.m_input.m_parseErrors);
+
+	snprintf(address, sizeof(address), "%s/queue", MSG_STATS);
+	char *p = sender.begin();
+	p = writeOscString(p, address);
+	p = writeOscString(p, ",ii");
+	p = writeOscInt32(p, g_stats.m_input.m_queueDepth);
+	p = writeOscInt32(p, g_stats.m_input.m_maxQueueDepth);
+	sender.end(p);
+
+	snprintf(address, sizeof(address), "%s/peer", MSG_STATS);
+	for (unsigned i=0; i<PeerTable::MAX_PEERS; ++i)
+	{
+		if (!g_peers.isUsed(i))
+			continue;
+
+		const Peer &peer = *g_peers.get(i);
+		char name[24];
+		snprintf(name, sizeof(name), "%s:%u", inet_ntoa(peer.m_addr.sin_addr), ntohs(peer.m_addr.sin_port));
+
+		p = sender.begin();
+		p = writeOscString(p, address);
+		p = writeOscString(p, ",shhhh");
+		p = writeOscString(p, name);
+		p = writeOscInt64(p, peer.m_stats.m_packets);
+		p = writeOscInt64(p, peer.m_stats.m_events);
+		p = writeOscInt64(p, peer.m_stats.m_dropped);
+		p = writeOscInt64(p, peer.m_stats.m_parseErrors);
+		sender.end(p);
+	}
+
+	if (g_perf.isEnabled())
+	{
+		for (unsigned d=0; d<MIDI_DIR_COUNT; ++d)
 		{
-			result = (result << 4) | (c - 'a' + 10);
+			snprintf(address, sizeof(address), "%s/perf/%s/windows", MSG_STATS, DIRECTIONS[d]);
+			sendStatsCounter(sender, address, g_perf.getWindows((MidiDirection)d));
+
+			for (unsigned i=0; i<PERF_COUNTER_COUNT; ++i)
+			{
+				if (!g_perf.isAvailable((PerfCounter)i))
+					continue;
+
+				snprintf(address, sizeof(address), "%s/perf/%s/%s", MSG_STATS, DIRECTIONS[d], PerfCounters::getCounterName((PerfCounter)i));
+				p = sender.begin();
+				p = writeOscString(p, address);
+				p = writeOscString(p, ",f");
+				p = writeOscFloat(p, g_perf.getCost((MidiDirection)d, (PerfCounter)i));
+				sender.end(p);
+			}
 		}
-		else if (c >= 'A' && c <= 'F')
+	}
+
+	if (g_watchdog.isEnabled())
+	{
+		snprintf(address, sizeof(address), "%s/iterations", MSG_STATS);
+		sendStatsCounter(sender, address, g_watchdog.getIterations());
+		snprintf(address, sizeof(address), "%s/maxiteration", MSG_STATS);
+		sendStatsCounter(sender, address, g_watchdog.getMaxUs());
+		for (unsigned i=0; i<WATCH_HANDLER_COUNT; ++i)
 		{
-			result = (result << 4) | (c - 'A' + 10);
+			snprintf(address, sizeof(address), "%s/stalls/%s", MSG_STATS, Watchdog::getHandlerName((WatchHandler)i));
+			sendStatsCounter(sender, address, g_watchdog.getOverruns((WatchHandler)i));
 		}
-		else
+
+		// The handler and the duration of the last caught stall followed by its backtrace,
+		// as offsets to resolve with addr2line -e osc2midi.debug.
+		const Watchdog::Stall *stall = g_watchdog.getLastStall();
+		if (stall)
 		{
-			result = 0;
-			return false;
+			char tags[3 + Watchdog::MAX_FRAMES + 1] = ",si";
+			memset(tags + 3, 'h', stall->m_frameCount);
+			tags[3 + stall->m_frameCount] = '\0';
+
+			snprintf(address, sizeof(address), "%s/stall", MSG_STATS);
+			p = sender.begin();
+			p = writeOscString(p, address);
+			p = writeOscString(p, tags);
+			p = writeOscString(p, Watchdog::getHandlerName(stall->m_handler));
+			p = writeOscInt32(p, stall->m_durationUs);
+			for (unsigned i=0; i<stall->m_frameCount; ++i)
+				p = writeOscInt64(p, stall->m_frames[i]);
+			sender.end(p);
 		}
 	}
 
-	return true;
+	snprintf(address, sizeof(address), "%s/end", MSG_STATS);
+	p = sender.begin();
+	p = writeOscString(p, address);
+	p = writeOscString(p, ",");
+	sender.end(p);
+
+	sender.flush();
 }
 
-static int sendMidiEvent(int socket, const sockaddr_in &addr, const midi_event_t &event)
+static void sendLatency(int socket, const sockaddr_in &addr, bool reset)
 {
-	char buffer[32];
-	memcpy(buffer, MSG_MIDI_EVENT, sizeof(MSG_MIDI_EVENT));
-
-	char *p = encodeHex32(buffer + sizeof(MSG_MIDI_EVENT), ((event.m_event) << 24) | ((event.m_data[0]) << 16) | ((event.m_data[1]) << 8) | event.m_data[2]) + 1;
+	static const char *const ADDRESSES[MIDI_DIR_COUNT] = { "/osc2midi/latency/in", "/osc2midi/latency/out" };
 
-	*p++ = '\0';
-	*p++ = '\0';
-	*p++ = '\0';
+	BundleSender sender(socket, addr);
 
-	assert(p-buffer == sizeof(buffer));
+	for (unsigned d=0; d<MIDI_DIR_COUNT; ++d)
+	{
+		LatencyHistogram &h = g_latency[d];
+
+		char *p = sender.begin();
+		p = writeOscString(p, ADDRESSES[d]);
+		p = writeOscString(p, ",hhhhh");
+		p = writeOscInt64(p, h.getCount());
+		p = writeOscInt64(p, h.getPercentile(50.0));
+		p = writeOscInt64(p, h.getPercentile(99.0));
+		p = writeOscInt64(p, h.getPercentile(99.9));
+		p = writeOscInt64(p, h.getMax());
+		sender.end(p);
+
+		if (reset)
+			h.reset();
+	}
 
-	return sendto(socket, buffer, p - buffer, 0, (const sockaddr*)&addr, sizeof(addr));
+	sender.flush();
 }
 
 static int g_socket = 0;
@@ -279,6 +861,10 @@ static int udpInit()
 		return -errno;
 	}
 
+	int on = 1;
+	if (setsockopt(s, SOL_SOCKET, SO_TIMESTAMPNS, &on, sizeof(on)) < 0)
+		fprintf(stderr, "Failed enabling UDP timestamps, inbound latency won't be measured! (%d)\n", errno);
+
 	int flags = fcntl(s, F_GETFL, 0);
 	if (flags < 0 || fcntl(s, F_SETFL, flags | O_NONBLOCK) < 0)
 	{
@@ -292,6 +878,40 @@ static int udpInit()
 	return 0;
 }
 
+// Receives a datagram along with its kernel receive time, CLOCK_REALTIME ns or 0 if unavailable.
+static ssize_t udpReceive(int socket, char *buffer, size_t size, sockaddr_in &addr, uint64_t &recvTime)
+{
+	iovec iov;
+	iov.iov_base = buffer;
+	iov.iov_len = size;
+
+	char control[CMSG_SPACE(sizeof(timespec))];
+
+	msghdr mh;
+	memset(&mh, 0, sizeof(mh));
+	mh.msg_name = &addr;
+	mh.msg_namelen = sizeof(addr);
+	mh.msg_iov = &iov;
+	mh.msg_iovlen = 1;
+	mh.msg_control = control;
+	mh.msg_controllen = sizeof(control);
+
+	ssize_t len = recvmsg(socket, &mh, 0);
+
+	recvTime = 0;
+	for (cmsghdr *c = CMSG_FIRSTHDR(&mh); c; c = CMSG_NXTHDR(&mh, c))
+	{
+		if (c->cmsg_level == SOL_SOCKET && c->cmsg_type == SCM_TIMESTAMPNS)
+		{
+			timespec ts;
+			memcpy(&ts, CMSG_DATA(c), sizeof(ts));
+			recvTime = (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+		}
+	}
+
+	return len;
+}
+
 static void udpUninit()
 {
 	if (g_socket != 0)
@@ -301,80 +921,806 @@ static void udpUninit()
 	}
 }
 
-static bool handleUdpPacket(const char *buffer, size_t len, snd_seq_t *seq, int portId)
+static uint64_t nowUs()
 {
-	if (memcmp(buffer, MSG_MIDI_EVENT, sizeof(MSG_MIDI_EVENT)) == 0)
-	{
-		if (len < sizeof(MSG_MIDI_EVENT) + 12)
-			return false;
+	timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void recordEvent(MidiDirection dir, const midi_event_t &event, const sockaddr_in *addr, unsigned outcome)
+{
+	g_flightRecorder.record(clockNs(CLOCK_REALTIME), dir, packMidiEvent(event), addr ? addr->sin_addr.s_addr : 0, addr ? addr->sin_port : 0, outcome);
+}
+
+static void countDrop(MidiDirection dir, StatDrop reason, Peer *peer, const midi_event_t &event)
+{
+	++g_stats.m_dir[dir].m_dropped[reason];
+	if (peer)
+		++peer->m_stats.m_dropped;
+
+	recordEvent(dir, event, peer ? &peer->m_addr : NULL, FLIGHT_DROPPED + reason);
+
+	PROBE_DROP(dir, reason, peer ? ntohs(peer->m_addr.sin_port) : 0);
+}
+
+static void countParseError(Peer *peer)
+{
+	++g_stats.m_input.m_parseErrors;
+	++peer->m_stats.m_parseErrors;
+}
+
+// Count of events handled in the direction so far, whether delivered or dropped. Events
+// are counted as decoded, before any of the checks which may drop them, so only the
+// drops of ALSA events which never got decoded are added.
+static uint64_t countHandled(MidiDirection dir)
+{
+	const DirectionStats &stats = g_stats.m_dir[dir];
+
+	uint64_t n = dir == MIDI_DIR_OUT ? g_perfLoopDrops : 0;
+	for (unsigned i=0; i<STAT_TYPE_COUNT; ++i)
+		n += stats.m_events[i];
+	return n;
+}
+
+// Surround the handling of events with these to attribute the performance counters to them.
+static uint64_t perfBegin(MidiDirection dir)
+{
+	if (!g_perf.isEnabled())
+		return 0;
+
+	g_perf.begin();
+	return countHandled(dir);
+}
 
-		uint32_t t;
-		if (decodeHex32(t, buffer + sizeof(MSG_MIDI_EVENT)))
+static void perfEnd(MidiDirection dir, uint64_t handled)
+{
+	if (g_perf.isEnabled())
+		g_perf.end(dir, (unsigned)(countHandled(dir) - handled));
+}
+
+// Passes an event received over OSC through the rules and the transforms to the ALSA port.
+static void seqWriteEvent(SeqBackend &seq, int portId, Peer *peer, const midi_event_t &midiEvent)
+{
+	midi_event_t events[2];
+	unsigned count = g_rules.apply(MIDI_DIR_IN, midiEvent, events);
+	if (count == 0)
+		countDrop(MIDI_DIR_IN, DROP_RULES, peer, midiEvent);
+
+	for (unsigned i=0; i<count; ++i)
+	{
+		uint8_t rawMidi[3];
+		unsigned l = UsbToMidi::process(events[i], rawMidi);
+		if (l > 0 && l <= 3 && !g_transform.apply(MIDI_DIR_IN, rawMidi))
 		{
-			midi_event_t midiEvent;
-			midiEvent.m_event = t >> 24;
-			midiEvent.m_data[0] = (t >> 16) & 0xff;
-			midiEvent.m_data[1] = (t >> 8) & 0xff;
-			midiEvent.m_data[2] = t & 0xff;
-			uint8_t rawMidi[3];
-			unsigned l = UsbToMidi::process(midiEvent, rawMidi);
-			if (l > 0 && l <= 3)
+			countDrop(MIDI_DIR_IN, DROP_TRANSFORM, peer, events[i]);
+		}
+		else if (l > 0 && l <= 3)
+		{
+			int cable = events[i].m_event >> 4;
+			if (g_shedder.shed(rawMidi, g_shedder.checksRedundancy(rawMidi) && g_state.isCurrent(cable, rawMidi)))
+			{
+				countDrop(MIDI_DIR_IN, DROP_SHED, peer, events[i]);
+				continue;
+			}
+
+			// A SysEx spans several packets, the encoder keeps its state across them and
+			// completes an event on F7 or whenever its buffer fills up. Any other message
+			// is complete, so the encoder is reset on its status rather than created per
+			// event, discarding what's left of an unterminated SysEx.
+			if (rawMidi[0] >= 0x80 && rawMidi[0] < 0xf7)
+				snd_midi_event_reset_encode(g_encoder);
+
+			bool completed = false;
+			const uint8_t *p = rawMidi;
+			long left = l;
+			while (left > 0)
 			{
-				snd_midi_event_t *e;
-				snd_midi_event_new(64, &e);
+				uint64_t t = g_tracer.begin();
 				snd_seq_event_t ev;
 				snd_seq_ev_clear(&ev);
 				snd_seq_ev_set_source(&ev, portId);
 				snd_seq_ev_set_subs(&ev);
 				snd_seq_ev_set_direct(&ev);
-				snd_midi_event_encode(e, rawMidi, l, &ev);
-				snd_seq_event_output_direct(seq, &ev);
-				snd_midi_event_free(e);
+				long n = snd_midi_event_encode(g_encoder, p, left, &ev);
+				ev.tag = SEQ_EVENT_TAG;
+				g_tracer.end(TRACE_ENCODE, t, rawMidi[0]);
+
+				if (n <= 0)
+					break;
+				p += n;
+				left -= n;
+
+				// The bytes were taken in, but no event is completed yet.
+				if (ev.type == SND_SEQ_EVENT_NONE)
+					continue;
+
+				// snd_seq_event_output_direct allocates a temporary buffer for variable
+				// length events, SysEx goes through the output buffer instead.
+				bool variable = snd_seq_ev_is_variable(&ev);
+				t = g_tracer.begin();
+				if (variable)
+				{
+					seq.output(&ev);
+					seq.drainOutput();
+				}
+				else
+				{
+					seq.outputDirect(&ev);
+				}
+				g_tracer.end(TRACE_ALSA_WRITE, t, rawMidi[0]);
+				PROBE_ALSA_OUTPUT(rawMidi[0], rawMidi[1], rawMidi[2]);
+				if (variable)
+					captureSeq(CAPTURE_SEQ_OUT, g_clientId, portId, ev.data.ext.ptr, ev.data.ext.len);
+				else
+					captureSeq(CAPTURE_SEQ_OUT, g_clientId, portId, p - n, n);
+				completed = true;
+			}
+
+			if (!completed)
+				continue;
+
+			g_state.update(cable, rawMidi);
+			peer->m_notes.update(rawMidi);
+			g_loopDetector.emitted(rawMidi, l, g_now);
+			recordEvent(MIDI_DIR_IN, events[i], &peer->m_addr, FLIGHT_SENT);
+
+			// The kernel stamps with CLOCK_REALTIME, which may have stepped back meanwhile.
+			if (g_recvTime)
+			{
+				uint64_t sent = clockNs(CLOCK_REALTIME);
+				if (sent > g_recvTime)
+					g_latency[MIDI_DIR_IN].record(sent - g_recvTime);
 			}
 		}
-		return false;
 	}
-	else if (memcmp(buffer, MSG_BYE, sizeof(MSG_BYE)) == 0)
+}
+
+static void seqOutputEvent(SeqBackend &seq, int portId, Peer *peer, const midi_event_t &midiEvent)
+{
+	PROBE_DECODE(MIDI_DIR_IN, packMidiEvent(midiEvent));
+	stat_count_event(g_stats.m_dir[MIDI_DIR_IN], midiEvent);
+	++peer->m_stats.m_events;
+
+	if (!g_rateLimits.isEmpty())
 	{
-		return true;
+		RateLimiter::Verdict verdict = peer->m_limiter.check(g_rateLimits, midiEvent, g_now);
+		if (verdict == RateLimiter::RATE_DROP)
+			countDrop(MIDI_DIR_IN, DROP_RATE, peer, midiEvent);
+		else if (verdict == RateLimiter::RATE_COALESCED)
+			recordEvent(MIDI_DIR_IN, midiEvent, &peer->m_addr, FLIGHT_HELD);
+		if (verdict != RateLimiter::RATE_PASS)
+			return;
 	}
 
-	return false;
+	seqWriteEvent(seq, portId, peer, midiEvent);
 }
 
-static MidiToUsb g_midiToUsb = MidiToUsb(0);
-
-static bool handleSeqEvent(snd_seq_t *seq, const sockaddr_in &addr, int portId)
+// Sends the coalesced events of the peer the rate allows by now, all of them if limits are empty.
+static void flushPending(SeqBackend &seq, int portId, Peer &peer, const RateLimits &limits)
 {
+	// The held back events weren't received with the current datagram.
+	uint64_t recvTime = g_recvTime;
+	g_recvTime = 0;
+
+	midi_event_t events[64];
+	unsigned n;
 	do
 	{
-		snd_seq_event_t *ev;
-		snd_seq_event_input(seq, &ev);
-		uint8_t buffer[64];
-		size_t len = seqDecodeToMIDI(buffer, sizeof(buffer), ev);
-		for (size_t i=0; i<len; ++i)
-		{
-			midi_event_t midiEvent;
-			if (g_midiToUsb.process(buffer[i], midiEvent))
-			{
-				sendMidiEvent(g_socket, addr, midiEvent);
-			}
-		}
-		snd_seq_free_event(ev);
-	} while (snd_seq_event_input_pending(seq, 0) > 0);
+		n = peer.m_limiter.flush(limits, g_now, events, sizeof(events) / sizeof(events[0]));
+		for (unsigned i=0; i<n; ++i)
+			seqWriteEvent(seq, portId, &peer, events[i]);
+	} while (n == sizeof(events) / sizeof(events[0]));
 
-	return false;
+	g_recvTime = recvTime;
 }
 
-static int run(const char *name, const char *ip, uint16_t port)
+// Sends Note Off for every note held by the peer, flushing them to ALSA at once.
+static void releaseNotes(SeqBackend &seq, int portId, Peer &peer)
 {
-	if (!name || !ip)
-		return -EINVAL;
+	if (peer.m_notes.isEmpty())
+		return;
+
+	for (int i = peer.m_notes.next(0); i >= 0; i = peer.m_notes.next(i + 1))
+	{
+		snd_seq_event_t ev;
+		snd_seq_ev_clear(&ev);
+		snd_seq_ev_set_source(&ev, portId);
+		snd_seq_ev_set_subs(&ev);
+		snd_seq_ev_set_direct(&ev);
+		snd_seq_ev_set_noteoff(&ev, i >> 7, i & 0x7f, 0);
+		ev.tag = SEQ_EVENT_TAG;
+		seq.output(&ev);
+
+		const uint8_t noteOff[3] = { (uint8_t)(0x80 | (i >> 7)), (uint8_t)(i & 0x7f), 0 };
+		captureSeq(CAPTURE_SEQ_OUT, g_clientId, portId, noteOff, sizeof(noteOff));
+	}
+	seq.drainOutput();
+
+	peer.m_notes.clear();
+}
+
+static void printLimiterStats(const Peer &peer)
+{
+	for (unsigned i=0; i<RATE_CLASS_COUNT; ++i)
+	{
+		RateClass c = (RateClass)i;
+		if (peer.m_limiter.getDropped(c) == 0 && peer.m_limiter.getCoalesced(c) == 0)
+			continue;
+
+		g_log.write(LOG_INFO, "%s:%u %s: %llu passed, %llu dropped, %llu coalesced over the rate limit.\n",
+			inet_ntoa(peer.m_addr.sin_addr),
+			ntohs(peer.m_addr.sin_port),
+			RateLimits::getClassName(c),
+			(unsigned long long)peer.m_limiter.getPassed(c),
+			(unsigned long long)peer.m_limiter.getDropped(c),
+			(unsigned long long)peer.m_limiter.getCoalesced(c)
+			);
+	}
+}
+
+static void closePeer(SeqBackend &seq, int portId, Peer *peer)
+{
+	static const RateLimits UNLIMITED;
+
+	flushPending(seq, portId, *peer, UNLIMITED);
+	printLimiterStats(*peer);
+	releaseNotes(seq, portId, *peer);
+	g_peers.remove(peer);
+}
+
+// Finds or starts the session of the sender, the least recently seen one is closed if the table is full.
+static Peer *getPeer(SeqBackend &seq, int portId, const sockaddr_in &addr, uint64_t now)
+{
+	Peer *peer = g_peers.lookup(addr);
+	if (peer)
+	{
+		peer->m_lastSeen = now;
+		return peer;
+	}
+
+	peer = g_peers.add(addr, now);
+	if (!peer)
+	{
+		closePeer(seq, portId, g_peers.getOldest());
+		peer = g_peers.add(addr, now);
+	}
+	return peer;
+}
+
+// Closes the sessions idle for longer than the timeout, or all of them if all is set.
+static void expirePeers(SeqBackend &seq, int portId, uint64_t now, bool all)
+{
+	for (unsigned i=0; i<PeerTable::MAX_PEERS; ++i)
+	{
+		if (g_peers.isUsed(i) && (all || now - g_peers.get(i)->m_lastSeen >= g_options.m_sessionTimeoutMs))
+			closePeer(seq, portId, g_peers.get(i));
+	}
+}
+
+// Returns the poll timeout until the next pending events may be sent, -1 if there's none.
+static int flushPeers(SeqBackend &seq, int portId)
+{
+	int timeout = -1;
+	for (unsigned i=0; i<PeerTable::MAX_PEERS; ++i)
+	{
+		if (!g_peers.isUsed(i) || !g_peers.get(i)->m_limiter.hasPending())
+			continue;
+
+		Peer &peer = *g_peers.get(i);
+		flushPending(seq, portId, peer, g_rateLimits);
+
+		if (peer.m_limiter.hasPending())
+		{
+			int wait = (int)peer.m_limiter.getWait(g_rateLimits, g_now);
+			if (wait < 1)
+				wait = 1;
+			if (timeout < 0 || wait < timeout)
+				timeout = wait;
+		}
+	}
+	return timeout;
+}
+
+static void buildAddressSpace()
+{
+	unsigned n = 0;
+	g_addressSpace[n++] = MSG_MIDI_EVENT;
+
+	unsigned mapped = g_mapping.getAddresses(g_addressSpace + n, OscAddressSet::MAX_ADDRESSES - n);
+	if (n + mapped > OscAddressSet::MAX_ADDRESSES)
+	{
+		g_log.write(LOG_WARNING, "Too many addresses, patterns will match only the first %d!\n", OscAddressSet::MAX_ADDRESSES);
+		mapped = OscAddressSet::MAX_ADDRESSES - n;
+	}
+
+	g_patternCache.setAddresses(g_addressSpace, n + mapped);
+}
+
+static void seqOutputHexEvent(SeqBackend &seq, int portId, Peer *peer, const char *hex)
+{
+	uint32_t t;
+	if (decodeHex32(t, hex))
+	{
+		midi_event_t midiEvent;
+		midiEvent.m_event = t >> 24;
+		midiEvent.m_data[0] = (t >> 16) & 0xff;
+		midiEvent.m_data[1] = (t >> 8) & 0xff;
+		midiEvent.m_data[2] = t & 0xff;
+		seqOutputEvent(seq, portId, peer, midiEvent);
+	}
+	else
+	{
+		countParseError(peer);
+	}
+}
+
+// Handles a message for one of the addresses in the address space, the address
+// differs from the message's own one if it was matched by a pattern.
+static bool dispatchOscMessage(const char *address, const OscMessage &msg, Peer *peer, SeqBackend &seq, int portId)
+{
+	if (strcmp(address, MSG_MIDI_EVENT) == 0)
+	{
+		const char *hex = msg.getString(0);
+		if (hex && strlen(hex) == 8)
+			seqOutputHexEvent(seq, portId, peer, hex);
+		else
+			countParseError(peer);
+		return false;
+	}
+	else if (strcmp(address, MSG_BYE) == 0)
+	{
+		releaseNotes(seq, portId, *peer);
+		return true;
+	}
+	else if (strcmp(address, MSG_SNAPSHOT) == 0)
+	{
+		int32_t since = 0;
+		msg.getInt(0, since);
+		sendSnapshot(g_socket, peer->m_addr, since);
+		return false;
+	}
+	else if (strcmp(address, MSG_STATS) == 0)
+	{
+		sendStats(g_socket, peer->m_addr);
+		return false;
+	}
+	else if (strcmp(address, MSG_LATENCY) == 0)
+	{
+		int32_t reset = 0;
+		msg.getInt(0, reset);
+		sendLatency(g_socket, peer->m_addr, reset != 0);
+		return false;
+	}
+
+	midi_event_t events[OscMapping::MAX_EVENTS];
+	unsigned count = g_mapping.map(address, msg, events);
+	for (unsigned i=0; i<count; ++i)
+		seqOutputEvent(seq, portId, peer, events[i]);
+
+	return false;
+}
+
+static bool handleUdpPacket(const char *buffer, size_t len, Peer *peer, SeqBackend &seq, int portId)
+{
+	++g_stats.m_input.m_packets;
+	++peer->m_stats.m_packets;
+
+	// Fast path for the exact messages produced by osc2midi clients.
+	if (len >= sizeof(MSG_MIDI_EVENT) && memcmp(buffer, MSG_MIDI_EVENT, sizeof(MSG_MIDI_EVENT)) == 0)
+	{
+		if (len < sizeof(MSG_MIDI_EVENT) + 12)
+		{
+			countParseError(peer);
+			return false;
+		}
+
+		seqOutputHexEvent(seq, portId, peer, buffer + sizeof(MSG_MIDI_EVENT));
+		return false;
+	}
+	else if (len >= sizeof(MSG_BYE) && memcmp(buffer, MSG_BYE, sizeof(MSG_BYE)) == 0)
+	{
+		releaseNotes(seq, portId, *peer);
+		return true;
+	}
+
+	OscMessage msg;
+	if (!msg.parse(buffer, len))
+	{
+		countParseError(peer);
+		return false;
+	}
+
+	if (!OscPattern::isPattern(msg.getAddress()))
+		return dispatchOscMessage(msg.getAddress(), msg, peer, seq, portId);
+
+	const OscAddressSet *matches = g_patternCache.resolve(msg.getAddress());
+	if (!matches)
+		return false;
 
 	bool done = false;
-	int npfd = 0;
+	for (int i = matches->next(0); i >= 0; i = matches->next(i + 1))
+		done = dispatchOscMessage(g_addressSpace[i], msg, peer, seq, portId) || done;
 
-	int result = seqInit(name);
+	return done;
+}
+
+static MidiToUsb g_midiToUsb = MidiToUsb(0);
+
+static void reportLoop()
+{
+	if (g_loopDetector.looped(g_now))
+		g_log.write(LOG_WARNING, "Feedback loop detected, dropped %u looped back events!\n", g_loopDetector.takeCount());
+}
+
+// Our own events come back either as is, when our port is connected to itself or
+// by a pass through client, or regenerated, which is caught by the hash window.
+// -l 0 disables all of the checks, for benchmarking through a looped back port.
+static bool isLoopedBack(const snd_seq_event_t *ev)
+{
+	if (g_options.m_loopWindowMs == 0)
+		return false;
+
+	return ev->source.client == g_clientId || ev->tag == SEQ_EVENT_TAG;
+}
+
+static bool isLoopedBack(const midi_event_t &midiEvent)
+{
+	if (midi_event_status(midiEvent) == 0xf0)
+		return false;
+
+	uint8_t rawMidi[3];
+	unsigned l = UsbToMidi::process(midiEvent, rawMidi);
+	return l > 0 && g_loopDetector.isEcho(rawMidi, l, g_now);
+}
+
+// Returns the CLOCK_MONOTONIC ns of the event's timestamp given by our queue, 0 if it has none.
+static uint64_t seqEventTime(const snd_seq_event_t *ev)
+{
+	if (g_queue < 0 || ev->queue != g_queue || (ev->flags & SND_SEQ_TIME_STAMP_MASK) != SND_SEQ_TIME_STAMP_REAL)
+		return 0;
+
+	return g_queueStart + (uint64_t)ev->time.time.tv_sec * 1000000000 + ev->time.time.tv_nsec;
+}
+
+static bool handleSeqEvent(SeqBackend &seq, const sockaddr_in &addr, int portId)
+{
+	do
+	{
+		uint64_t t = g_tracer.begin();
+		snd_seq_event_t *ev;
+		seq.input(ev);
+		g_tracer.end(TRACE_ALSA_READ, t, ev->type);
+		uint64_t eventTime = seqEventTime(ev);
+		uint8_t buffer[64];
+		size_t len = 0;
+		if (isLoopedBack(ev))
+		{
+			midi_event_t unknown;
+			memset(&unknown, 0, sizeof(unknown));
+			countDrop(MIDI_DIR_OUT, DROP_LOOP, NULL, unknown);
+			++g_perfLoopDrops;
+			reportLoop();
+		}
+		else
+		{
+			len = seqDecodeToMIDI(buffer, sizeof(buffer), ev);
+			captureSeq(CAPTURE_SEQ_IN, ev->source.client, ev->source.port, buffer, len);
+		}
+		for (size_t i=0; i<len; ++i)
+		{
+			midi_event_t midiEvent;
+			if (g_midiToUsb.process(buffer[i], midiEvent))
+			{
+				PROBE_DECODE(MIDI_DIR_OUT, packMidiEvent(midiEvent));
+				stat_count_event(g_stats.m_dir[MIDI_DIR_OUT], midiEvent);
+
+				if (isLoopedBack(midiEvent))
+				{
+					countDrop(MIDI_DIR_OUT, DROP_LOOP, NULL, midiEvent);
+					reportLoop();
+					continue;
+				}
+
+				midi_event_t events[2];
+				unsigned count = g_rules.apply(MIDI_DIR_OUT, midiEvent, events);
+				if (count == 0)
+					countDrop(MIDI_DIR_OUT, DROP_RULES, NULL, midiEvent);
+
+				for (unsigned j=0; j<count; ++j)
+				{
+					if (!g_transform.apply(MIDI_DIR_OUT, events[j].m_data))
+					{
+						countDrop(MIDI_DIR_OUT, DROP_TRANSFORM, NULL, events[j]);
+						continue;
+					}
+
+					int cable = events[j].m_event >> 4;
+					const uint8_t *msg = events[j].m_data;
+					bool redundant = midi_is_channel_status(midi_event_status(events[j])) && g_shedder.checksRedundancy(msg) && g_state.isCurrent(cable, msg);
+					if (g_shedder.shed(msg, redundant))
+					{
+						countDrop(MIDI_DIR_OUT, DROP_SHED, NULL, events[j]);
+						continue;
+					}
+
+					if (midi_is_channel_status(midi_event_status(events[j])))
+						g_state.update(cable, msg);
+
+					sendMidiEvent(g_socket, addr, events[j]);
+					recordEvent(MIDI_DIR_OUT, events[j], &addr, FLIGHT_SENT);
+
+					if (eventTime)
+					{
+						uint64_t sent = clockNs(CLOCK_MONOTONIC);
+						if (sent > eventTime)
+							g_latency[MIDI_DIR_OUT].record(sent - eventTime);
+					}
+				}
+			}
+		}
+		seq.freeEvent(ev);
+	} while (seq.inputPending(false) > 0);
+
+	return false;
+}
+
+static void sampleLoad(unsigned busyUs, unsigned queued, uint64_t now)
+{
+	OverloadShedder::Level previous = g_shedder.getLevel();
+	if (!g_shedder.sample(busyUs, queued, now))
+		return;
+
+	OverloadShedder::Level level = g_shedder.getLevel();
+	if (level > previous)
+		g_log.write(LOG_WARNING, "Overloaded, shedding %s.\n", OverloadShedder::getLevelName(level));
+	else if (level != OverloadShedder::SHED_NONE)
+		g_log.write(LOG_NOTICE, "Load decreased, shedding up to %s.\n", OverloadShedder::getLevelName(level));
+	else
+		g_log.write(LOG_NOTICE, "Load back to normal, %llu events were shed.\n",
+			(unsigned long long)(g_shedder.getShed(OverloadShedder::SHED_SENSING) +
+			g_shedder.getShed(OverloadShedder::SHED_REDUNDANT_CC) +
+			g_shedder.getShed(OverloadShedder::SHED_AFTERTOUCH))
+			);
+}
+
+static void publishMetrics(uint64_t now)
+{
+	MetricsData *data = g_metrics.beginWrite();
+	data->m_timestamp = now;
+	data->m_shedLevel = g_shedder.getLevel();
+	data->m_stats = g_stats;
+
+	unsigned n = 0;
+	for (unsigned i=0; i<PeerTable::MAX_PEERS; ++i)
+	{
+		if (!g_peers.isUsed(i))
+			continue;
+
+		const Peer &peer = *g_peers.get(i);
+		MetricsPeer &p = data->m_peers[n++];
+		snprintf(p.m_address, sizeof(p.m_address), "%s:%u", inet_ntoa(peer.m_addr.sin_addr), ntohs(peer.m_addr.sin_port));
+		p.m_stats = peer.m_stats;
+	}
+	data->m_peerCount = n;
+
+	g_metrics.endWrite();
+}
+
+static void onSigHup(int)
+{
+	g_reload = 1;
+}
+
+static void onSigUsr2(int)
+{
+	g_dumpTrace = 1;
+}
+
+static void onSigUsr1(int)
+{
+	g_dumpFlight = 1;
+}
+
+static void onCrash(int sig)
+{
+	g_flightRecorder.dump(g_flightFile, "crash");
+
+	// The handler was reset by SA_RESETHAND, let the default action take place.
+	raise(sig);
+}
+
+static int formatFlightResult(char *text, size_t size, int result, const char *reason)
+{
+	if (result < 0)
+	{
+		snprintf(text, size, "Failed to write the flight recorder to '%s'! (%d)\n", g_flightFile, -result);
+		return LOG_ERR;
+	}
+	snprintf(text, size, "Flight recorder written to '%s' (%s).\n", g_flightFile, reason);
+	return LOG_NOTICE;
+}
+
+// Runs on the logger thread.
+static int writeFlightSnapshot(void *, char *text, size_t size)
+{
+	int result = g_flightSnapshot.dump(g_flightFile, g_flightReason);
+	int priority = formatFlightResult(text, size, result, g_flightReason);
+	__atomic_store_n(&g_flightWriting, false, __ATOMIC_RELEASE);
+	return priority;
+}
+
+// Anomalies are detected when the loop is already behind, so their dumps are written
+// by the logger thread from a copy of the ring, or skipped if its ring is full. The
+// signal's dump is written right away. Returns false if it has to wait for a dump
+// still being written.
+static bool dumpFlightRecorder(const char *reason, uint64_t now)
+{
+	if (__atomic_load_n(&g_flightWriting, __ATOMIC_ACQUIRE))
+		return false;
+
+	bool signal = strcmp(reason, "signal") == 0;
+
+	// Anomalies may repeat rapidly, keep the first dump around for a while.
+	static uint64_t lastDump;
+	if (!signal && lastDump != 0 && now - lastDump < 10000)
+		return true;
+	lastDump = now;
+
+	if (!signal)
+	{
+		g_flightSnapshot = g_flightRecorder;
+		g_flightReason = reason;
+		__atomic_store_n(&g_flightWriting, true, __ATOMIC_RELAXED);
+		if (!g_log.post(&writeFlightSnapshot, NULL))
+			__atomic_store_n(&g_flightWriting, false, __ATOMIC_RELAXED);
+		return true;
+	}
+
+	char text[512];
+	int priority = formatFlightResult(text, sizeof(text), g_flightRecorder.dump(g_flightFile, reason), reason);
+	g_log.write(priority, "%s", text);
+	return true;
+}
+
+static void logConfigError(const char *text)
+{
+	g_log.write(LOG_ERR, "%s", text);
+}
+
+static void dumpTrace()
+{
+	int result = g_tracer.dump(g_options.m_traceFile);
+	if (result < 0)
+		g_log.write(LOG_ERR, "Failed to write the trace to '%s'! (%d)\n", g_options.m_traceFile, -result);
+}
+
+// Invalid files keep the previous configuration in effect.
+static void reloadConfig()
+{
+	if (g_options.m_rulesFile)
+	{
+		static MidiRules rules;
+		if (rules.load(g_options.m_rulesFile) == 0)
+		{
+			g_rules = rules;
+			seqSetEventFilter(g_rules, g_midiToUsb.getCable());
+		}
+	}
+
+	if (g_options.m_transformFile)
+		g_transform.load(g_options.m_transformFile);
+
+	if (g_options.m_mappingFile)
+	{
+		static OscMapping mapping;
+		if (mapping.load(g_options.m_mappingFile) == 0)
+			g_mapping = mapping;
+	}
+
+	if (g_options.m_rateLimitsFile)
+	{
+		RateLimits limits;
+		if (limits.load(g_options.m_rateLimitsFile) == 0)
+			g_rateLimits = limits;
+	}
+
+	buildAddressSpace();
+}
+
+static int run(const char *name, const char *ip, uint16_t port)
+{
+	if (!name || !ip)
+		return -EINVAL;
+
+	bool done = false;
+	int result = 0;
+	uint64_t nextExpiryCheck = 0;
+	uint64_t nextPublish = 0;
+	int flushTimeout = -1;
+
+	if (g_options.m_rulesFile)
+	{
+		result = g_rules.load(g_options.m_rulesFile);
+		if (result < 0)
+			return result;
+	}
+
+	if (g_options.m_transformFile)
+	{
+		result = g_transform.load(g_options.m_transformFile);
+		if (result < 0)
+			return result;
+	}
+
+	if (g_options.m_mappingFile)
+	{
+		result = g_mapping.load(g_options.m_mappingFile);
+		if (result < 0)
+			return result;
+	}
+
+	if (g_options.m_rateLimitsFile)
+	{
+		result = g_rateLimits.load(g_options.m_rateLimitsFile);
+		if (result < 0)
+			return result;
+	}
+
+	buildAddressSpace();
+
+	if (g_options.m_semantic)
+		g_semanticOsc.init(g_options.m_semanticFormat);
+
+	g_loopDetector.setWindow(g_options.m_loopWindowMs);
+	g_shedder.setBudget(g_options.m_budgetUs);
+	g_shedder.setWatermark(g_options.m_queueWatermark);
+
+	struct sigaction sa;
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = &onSigHup;
+	sigaction(SIGHUP, &sa, NULL);
+
+	if (g_options.m_traceFile)
+	{
+		g_tracer.setRate(g_options.m_traceRate);
+		sa.sa_handler = &onSigUsr2;
+		sigaction(SIGUSR2, &sa, NULL);
+	}
+
+	if (g_options.m_flightFile)
+		snprintf(g_flightFile, sizeof(g_flightFile), "%s", g_options.m_flightFile);
+	else
+		snprintf(g_flightFile, sizeof(g_flightFile), "/tmp/osc2midi-%d.flight", (int)getpid());
+
+	sa.sa_handler = &onSigUsr1;
+	sigaction(SIGUSR1, &sa, NULL);
+
+	result = g_watchdog.init(g_options.m_stallBudgetUs);
+	if (result < 0)
+		return result;
+
+	result = g_perf.init(g_options.m_perfWindow);
+	if (result < 0)
+		return result;
+
+	{
+		static const int CRASH_SIGNALS[] = { SIGSEGV, SIGBUS, SIGFPE, SIGILL, SIGABRT };
+
+		struct sigaction crash;
+		memset(&crash, 0, sizeof(crash));
+		crash.sa_handler = &onCrash;
+		crash.sa_flags = SA_RESETHAND;
+		for (unsigned i=0; i<sizeof(CRASH_SIGNALS)/sizeof(CRASH_SIGNALS[0]); ++i)
+			sigaction(CRASH_SIGNALS[i], &crash, NULL);
+	}
+
+	result = seqInit(name);
+
+	if (result < 0)
+		goto cleanup;
+
+	result = seqSetEventFilter(g_rules, g_midiToUsb.getCable());
 
 	if (result < 0)
 		goto cleanup;
@@ -384,6 +1730,26 @@ static int run(const char *name, const char *ip, uint16_t port)
 	if (result < 0)
 		goto cleanup;
 
+	if (g_options.m_metricsFile)
+	{
+		result = g_metrics.open(g_options.m_metricsFile);
+
+		if (result < 0)
+			goto cleanup;
+
+		MetricsData *data = g_metrics.beginWrite();
+		data->m_startTime = nowUs() / 1000;
+		g_metrics.endWrite();
+	}
+
+	if (g_options.m_captureFile)
+	{
+		result = g_capture.open(g_options.m_captureFile);
+
+		if (result < 0)
+			goto cleanup;
+	}
+
 	sockaddr_in addr;
 	memset(&addr, 0, sizeof(addr));
 	if (inet_aton(ip, &addr.sin_addr) == 0)
@@ -396,53 +1762,171 @@ static int run(const char *name, const char *ip, uint16_t port)
 
 	sendHello(g_socket, addr, name);
 
-	npfd = snd_seq_poll_descriptors_count(g_seq, POLLIN);
-	if (npfd != 1)
+	pollfd fds[2];
+	result = g_seq.getPollDescriptor(fds[0]);
+	if (result < 0)
 	{
-		fprintf(stderr, "Unexpected count (%d) of seq fds! Expected 1!", npfd);
-		result = -EINVAL;
+		fprintf(stderr, "Unexpected count of seq fds! Expected 1!\n");
 		goto cleanup;
 	}
-
-	pollfd fds[2];
-	snd_seq_poll_descriptors(g_seq, &fds[0], 1, POLLIN);
 	fds[1].fd = g_socket;
 	fds[1].events = POLLIN;
 
+	// From here on, nothing on the event path waits for the log output.
+	result = g_log.start(g_options.m_logTarget);
+	if (result < 0)
+		goto cleanup;
+	ConfigReader::setReporter(&logConfigError);
+
+	// Everything the event loop needs is allocated by now.
+	alloc_guard_arm(true);
+
 	while (!done)
 	{
-		int n = poll(fds, 2, -1);
+		if (g_reload)
+		{
+			g_reload = 0;
+			reloadConfig();
+		}
+
+		// While there are sessions, wake up at least once a second to expire them.
+		int timeout = g_options.m_sessionTimeoutMs && g_peers.getCount() ? 1000 : -1;
+		if (flushTimeout >= 0 && (timeout < 0 || flushTimeout < timeout))
+			timeout = flushTimeout;
+
+		// Keep the timestamp and the gauges in the metrics file fresh.
+		if (g_metrics.isOpen() && (timeout < 0 || timeout > 1000))
+			timeout = 1000;
+
+		if (g_dumpTrace)
+		{
+			g_dumpTrace = 0;
+			AllocGuardExempt exempt;
+			dumpTrace();
+		}
+
+		if (g_dumpFlight && dumpFlightRecorder("signal", g_now))
+			g_dumpFlight = 0;
+
+		g_tracer.startIteration();
+		uint64_t pollStart = g_tracer.begin();
+
+		int n = poll(fds, 2, timeout);
+		g_tracer.end(TRACE_POLL, pollStart);
+		uint64_t iterationStart = g_tracer.begin();
+
 		if (n < 0)
 		{
-			fprintf(stderr, "Polling failed! (%d)\n", errno);
+			if (errno == EINTR)
+				continue;
+
+			g_log.write(LOG_ERR, "Polling failed! (%d)\n", errno);
 			result = -errno;
 			goto cleanup;
 		}
 
+		g_watchdog.beginIteration();
+
+		uint64_t start = nowUs();
+		uint64_t now = start / 1000;
+		g_now = now;
+
+		// The events waiting in the ALSA input buffer, measured before handling them.
+		unsigned queued = fds[0].revents ? (unsigned)g_seq.inputPending(true) : 0;
+		g_stats.m_input.m_queueDepth = queued;
+		if (queued > g_stats.m_input.m_maxQueueDepth)
+			g_stats.m_input.m_maxQueueDepth = queued;
+
+		if (g_options.m_sessionTimeoutMs && now >= nextExpiryCheck)
+		{
+			g_watchdog.enter(WATCH_EXPIRY);
+			expirePeers(g_seq, g_port, now, false);
+			g_watchdog.enter(WATCH_LOOP);
+			nextExpiryCheck = now + 1000;
+		}
+
 		if (fds[0].revents)
 		{
 			--n;
+			g_watchdog.enter(WATCH_ALSA);
+			uint64_t handled = perfBegin(MIDI_DIR_OUT);
 			done = handleSeqEvent(g_seq, addr, g_port);
+			perfEnd(MIDI_DIR_OUT, handled);
 		}
 		if (fds[1].revents)
 		{
 			--n;
 			char buffer[256];
 			sockaddr_in a;
-			socklen_t l = sizeof(a);
-			ssize_t len = recvfrom(g_socket, buffer, sizeof(buffer), 0, (sockaddr*)&a, &l);
+			g_watchdog.enter(WATCH_UDP);
+			uint64_t t = g_tracer.begin();
+			ssize_t len = udpReceive(g_socket, buffer, sizeof(buffer), a, g_recvTime);
+			g_tracer.end(TRACE_RECV, t, len > 0 ? len : 0);
 			if (len > 0)
 			{
-				done = handleUdpPacket(buffer, (size_t)len, g_seq, g_port);
+				PROBE_RECEIVE(len, ntohl(a.sin_addr.s_addr), ntohs(a.sin_port));
+				capture(CAPTURE_UDP_IN, a.sin_addr.s_addr, a.sin_port, buffer, len);
+				t = g_tracer.begin();
+				Peer *peer = getPeer(g_seq, g_port, a, now);
+				uint64_t handled = perfBegin(MIDI_DIR_IN);
+				done = handleUdpPacket(buffer, (size_t)len, peer, g_seq, g_port);
+				perfEnd(MIDI_DIR_IN, handled);
+				g_tracer.end(TRACE_PARSE, t, len);
 			}
 		}
 
 		assert(n == 0);
+
+		if (flushTimeout >= 0 || (fds[1].revents && !g_rateLimits.isEmpty()))
+		{
+			g_watchdog.enter(WATCH_FLUSH);
+			flushTimeout = flushPeers(g_seq, g_port);
+		}
+
+		g_watchdog.enter(WATCH_LOOP);
+
+		unsigned busyUs = (unsigned)(nowUs() - start);
+		PROBE_LOOP_ITERATION(busyUs, queued);
+
+		if (g_options.m_budgetUs)
+			sampleLoad(busyUs, queued, now);
+
+		if (busyUs > FLIGHT_STALL_US)
+			dumpFlightRecorder("stall", now);
+		else if (g_flightRecorder.isDropBurst(now, FLIGHT_DROP_BURST))
+			dumpFlightRecorder("drop burst", now);
+
+		if (g_metrics.isOpen() && now >= nextPublish)
+		{
+			publishMetrics(now);
+			nextPublish = now + METRICS_INTERVAL_MS;
+		}
+
+		g_watchdog.endIteration();
+		g_tracer.end(TRACE_ITERATION, iterationStart);
 	}
 
 cleanup:
+	alloc_guard_arm(false);
+
+	if (g_seq.isOpen())
+		expirePeers(g_seq, g_port, 0, true);
+
+	if (g_tracer.isEnabled())
+		dumpTrace();
+
+	if (g_capture.isOpen())
+	{
+		if (g_capture.getLost())
+			g_log.write(LOG_WARNING, "Capture lost %llu records!\n", (unsigned long long)g_capture.getLost());
+		g_capture.close();
+	}
+
+	g_metrics.close();
 	udpUninit();
 	seqUninit();
+	ConfigReader::setReporter(NULL);
+	g_log.stop();
 
 	return result;
 }
@@ -454,7 +1938,50 @@ static void printVersion(void)
 
 static void printUsage()
 {
-	printf("Usage: osc2midi \"Virtual Port Name\" host_ip host_port\n"
+	printf("Usage: osc2midi [options] \"Virtual Port Name\" host_ip host_port\n"
+		"Options:\n"
+		"\t-r, --rules FILE     Drop, route and split events according to the rules in FILE.\n"
+		"\t-t, --transform FILE Apply the per channel transforms in FILE.\n"
+		"\t-m, --map FILE       Map the OSC addresses listed in FILE to MIDI events.\n"
+		"\t-R, --rate-limits FILE\n"
+		"\t                     Limit the event rate of each sender per the policies in FILE.\n"
+		"\t                     The files above get reloaded on SIGHUP.\n"
+		"\t-M, --metrics FILE   Publish the counters in FILE for osc2midi-top, such as\n"
+		"\t                     " METRICS_DEFAULT_PATH ".\n"
+		"\t-T, --trace FILE     Trace the event handling stages, written to FILE as Chrome\n"
+		"\t                     trace JSON on SIGUSR2 and on exit.\n"
+		"\t-N, --trace-rate N   Trace one of every N event loop iterations (default 1).\n"
+		"\t-F, --flight-recorder FILE\n"
+		"\t                     Where to write the last events on SIGUSR1, anomalies and\n"
+		"\t                     crashes (default /tmp/osc2midi-<pid>.flight).\n"
+		"\t-L, --log TARGET     Where to log the diagnostics while running: stderr (default),\n"
+		"\t                     syslog or a file to append to.\n"
+		"\t-C, --capture FILE   Record every datagram and ALSA event with its time in FILE,\n"
+		"\t                     for osc2midi-replay.\n"
+		"\t-f, --format FORMAT  Format of the sent events: hex (default), int or float.\n"
+		"\t                     int and float use addresses like /ch/1/note and /ch/3/cc/74.\n"
+		"\t-s, --session-timeout SECONDS\n"
+		"\t                     Release the notes held by a sender after it's silent for\n"
+		"\t                     SECONDS (default 30), 0 disables the timeout.\n"
+		"\t-l, --loop-window MS Drop events coming back from ALSA within MS (default 10)\n"
+		"\t                     of being sent, to break feedback loops. 0 disables the loop\n"
+		"\t                     detection entirely.\n"
+		"\t-b, --budget US      Shed low priority events when handling the events takes over\n"
+		"\t                     US microseconds per loop iteration on average (default 5000).\n"
+		"\t                     0 disables the shedding.\n"
+		"\t-q, --queue-watermark EVENTS\n"
+		"\t                     Shed low priority events when over EVENTS are waiting in the\n"
+		"\t                     ALSA input (default 256).\n"
+		"\t-w, --stall-budget US\n"
+		"\t                     Count event loop iterations taking over US microseconds per\n"
+		"\t                     handler, with a backtrace of the last one in the stats.\n"
+		"\t                     0 (default) disables the watchdog.\n"
+		"\t-P, --perf-counters EVENTS\n"
+		"\t                     Report the CPU cycles, instructions, cache misses and context\n"
+		"\t                     switches per event in the stats, averaged over EVENTS.\n"
+		"\t                     0 (default) disables the counters.\n"
+		"\t-v, --version        Print the version and exit.\n"
+		"\t-h, --help           Print this help and exit.\n"
 		"Example:\n"
 		"\tosc2midi \"Osc MIDI Bridge\" 127.0.0.1 8000\n"
 		"\n"
@@ -462,23 +1989,185 @@ static void printUsage()
 	printVersion();
 }
 
+static const option OPTIONS[] = {
+	{ "rules",     required_argument, NULL, 'r' },
+	{ "transform", required_argument, NULL, 't' },
+	{ "map",       required_argument, NULL, 'm' },
+	{ "rate-limits", required_argument, NULL, 'R' },
+	{ "metrics",   required_argument, NULL, 'M' },
+	{ "trace",     required_argument, NULL, 'T' },
+	{ "trace-rate", required_argument, NULL, 'N' },
+	{ "flight-recorder", required_argument, NULL, 'F' },
+	{ "log",       required_argument, NULL, 'L' },
+	{ "capture",   required_argument, NULL, 'C' },
+	{ "format",    required_argument, NULL, 'f' },
+	{ "session-timeout", required_argument, NULL, 's' },
+	{ "loop-window", required_argument, NULL, 'l' },
+	{ "budget",    required_argument, NULL, 'b' },
+	{ "queue-watermark", required_argument, NULL, 'q' },
+	{ "stall-budget", required_argument, NULL, 'w' },
+	{ "perf-counters", required_argument, NULL, 'P' },
+	{ "version",   no_argument,       NULL, 'v' },
+	{ "help",      no_argument,       NULL, 'h' },
+	{ NULL,        0,                 NULL, 0   }
+};
+
 int main(int argc, char **argv)
 {
-	if (argc == 2 && (strcmp(argv[1], "-v") == 0 || strcmp(argv[1], "--version") == 0))
+	int opt;
+	while ((opt = getopt_long(argc, argv, "r:t:m:R:M:T:N:F:L:C:f:s:l:b:q:w:P:vh", OPTIONS, NULL)) != -1)
 	{
-		printVersion();
-		return 0;
+		switch (opt)
+		{
+		case 'r':
+			g_options.m_rulesFile = optarg;
+			break;
+		case 't':
+			g_options.m_transformFile = optarg;
+			break;
+		case 'm':
+			g_options.m_mappingFile = optarg;
+			break;
+		case 'R':
+			g_options.m_rateLimitsFile = optarg;
+			break;
+		case 'M':
+			g_options.m_metricsFile = optarg;
+			break;
+		case 'T':
+			g_options.m_traceFile = optarg;
+			break;
+		case 'F':
+			g_options.m_flightFile = optarg;
+			break;
+		case 'L':
+			g_options.m_logTarget = optarg;
+			break;
+		case 'C':
+			g_options.m_captureFile = optarg;
+			break;
+		case 'N':
+			{
+				char *endPtr;
+				unsigned long rate = strtoul(optarg, &endPtr, 10);
+				if (endPtr == optarg || *endPtr != '\0' || rate < 1 || rate > 1000000)
+				{
+					fprintf(stderr, "Invalid trace rate '%s'!\n", optarg);
+					return EINVAL;
+				}
+				g_options.m_traceRate = rate;
+			}
+			break;
+		case 'f':
+			if (strcmp(optarg, "hex") == 0)
+			{
+				g_options.m_semantic = false;
+			}
+			else if (strcmp(optarg, "int") == 0 || strcmp(optarg, "float") == 0)
+			{
+				g_options.m_semantic = true;
+				g_options.m_semanticFormat = optarg[0] == 'f' ? SemanticOsc::FORMAT_FLOAT : SemanticOsc::FORMAT_INT;
+			}
+			else
+			{
+				fprintf(stderr, "Unknown format '%s'!\n", optarg);
+				return EINVAL;
+			}
+			break;
+		case 's':
+			{
+				char *endPtr;
+				unsigned long seconds = strtoul(optarg, &endPtr, 10);
+				if (endPtr == optarg || *endPtr != '\0' || seconds > 86400)
+				{
+					fprintf(stderr, "Invalid session timeout '%s'!\n", optarg);
+					return EINVAL;
+				}
+				g_options.m_sessionTimeoutMs = seconds * 1000;
+			}
+			break;
+		case 'l':
+			{
+				char *endPtr;
+				unsigned long ms = strtoul(optarg, &endPtr, 10);
+				if (endPtr == optarg || *endPtr != '\0' || ms > 10000)
+				{
+					fprintf(stderr, "Invalid loop window '%s'!\n", optarg);
+					return EINVAL;
+				}
+				g_options.m_loopWindowMs = ms;
+			}
+			break;
+		case 'b':
+			{
+				char *endPtr;
+				unsigned long us = strtoul(optarg, &endPtr, 10);
+				if (endPtr == optarg || *endPtr != '\0' || us > 1000000)
+				{
+					fprintf(stderr, "Invalid budget '%s'!\n", optarg);
+					return EINVAL;
+				}
+				g_options.m_budgetUs = us;
+			}
+			break;
+		case 'q':
+			{
+				char *endPtr;
+				unsigned long events = strtoul(optarg, &endPtr, 10);
+				if (endPtr == optarg || *endPtr != '\0' || events > 1000000)
+				{
+					fprintf(stderr, "Invalid queue watermark '%s'!\n", optarg);
+					return EINVAL;
+				}
+				g_options.m_queueWatermark = events;
+			}
+			break;
+		case 'w':
+			{
+				char *endPtr;
+				unsigned long us = strtoul(optarg, &endPtr, 10);
+				if (endPtr == optarg || *endPtr != '\0' || us > 10000000)
+				{
+					fprintf(stderr, "Invalid stall budget '%s'!\n", optarg);
+					return EINVAL;
+				}
+				g_options.m_stallBudgetUs = us;
+			}
+			break;
+		case 'P':
+			{
+				char *endPtr;
+				unsigned long events = strtoul(optarg, &endPtr, 10);
+				if (endPtr == optarg || *endPtr != '\0' || events > 1000000)
+				{
+					fprintf(stderr, "Invalid performance counter window '%s'!\n", optarg);
+					return EINVAL;
+				}
+				g_options.m_perfWindow = events;
+			}
+			break;
+		case 'v':
+			printVersion();
+			return 0;
+		case 'h':
+		default:
+			printUsage();
+			return 0;
+		}
 	}
-	else if (argc != 4)
+
+	if (argc - optind != 3)
 	{
 		printUsage();
 		return 0;
 	}
 
+	argv += optind;
+
 	char *endPtr;
-	uint32_t port = strtoul(argv[3], &endPtr, 10);
+	uint32_t port = strtoul(argv[2], &endPtr, 10);
 
-	if (endPtr == argv[3] || *endPtr != '\0')
+	if (endPtr == argv[2] || *endPtr != '\0')
 	{
 		fprintf(stderr, "Failed parsing host_port argument!\n");
 		return EINVAL;
@@ -490,7 +2179,7 @@ int main(int argc, char **argv)
 		return EINVAL;
 	}
 
-	int result = run(argv[1], argv[2], port);
+	int result = run(argv[0], argv[1], port);
 
 	if (result < 0)
 		fprintf(stderr, "Error %d!\n", result);
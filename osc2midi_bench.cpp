@@ -0,0 +1,383 @@
+/*
+ * osc2midi - a bridge between OSC and (ALSA) MIDI.
+ * Copyright (C) 2018  Vilniaus Blokas UAB, https://blokas.io/
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2 of the
+ * License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <getopt.h>
+#include <time.h>
+
+#include "midi_serialization.h"
+#include "hex32.h"
+
+// Microbenchmarks of the MIDI byte stream and OSC hex codecs. Each benchmark
+// runs its pass repeatedly for a number of rounds, the fastest round is
+// reported, as JSON on stdout.
+
+enum
+{
+	STREAM_SIZE = 64 * 1024,
+	HEX_COUNT   = 4096,
+	ROUNDS      = 5,
+};
+
+enum StreamType
+{
+	STREAM_RUNNING_STATUS, // Notes using running status, interleaved with clock.
+	STREAM_MIXED,          // Channel messages of all kinds, clock and short SysEx.
+	STREAM_SYSEX,          // 4KB SysEx dumps.
+
+	STREAM_COUNT
+};
+
+static const char *const STREAM_NAMES[STREAM_COUNT] = {
+	"running_status",
+	"mixed",
+	"sysex",
+};
+
+struct Stream
+{
+	uint8_t m_bytes[STREAM_SIZE];
+	unsigned m_length;
+
+	midi_event_t m_events[STREAM_SIZE];
+	unsigned m_eventCount;
+};
+
+static Stream g_streams[STREAM_COUNT];
+static uint32_t g_hexValues[HEX_COUNT];
+static char g_hexStrings[HEX_COUNT][12];
+
+// Written once per pass, to keep the work from being optimized away.
+static volatile uint32_t g_sink;
+
+static uint32_t g_seed = 0x12345678;
+
+static uint8_t random7()
+{
+	g_seed = g_seed * 1103515245 + 12345;
+	return (g_seed >> 16) & 0x7f;
+}
+
+static uint64_t nowNs()
+{
+	timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static uint32_t packMidiEvent(const midi_event_t &event)
+{
+	return (event.m_event << 24) | (event.m_data[0] << 16) | (event.m_data[1] << 8) | event.m_data[2];
+}
+
+class StreamBuilder
+{
+public:
+	explicit StreamBuilder(Stream &stream)
+		:m_stream(stream)
+	{
+		m_stream.m_length = 0;
+	}
+
+	bool isFull(unsigned reserve) const
+	{
+		return m_stream.m_length + reserve > STREAM_SIZE;
+	}
+
+	void put(uint8_t byte)
+	{
+		if (m_stream.m_length < STREAM_SIZE)
+			m_stream.m_bytes[m_stream.m_length++] = byte;
+	}
+
+private:
+	Stream &m_stream;
+};
+
+static void buildRunningStatus(Stream &stream)
+{
+	StreamBuilder b(stream);
+	while (!b.isFull(8))
+	{
+		b.put(0x90 | (random7() & 0x0f));
+		for (int i=0; i<16 && !b.isFull(8); ++i)
+		{
+			b.put(random7());
+			// Real-time messages may appear in between the data bytes.
+			if ((i & 3) == 1)
+				b.put(0xf8);
+			b.put(i & 1 ? 0 : random7() | 1);
+		}
+	}
+}
+
+static void buildMixed(Stream &stream)
+{
+	StreamBuilder b(stream);
+	while (!b.isFull(16))
+	{
+		uint8_t channel = random7() & 0x0f;
+		switch (random7() % 8)
+		{
+		case 0:
+			b.put(0x90 | channel);
+			b.put(random7());
+			b.put(random7());
+			break;
+		case 1:
+			b.put(0x80 | channel);
+			b.put(random7());
+			b.put(random7());
+			break;
+		case 2:
+		case 3:
+			b.put(0xb0 | channel);
+			b.put(random7());
+			b.put(random7());
+			break;
+		case 4:
+			b.put(0xc0 | channel);
+			b.put(random7());
+			break;
+		case 5:
+			b.put(0xe0 | channel);
+			b.put(random7());
+			b.put(random7());
+			break;
+		case 6:
+			b.put(0xd0 | channel);
+			b.put(random7());
+			break;
+		case 7:
+			b.put(0xf8);
+			if (random7() < 8)
+			{
+				b.put(0xf0);
+				for (int i=0; i<9; ++i)
+					b.put(random7());
+				b.put(0xf7);
+			}
+			break;
+		}
+	}
+}
+
+static void buildSysex(Stream &stream)
+{
+	StreamBuilder b(stream);
+	while (!b.isFull(4096))
+	{
+		b.put(0xf0);
+		for (int i=0; i<4094; ++i)
+			b.put(random7());
+		b.put(0xf7);
+	}
+}
+
+static void setup()
+{
+	buildRunningStatus(g_streams[STREAM_RUNNING_STATUS]);
+	buildMixed(g_streams[STREAM_MIXED]);
+	buildSysex(g_streams[STREAM_SYSEX]);
+
+	for (unsigned s=0; s<STREAM_COUNT; ++s)
+	{
+		Stream &stream = g_streams[s];
+		MidiToUsb m2u(0);
+		stream.m_eventCount = 0;
+		for (unsigned i=0; i<stream.m_length; ++i)
+		{
+			if (m2u.process(stream.m_bytes[i], stream.m_events[stream.m_eventCount]))
+				++stream.m_eventCount;
+		}
+	}
+
+	const Stream &mixed = g_streams[STREAM_MIXED];
+	for (unsigned i=0; i<HEX_COUNT; ++i)
+	{
+		g_hexValues[i] = packMidiEvent(mixed.m_events[i % mixed.m_eventCount]);
+		encodeHex32(g_hexStrings[i], g_hexValues[i]);
+	}
+}
+
+// A pass returns the count of events it processed.
+typedef unsigned (*PassFunction)(const Stream *stream);
+
+static unsigned passMidiToUsb(const Stream *stream)
+{
+	MidiToUsb m2u(0);
+	midi_event_t ev;
+	uint32_t sink = 0;
+	unsigned n = 0;
+	for (unsigned i=0; i<stream->m_length; ++i)
+	{
+		if (m2u.process(stream->m_bytes[i], ev))
+		{
+			sink ^= packMidiEvent(ev);
+			++n;
+		}
+	}
+	g_sink = sink;
+	return n;
+}
+
+static unsigned passUsbToMidi(const Stream *stream)
+{
+	uint8_t out[3];
+	uint32_t sink = 0;
+	for (unsigned i=0; i<stream->m_eventCount; ++i)
+		sink += UsbToMidi::process(stream->m_events[i], out) + out[0];
+	g_sink = sink;
+	return stream->m_eventCount;
+}
+
+static unsigned passEncodeHex32(const Stream *)
+{
+	char buffer[12];
+	uint32_t sink = 0;
+	for (unsigned i=0; i<HEX_COUNT; ++i)
+	{
+		encodeHex32(buffer, g_hexValues[i]);
+
+		// Every digit goes into the sink, or the encoder gets reduced to a couple of lookups.
+		uint32_t digits[2];
+		memcpy(digits, buffer, sizeof(digits));
+		sink += digits[0] ^ digits[1];
+	}
+	g_sink = sink;
+	return HEX_COUNT;
+}
+
+static unsigned passDecodeHex32(const Stream *)
+{
+	uint32_t sink = 0;
+	for (unsigned i=0; i<HEX_COUNT; ++i)
+	{
+		uint32_t value;
+		if (decodeHex32(value, g_hexStrings[i]))
+			sink ^= value;
+	}
+	g_sink = sink;
+	return HEX_COUNT;
+}
+
+static void run(const char *name, const char *streamName, PassFunction pass, const Stream *stream, uint64_t durationNs, bool &first)
+{
+	// Warm up the caches and the branch predictors.
+	pass(stream);
+
+	double best = 0.0;
+	uint64_t total = 0;
+	for (unsigned r=0; r<ROUNDS; ++r)
+	{
+		uint64_t events = 0;
+		uint64_t start = nowNs();
+		uint64_t elapsed;
+		do
+		{
+			events += pass(stream);
+			elapsed = nowNs() - start;
+		}
+		while (elapsed < durationNs / ROUNDS);
+
+		double ns = (double)elapsed / events;
+		if (r == 0 || ns < best)
+			best = ns;
+		total += events;
+	}
+
+	printf("%s\t\t{ \"name\": \"%s%s%s\", \"events\": %llu, \"ns_per_event\": %.3f, \"events_per_second\": %.0f }",
+		first ? "" : ",\n",
+		name,
+		streamName ? "/" : "",
+		streamName ? streamName : "",
+		(unsigned long long)total,
+		best,
+		best > 0.0 ? 1e9 / best : 0.0
+		);
+	fflush(stdout);
+	first = false;
+}
+
+static void printUsage()
+{
+	printf("Usage: osc2midi-bench [options]\n"
+		"Options:\n"
+		"\t-d, --duration MS    Time to run each benchmark for (default 500).\n"
+		"\t-h, --help           Print this help and exit.\n"
+		"Runs the codec microbenchmarks and prints the results as JSON.\n"
+		"\n"
+		);
+}
+
+static const option OPTIONS[] = {
+	{ "duration",  required_argument, NULL, 'd' },
+	{ "help",      no_argument,       NULL, 'h' },
+	{ NULL,        0,                 NULL, 0   }
+};
+
+int main(int argc, char **argv)
+{
+	unsigned long durationMs = 500;
+
+	int opt;
+	while ((opt = getopt_long(argc, argv, "d:h", OPTIONS, NULL)) != -1)
+	{
+		switch (opt)
+		{
+		case 'd':
+			{
+				char *endPtr;
+				durationMs = strtoul(optarg, &endPtr, 10);
+				if (endPtr == optarg || *endPtr != '\0' || durationMs < 1 || durationMs > 600000)
+				{
+					fprintf(stderr, "Invalid duration '%s'!\n", optarg);
+					return EINVAL;
+				}
+			}
+			break;
+		case 'h':
+		default:
+			printUsage();
+			return 0;
+		}
+	}
+
+	setup();
+
+	uint64_t durationNs = (uint64_t)durationMs * 1000000;
+	bool first = true;
+
+	printf("{\n\t\"duration_ms\": %lu,\n\t\"benchmarks\": [\n", durationMs);
+
+	for (unsigned s=0; s<STREAM_COUNT; ++s)
+		run("midi_to_usb", STREAM_NAMES[s], &passMidiToUsb, &g_streams[s], durationNs, first);
+	for (unsigned s=0; s<STREAM_COUNT; ++s)
+		run("usb_to_midi", STREAM_NAMES[s], &passUsbToMidi, &g_streams[s], durationNs, first);
+	run("encode_hex32", NULL, &passEncodeHex32, NULL, durationNs, first);
+	run("decode_hex32", NULL, &passDecodeHex32, NULL, durationNs, first);
+
+	printf("\n\t]\n}\n");
+
+	return 0;
+}
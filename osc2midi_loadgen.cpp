@@ -0,0 +1,558 @@
+/*
+ * osc2midi - a bridge between OSC and (ALSA) MIDI.
+ * Copyright (C) 2018  Vilniaus Blokas UAB, https://blokas.io/
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2 of the
+ * License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+
+#include "hex32.h"
+
+// Synthetic /osc2midi/event load, for stressing the bridge well beyond what a
+// real host produces. Each sender thread has its own socket and paces its share
+// of the rate against CLOCK_MONOTONIC, sending the due events in sendmmsg
+// batches. The totals are printed as JSON on exit.
+
+enum Pattern
+{
+	PATTERN_CC,    // Sweeps of every controller from 0 to 127 and back.
+	PATTERN_CHORD, // 4 note chords, each burst of note ons followed by their note offs.
+	PATTERN_CLOCK, // Timing clock, with a start every 96 clocks.
+	PATTERN_SYSEX, // 256 byte SysEx dumps.
+	PATTERN_MIX,   // All of the above, interleaved.
+
+	PATTERN_COUNT
+};
+
+static const char *const PATTERN_NAMES[PATTERN_COUNT] = {
+	"cc",
+	"chord",
+	"clock",
+	"sysex",
+	"mix",
+};
+
+enum
+{
+	MAX_THREADS   = 64,
+	MAX_BATCH     = 1024,
+	SYSEX_LENGTH  = 256,
+
+	// /osc2midi/event ,s followed by the 8 hex digits padded to 12 bytes.
+	MESSAGE_SIZE  = 32,
+};
+
+static const char MSG_MIDI_EVENT[20] = {
+	'/', 'o', 's', 'c', '2', 'm', 'i', 'd', 'i', '/', 'e', 'v', 'e', 'n', 't', '\0',
+	',', 's', '\0', '\0'
+};
+
+struct Options
+{
+	sockaddr_in m_addr;
+	uint64_t m_rate;
+	double m_duration;
+	unsigned m_threads;
+	unsigned m_batch;
+	unsigned m_channel;
+	Pattern m_pattern;
+};
+
+// Produces the packed USB-MIDI events of a pattern, one at a time.
+class PatternGenerator
+{
+public:
+	PatternGenerator(Pattern pattern, unsigned channel);
+
+	uint32_t next();
+
+private:
+	enum
+	{
+		// Events of a whole controller sweep, chord, clock bar and SysEx dump.
+		CC_UNIT    = 254,
+		CHORD_UNIT = 8,
+		CLOCK_UNIT = 96,
+		SYSEX_UNIT = (SYSEX_LENGTH + 2) / 3,
+
+		// The mix runs a pattern for whole units, at least this many events.
+		MIX_RUN    = 64,
+	};
+
+	uint32_t nextOf(Pattern pattern);
+	uint32_t nextCc();
+	uint32_t nextChord();
+	uint32_t nextClock();
+	uint32_t nextSysex();
+
+	static unsigned getUnit(Pattern pattern);
+
+	Pattern m_pattern;
+	unsigned m_channel;
+	unsigned m_positions[PATTERN_MIX]; // Each pattern continues where it left off.
+	Pattern m_current;                 // Of the mix.
+	unsigned m_remaining;              // Events until the mix switches to the next pattern.
+};
+
+PatternGenerator::PatternGenerator(Pattern pattern, unsigned channel)
+	:m_pattern(pattern)
+	,m_channel(channel & 0xf)
+	,m_current(PATTERN_SYSEX)
+	,m_remaining(0)
+{
+	memset(m_positions, 0, sizeof(m_positions));
+}
+
+unsigned PatternGenerator::getUnit(Pattern pattern)
+{
+	switch (pattern)
+	{
+	case PATTERN_CC:    return CC_UNIT;
+	case PATTERN_CHORD: return CHORD_UNIT;
+	case PATTERN_CLOCK: return CLOCK_UNIT;
+	case PATTERN_SYSEX:
+	default:            return SYSEX_UNIT;
+	}
+}
+
+uint32_t PatternGenerator::next()
+{
+	if (m_pattern != PATTERN_MIX)
+		return nextOf(m_pattern);
+
+	// Switches only at the end of a unit, so SysEx dumps and chords are never cut.
+	if (m_remaining == 0)
+	{
+		m_current = (Pattern)((m_current + 1) % PATTERN_MIX);
+		unsigned unit = getUnit(m_current);
+		m_remaining = (MIX_RUN + unit - 1) / unit * unit;
+	}
+
+	--m_remaining;
+	return nextOf(m_current);
+}
+
+uint32_t PatternGenerator::nextOf(Pattern pattern)
+{
+	switch (pattern)
+	{
+	case PATTERN_CC:    return nextCc();
+	case PATTERN_CHORD: return nextChord();
+	case PATTERN_CLOCK: return nextClock();
+	case PATTERN_SYSEX:
+	default:            return nextSysex();
+	}
+}
+
+uint32_t PatternGenerator::nextCc()
+{
+	// Up and down, 254 values per controller, over controllers 0 to 119.
+	unsigned i = m_positions[PATTERN_CC]++ % (CC_UNIT * 120);
+	unsigned controller = i / CC_UNIT;
+	unsigned value = i % CC_UNIT;
+	if (value > 127)
+		value = 254 - value;
+	return 0x0bb00000 | (m_channel << 16) | (controller << 8) | value;
+}
+
+uint32_t PatternGenerator::nextChord()
+{
+	static const uint8_t INTERVALS[4] = { 0, 4, 7, 11 };
+
+	unsigned i = m_positions[PATTERN_CHORD]++ % (CHORD_UNIT * 12);
+	unsigned chord = i / CHORD_UNIT;
+	unsigned note = 48 + chord + INTERVALS[i % 4];
+	if ((i % CHORD_UNIT) < 4)
+		return 0x09900000 | (m_channel << 16) | (note << 8) | 100;
+	return 0x08800000 | (m_channel << 16) | (note << 8);
+}
+
+uint32_t PatternGenerator::nextClock()
+{
+	unsigned i = m_positions[PATTERN_CLOCK]++ % CLOCK_UNIT;
+	return i == 0 ? 0x0ffa0000 : 0x0ff80000;
+}
+
+uint32_t PatternGenerator::nextSysex()
+{
+	// F0 7D, SYSEX_LENGTH - 3 data bytes, F7, in 3 byte packets.
+	unsigned packet = m_positions[PATTERN_SYSEX]++ % SYSEX_UNIT;
+	uint8_t b[3];
+	for (unsigned j=0; j<3; ++j)
+	{
+		unsigned offset = packet * 3 + j;
+		if (offset == 0)
+			b[j] = 0xf0;
+		else if (offset == 1)
+			b[j] = 0x7d;
+		else if (offset < SYSEX_LENGTH - 1)
+			b[j] = offset & 0x7f;
+		else if (offset == SYSEX_LENGTH - 1)
+			b[j] = 0xf7;
+		else
+			b[j] = 0x00;
+	}
+
+	uint8_t cin = 0x4;
+	if (packet == SYSEX_UNIT - 1)
+		cin = 0x5 + (SYSEX_LENGTH - 1) % 3;
+
+	return (cin << 24) | (b[0] << 16) | (b[1] << 8) | b[2];
+}
+
+struct Sender
+{
+	pthread_t m_thread;
+	const Options *m_options;
+	unsigned m_index;
+	uint64_t m_rate;
+	int m_socket;
+
+	uint64_t m_sent;
+	uint64_t m_errors;
+	uint64_t m_late;
+
+	char m_messages[MAX_BATCH][MESSAGE_SIZE];
+	iovec m_iovecs[MAX_BATCH];
+	mmsghdr m_headers[MAX_BATCH];
+};
+
+static volatile sig_atomic_t g_done;
+
+static void onSignal(int)
+{
+	g_done = 1;
+}
+
+static uint64_t nowNs()
+{
+	timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void sleepUntil(uint64_t ns)
+{
+	timespec ts = { (time_t)(ns / 1000000000), (long)(ns % 1000000000) };
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR && !g_done)
+	{
+	}
+}
+
+static void *senderMain(void *arg)
+{
+	Sender &sender = *(Sender*)arg;
+	const Options &options = *sender.m_options;
+
+	for (unsigned i=0; i<MAX_BATCH; ++i)
+	{
+		memset(sender.m_messages[i], 0, MESSAGE_SIZE);
+		memcpy(sender.m_messages[i], MSG_MIDI_EVENT, sizeof(MSG_MIDI_EVENT));
+		sender.m_iovecs[i].iov_base = sender.m_messages[i];
+		sender.m_iovecs[i].iov_len = MESSAGE_SIZE;
+		memset(&sender.m_headers[i], 0, sizeof(mmsghdr));
+		sender.m_headers[i].msg_hdr.msg_iov = &sender.m_iovecs[i];
+		sender.m_headers[i].msg_hdr.msg_iovlen = 1;
+	}
+
+	// Every thread sends its pattern on its own channel.
+	PatternGenerator generator(options.m_pattern, options.m_channel + sender.m_index);
+
+	uint64_t start = nowNs();
+	uint64_t duration = options.m_duration > 0.0 ? (uint64_t)(options.m_duration * 1e9) : UINT64_MAX;
+	uint64_t total = options.m_duration > 0.0 ? (uint64_t)(options.m_duration * sender.m_rate) : UINT64_MAX;
+	uint64_t sent = 0;
+
+	while (!g_done && sent < total)
+	{
+		// Past the duration, falling short of the rate is reported rather than made up for.
+		uint64_t elapsed = nowNs() - start;
+		bool last = elapsed >= duration;
+
+		uint64_t due = (uint64_t)((unsigned __int128)elapsed * sender.m_rate / 1000000000);
+		if (due > total)
+			due = total;
+
+		if (due <= sent && !last)
+		{
+			sleepUntil(start + (uint64_t)((unsigned __int128)(sent + 1) * 1000000000 / sender.m_rate));
+			continue;
+		}
+
+		// More than a batch behind, the receiver or the kernel can't keep up.
+		if (due - sent > options.m_batch)
+			++sender.m_late;
+
+		unsigned count = due - sent < options.m_batch ? due - sent : options.m_batch;
+		for (unsigned i=0; i<count; ++i)
+			encodeHex32(sender.m_messages[i] + sizeof(MSG_MIDI_EVENT), generator.next());
+
+		unsigned done = 0;
+		while (done < count)
+		{
+			int n = sendmmsg(sender.m_socket, sender.m_headers + done, count - done, 0);
+			if (n < 0)
+			{
+				// The events are counted as sent regardless, to keep the offered rate fixed.
+				++sender.m_errors;
+				break;
+			}
+			done += n;
+		}
+
+		sent += count;
+		sender.m_sent += done;
+
+		if (last)
+			break;
+	}
+
+	return NULL;
+}
+
+static int parseAddress(sockaddr_in &addr, const char *host, const char *port)
+{
+	char *endPtr;
+	unsigned long p = strtoul(port, &endPtr, 10);
+	if (endPtr == port || *endPtr != '\0' || p < 1 || p > 65535)
+		return -EINVAL;
+
+	addrinfo hints;
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_INET;
+	hints.ai_socktype = SOCK_DGRAM;
+
+	addrinfo *result;
+	if (getaddrinfo(host, NULL, &hints, &result) != 0)
+		return -ENOENT;
+
+	memcpy(&addr, result->ai_addr, sizeof(addr));
+	addr.sin_port = htons(p);
+	freeaddrinfo(result);
+	return 0;
+}
+
+static void printUsage()
+{
+	printf("Usage: osc2midi-loadgen [options] <host> <port>\n"
+		"Options:\n"
+		"\t-r, --rate EVENTS    Total events per second, split among the threads (default 10000).\n"
+		"\t-d, --duration SECONDS\n"
+		"\t                     How long to run, 0 runs until interrupted (default 10).\n"
+		"\t-j, --threads N      Number of sender threads, each with its own socket (default 1).\n"
+		"\t-b, --batch N        Most events per sendmmsg call (default 64).\n"
+		"\t-p, --pattern NAME   cc, chord, clock, sysex or mix (default cc).\n"
+		"\t-c, --channel N      MIDI channel of the first thread, 1-16, the following threads\n"
+		"\t                     use the next channels (default 1).\n"
+		"\t-h, --help           Print this help and exit.\n"
+		"\n"
+		);
+}
+
+static const option OPTIONS[] = {
+	{ "rate",      required_argument, NULL, 'r' },
+	{ "duration",  required_argument, NULL, 'd' },
+	{ "threads",   required_argument, NULL, 'j' },
+	{ "batch",     required_argument, NULL, 'b' },
+	{ "pattern",   required_argument, NULL, 'p' },
+	{ "channel",   required_argument, NULL, 'c' },
+	{ "help",      no_argument,       NULL, 'h' },
+	{ NULL,        0,                 NULL, 0   }
+};
+
+int main(int argc, char **argv)
+{
+	Options options;
+	memset(&options, 0, sizeof(options));
+	options.m_rate = 10000;
+	options.m_duration = 10.0;
+	options.m_threads = 1;
+	options.m_batch = 64;
+	options.m_pattern = PATTERN_CC;
+
+	int opt;
+	while ((opt = getopt_long(argc, argv, "r:d:j:b:p:c:h", OPTIONS, NULL)) != -1)
+	{
+		char *endPtr;
+		switch (opt)
+		{
+		case 'r':
+			options.m_rate = strtoull(optarg, &endPtr, 10);
+			if (endPtr == optarg || *endPtr != '\0' || options.m_rate < 1 || options.m_rate > 100000000)
+			{
+				fprintf(stderr, "Invalid rate '%s'!\n", optarg);
+				return EINVAL;
+			}
+			break;
+		case 'd':
+			options.m_duration = strtod(optarg, &endPtr);
+			if (endPtr == optarg || *endPtr != '\0' || options.m_duration < 0.0)
+			{
+				fprintf(stderr, "Invalid duration '%s'!\n", optarg);
+				return EINVAL;
+			}
+			break;
+		case 'j':
+			options.m_threads = strtoul(optarg, &endPtr, 10);
+			if (endPtr == optarg || *endPtr != '\0' || options.m_threads < 1 || options.m_threads > MAX_THREADS)
+			{
+				fprintf(stderr, "Invalid thread count '%s'!\n", optarg);
+				return EINVAL;
+			}
+			break;
+		case 'b':
+			options.m_batch = strtoul(optarg, &endPtr, 10);
+			if (endPtr == optarg || *endPtr != '\0' || options.m_batch < 1 || options.m_batch > MAX_BATCH)
+			{
+				fprintf(stderr, "Invalid batch size '%s'!\n", optarg);
+				return EINVAL;
+			}
+			break;
+		case 'p':
+			{
+				unsigned i;
+				for (i=0; i<PATTERN_COUNT; ++i)
+				{
+					if (strcmp(optarg, PATTERN_NAMES[i]) == 0)
+						break;
+				}
+				if (i == PATTERN_COUNT)
+				{
+					fprintf(stderr, "Unknown pattern '%s'!\n", optarg);
+					return EINVAL;
+				}
+				options.m_pattern = (Pattern)i;
+			}
+			break;
+		case 'c':
+			options.m_channel = strtoul(optarg, &endPtr, 10) - 1;
+			if (endPtr == optarg || *endPtr != '\0' || options.m_channel > 15)
+			{
+				fprintf(stderr, "Invalid channel '%s'!\n", optarg);
+				return EINVAL;
+			}
+			break;
+		case 'h':
+		default:
+			printUsage();
+			return 0;
+		}
+	}
+
+	if (argc - optind != 2)
+	{
+		printUsage();
+		return EINVAL;
+	}
+
+	if (parseAddress(options.m_addr, argv[optind], argv[optind + 1]) < 0)
+	{
+		fprintf(stderr, "Invalid address '%s:%s'!\n", argv[optind], argv[optind + 1]);
+		return EINVAL;
+	}
+
+	if (options.m_rate < options.m_threads)
+		options.m_threads = options.m_rate;
+
+	struct sigaction sa;
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = &onSignal;
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+
+	Sender *senders = (Sender*)calloc(options.m_threads, sizeof(Sender));
+	if (!senders)
+		return ENOMEM;
+
+	int result = 0;
+	unsigned started = 0;
+	for (unsigned i=0; i<options.m_threads; ++i)
+	{
+		Sender &sender = senders[i];
+		sender.m_options = &options;
+		sender.m_index = i;
+		sender.m_rate = options.m_rate / options.m_threads + (i < options.m_rate % options.m_threads ? 1 : 0);
+
+		// Connected, for sendmmsg to go without per message addresses.
+		sender.m_socket = socket(AF_INET, SOCK_DGRAM, 0);
+		if (sender.m_socket < 0 || connect(sender.m_socket, (const sockaddr*)&options.m_addr, sizeof(options.m_addr)) < 0)
+		{
+			fprintf(stderr, "Failed to set up a socket! (%d)\n", errno);
+			result = errno;
+			break;
+		}
+
+		int size = 4 * 1024 * 1024;
+		setsockopt(sender.m_socket, SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+
+		if (pthread_create(&sender.m_thread, NULL, &senderMain, &sender) != 0)
+		{
+			fprintf(stderr, "Failed to start a sender thread!\n");
+			result = EAGAIN;
+			break;
+		}
+		++started;
+	}
+
+	if (result != 0)
+		g_done = 1;
+
+	uint64_t start = nowNs();
+	uint64_t sent = 0, errors = 0, late = 0;
+	for (unsigned i=0; i<started; ++i)
+	{
+		pthread_join(senders[i].m_thread, NULL);
+		sent += senders[i].m_sent;
+		errors += senders[i].m_errors;
+		late += senders[i].m_late;
+	}
+	double seconds = (nowNs() - start) / 1e9;
+
+	for (unsigned i=0; i<options.m_threads; ++i)
+	{
+		if (senders[i].m_socket > 0)
+			close(senders[i].m_socket);
+	}
+	free(senders);
+
+	if (started)
+	{
+		printf("{\n");
+		printf("\t\"pattern\": \"%s\",\n", PATTERN_NAMES[options.m_pattern]);
+		printf("\t\"threads\": %u,\n", started);
+		printf("\t\"offered_rate\": %llu,\n", (unsigned long long)options.m_rate);
+		printf("\t\"seconds\": %.3f,\n", seconds);
+		printf("\t\"sent\": %llu,\n", (unsigned long long)sent);
+		printf("\t\"achieved_rate\": %.1f,\n", seconds > 0.0 ? sent / seconds : 0.0);
+		printf("\t\"send_errors\": %llu,\n", (unsigned long long)errors);
+		printf("\t\"late_batches\": %llu\n", (unsigned long long)late);
+		printf("}\n");
+	}
+
+	return result;
+}
@@ -0,0 +1,896 @@
+/*
+ * osc2midi - a bridge between OSC and (ALSA) MIDI.
+ * Copyright (C) 2018  Vilniaus Blokas UAB, https://blokas.io/
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2 of the
+ * License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <getopt.h>
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <arpa/inet.h>
+
+#include "hex32.h"
+#include "latency_histogram.h"
+
+// End to end benchmark of a bridge whose ALSA port is looped back, either the
+// loopback build (make SEQ_BACKEND=loopback) or an ALSA build connected to
+// itself through snd-seq-dummy. Acting as the bridge's host, events are sent
+// at fixed offered rates and matched with their echoes coming back, to measure
+// the delivered throughput, the loss and the round trip latency, reported as
+// JSON along with the bridge's own latency and drop counters.
+
+enum EventType
+{
+	EVENT_NOTE,
+	EVENT_CC,
+	EVENT_BEND,
+	EVENT_CLOCK,
+	EVENT_SYSEX,
+
+	EVENT_TYPE_COUNT
+};
+
+static const char *const EVENT_NAMES[EVENT_TYPE_COUNT] = {
+	"note",
+	"cc",
+	"bend",
+	"clock",
+	"sysex",
+};
+
+enum
+{
+	// The note, CC and bend events carry a sequence number in their data bytes,
+	// to match the echoes with the send times.
+	KEY_COUNT  = 16384,
+
+	MAX_RATES  = 32,
+	MAX_DROPS  = 32,
+	MAX_BURST  = 1024,
+};
+
+struct Options
+{
+	const char *m_bridge;
+	unsigned m_rates[MAX_RATES];
+	unsigned m_rateCount;
+	double m_duration;
+	double m_wait;
+	unsigned m_mix[EVENT_TYPE_COUNT];
+	const char *m_mixString;
+	const char *m_output;
+	unsigned m_signalMs;
+};
+
+struct DirectionLatency
+{
+	uint64_t m_count;
+	uint64_t m_p50;
+	uint64_t m_p99;
+	uint64_t m_p999;
+	uint64_t m_max;
+};
+
+struct Counter
+{
+	char m_name[48];
+	uint64_t m_value;
+};
+
+struct Step
+{
+	unsigned m_rate;
+	uint64_t m_sent[EVENT_TYPE_COUNT];
+	uint64_t m_received[EVENT_TYPE_COUNT];
+	uint64_t m_firstSend;
+	uint64_t m_lastReceive;
+	LatencyHistogram m_latency;
+	DirectionLatency m_bridge[2];
+	Counter m_drops[MAX_DROPS];
+	unsigned m_dropCount;
+};
+
+static int g_socket = -1;
+static sockaddr_in g_bridgeAddr;
+static uint64_t g_sendTimes[EVENT_TYPE_COUNT][KEY_COUNT];
+
+// Cumulative drop counters of the bridge, to report the increase of each step.
+static Counter g_drops[MAX_DROPS];
+static unsigned g_dropCount;
+
+static pid_t g_bridgePid;
+static int g_bridgeStatus = -1; // From waitpid once the bridge exited, -1 while it runs.
+static uint64_t g_nextCheck;
+static uint64_t g_signalInterval;
+static uint64_t g_nextSignal;
+static unsigned g_signalCount;
+
+static uint64_t nowNs()
+{
+	timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static size_t oscPad(size_t n)
+{
+	return (n + 4) & ~3;
+}
+
+static size_t writeOscMessage(char *buffer, const char *address, const char *tags, const char *s, int32_t i)
+{
+	size_t n = strlen(address);
+	memset(buffer, 0, 256);
+	memcpy(buffer, address, n);
+	char *p = buffer + oscPad(n);
+	n = strlen(tags);
+	memcpy(p, tags, n);
+	p += oscPad(n);
+	if (s)
+	{
+		n = strlen(s);
+		memcpy(p, s, n);
+		p += oscPad(n);
+	}
+	else if (tags[1] == 'i')
+	{
+		uint32_t v = htonl((uint32_t)i);
+		memcpy(p, &v, sizeof(v));
+		p += sizeof(v);
+	}
+	return p - buffer;
+}
+
+static void sendOsc(const char *address, const char *tags, const char *s, int32_t i)
+{
+	char buffer[256];
+	size_t n = writeOscMessage(buffer, address, tags, s, i);
+	sendto(g_socket, buffer, n, 0, (const sockaddr*)&g_bridgeAddr, sizeof(g_bridgeAddr));
+}
+
+static uint64_t readInt64(const char *p)
+{
+	uint32_t hi, lo;
+	memcpy(&hi, p, sizeof(hi));
+	memcpy(&lo, p + 4, sizeof(lo));
+	return ((uint64_t)ntohl(hi) << 32) | ntohl(lo);
+}
+
+// Calls handler for every message in the datagram, bundles included.
+typedef void (*MessageHandler)(const char *address, const char *tags, const char *args, const char *end, void *context);
+
+static void parseOsc(const char *p, const char *end, MessageHandler handler, void *context)
+{
+	if (end - p >= 16 && memcmp(p, "#bundle", 8) == 0)
+	{
+		p += 16;
+		while (end - p >= 4)
+		{
+			uint32_t size;
+			memcpy(&size, p, sizeof(size));
+			size = ntohl(size);
+			p += 4;
+			if (size > (size_t)(end - p))
+				return;
+			parseOsc(p, p + size, handler, context);
+			p += size;
+		}
+		return;
+	}
+
+	const char *address = p;
+	size_t n = strnlen(p, end - p);
+	if (n == (size_t)(end - p))
+		return;
+	p += oscPad(n);
+	if (p >= end || *p != ',')
+	{
+		handler(address, ",", p, end, context);
+		return;
+	}
+
+	const char *tags = p;
+	n = strnlen(p, end - p);
+	if (n == (size_t)(end - p))
+		return;
+	p += oscPad(n);
+	handler(address, tags, p, end, context);
+}
+
+static bool isEvent(const char *address, const char *tags)
+{
+	return strcmp(address, "/osc2midi/event") == 0 && strcmp(tags, ",s") == 0;
+}
+
+static void makeEvent(EventType type, unsigned seq, char hex[12], unsigned &key)
+{
+	uint32_t packed;
+	switch (type)
+	{
+	case EVENT_NOTE:
+		key = seq % (128 * 127);
+		packed = 0x09900000 | ((key % 128) << 8) | (1 + key / 128);
+		break;
+	case EVENT_CC:
+		// Controllers 120 and up are the channel mode messages.
+		key = seq % (120 * 128);
+		packed = 0x0bb00000 | ((key % 120) << 8) | (key / 120);
+		break;
+	case EVENT_BEND:
+		key = seq % KEY_COUNT;
+		packed = 0x0ee00000 | ((key & 0x7f) << 8) | (key >> 7);
+		break;
+	case EVENT_CLOCK:
+		key = 0;
+		packed = 0x0ff80000;
+		break;
+	case EVENT_SYSEX:
+	default:
+		key = 0;
+		packed = 0x07f07df7;
+		break;
+	}
+	encodeHex32(hex, packed);
+}
+
+// Returns false for events that aren't from the benchmark.
+static bool classifyEvent(uint32_t packed, EventType &type, unsigned &key)
+{
+	uint8_t status = (packed >> 16) & 0xff;
+	uint8_t d1 = (packed >> 8) & 0x7f;
+	uint8_t d2 = packed & 0x7f;
+
+	switch (status)
+	{
+	case 0x90:
+		type = EVENT_NOTE;
+		key = d1 + 128 * (d2 - 1);
+		return d2 != 0;
+	case 0xb0:
+		type = EVENT_CC;
+		key = d1 + 120 * d2;
+		return d1 < 120;
+	case 0xe0:
+		type = EVENT_BEND;
+		key = d1 | (d2 << 7);
+		return true;
+	case 0xf8:
+		type = EVENT_CLOCK;
+		key = 0;
+		return true;
+	case 0xf0:
+		type = EVENT_SYSEX;
+		key = 0;
+		return true;
+	default:
+		return false;
+	}
+}
+
+static void onEcho(const char *address, const char *tags, const char *args, const char *end, void *context)
+{
+	if (!isEvent(address, tags) || end - args < 8)
+		return;
+
+	char hex[9];
+	memcpy(hex, args, 8);
+	hex[8] = '\0';
+	uint32_t packed;
+	if (!decodeHex32(packed, hex))
+		return;
+
+	EventType type;
+	unsigned key;
+	if (!classifyEvent(packed, type, key))
+		return;
+
+	Step &step = *(Step*)context;
+	uint64_t now = nowNs();
+	++step.m_received[type];
+	step.m_lastReceive = now;
+
+	uint64_t &sent = g_sendTimes[type][key];
+	if (type <= EVENT_BEND && sent)
+	{
+		step.m_latency.record(now - sent);
+		sent = 0;
+	}
+}
+
+static void receive(MessageHandler handler, void *context)
+{
+	char buffer[2048];
+	for (;;)
+	{
+		ssize_t n = recv(g_socket, buffer, sizeof(buffer), MSG_DONTWAIT);
+		if (n <= 0)
+			return;
+		parseOsc(buffer, buffer + n, handler, context);
+	}
+}
+
+static uint64_t totalOf(const uint64_t counts[EVENT_TYPE_COUNT])
+{
+	uint64_t total = 0;
+	for (unsigned i=0; i<EVENT_TYPE_COUNT; ++i)
+		total += counts[i];
+	return total;
+}
+
+static EventType pickType(const Options &options, unsigned n)
+{
+	unsigned total = 0;
+	for (unsigned i=0; i<EVENT_TYPE_COUNT; ++i)
+		total += options.m_mix[i];
+
+	n %= total;
+	for (unsigned i=0; i<EVENT_TYPE_COUNT; ++i)
+	{
+		if (n < options.m_mix[i])
+			return (EventType)i;
+		n -= options.m_mix[i];
+	}
+	return EVENT_NOTE;
+}
+
+// Sends the bridge SIGHUP, SIGUSR1 and SIGUSR2 in turn when due, and notices it exiting,
+// checking every 10ms unless forced. Returns false once the bridge is gone.
+static bool tendBridge(bool force)
+{
+	if (g_bridgeStatus != -1)
+		return false;
+
+	uint64_t now = nowNs();
+	if (!force && now < g_nextCheck)
+		return true;
+	g_nextCheck = now + 10000000;
+
+	int status;
+	if (waitpid(g_bridgePid, &status, WNOHANG) == g_bridgePid)
+	{
+		g_bridgeStatus = status;
+		return false;
+	}
+
+	if (g_signalInterval && now >= g_nextSignal)
+	{
+		static const int SIGNALS[3] = { SIGHUP, SIGUSR1, SIGUSR2 };
+		kill(g_bridgePid, SIGNALS[g_signalCount++ % 3]);
+		g_nextSignal = now + g_signalInterval;
+	}
+	return true;
+}
+
+static void runStep(const Options &options, Step &step)
+{
+	memset(g_sendTimes, 0, sizeof(g_sendTimes));
+
+	uint64_t duration = (uint64_t)(options.m_duration * 1e9);
+	uint64_t total = (uint64_t)(options.m_duration * step.m_rate);
+	uint64_t start = nowNs();
+	step.m_firstSend = start;
+	step.m_lastReceive = start;
+
+	uint64_t sent = 0;
+	unsigned seq[EVENT_TYPE_COUNT] = { 0 };
+
+	while (sent < total && tendBridge(false))
+	{
+		uint64_t now = nowNs();
+		uint64_t due = (uint64_t)((unsigned __int128)(now - start) * step.m_rate / 1000000000);
+		if (due > total)
+			due = total;
+
+		// Catching up after a stall is bounded, the offered load stays fixed.
+		for (unsigned burst=0; sent < due && burst < MAX_BURST; ++burst, ++sent)
+		{
+			EventType type = pickType(options, sent);
+			char hex[12];
+			unsigned key;
+			makeEvent(type, seq[type]++, hex, key);
+			if (type <= EVENT_BEND)
+				g_sendTimes[type][key] = nowNs();
+			sendOsc("/osc2midi/event", ",s", hex, 0);
+			++step.m_sent[type];
+		}
+
+		receive(&onEcho, &step);
+
+		if (sent < due)
+			continue;
+
+		uint64_t next = start + (uint64_t)((unsigned __int128)(sent + 1) * 1000000000 / step.m_rate);
+		now = nowNs();
+		if (next > now && now - start < duration + 1000000000)
+		{
+			uint64_t wait = next - now;
+			timespec ts = { (time_t)(wait / 1000000000), (long)(wait % 1000000000) };
+			pollfd fd = { g_socket, POLLIN, 0 };
+			ppoll(&fd, 1, &ts, NULL);
+		}
+	}
+
+	// Collect the stragglers, until everything came back or nothing did for a while.
+	uint64_t idleSince = nowNs();
+	uint64_t received = totalOf(step.m_received);
+	while (received < sent && nowNs() - idleSince < 500000000 && tendBridge(false))
+	{
+		pollfd fd = { g_socket, POLLIN, 0 };
+		poll(&fd, 1, 50);
+		receive(&onEcho, &step);
+		uint64_t r = totalOf(step.m_received);
+		if (r != received)
+		{
+			received = r;
+			idleSince = nowNs();
+		}
+	}
+}
+
+static void onLatency(const char *address, const char *tags, const char *args, const char *end, void *context)
+{
+	static const char *const ADDRESSES[2] = { "/osc2midi/latency/in", "/osc2midi/latency/out" };
+
+	if (strcmp(tags, ",hhhhh") != 0 || end - args < 40)
+		return;
+
+	Step &step = *(Step*)context;
+	for (unsigned d=0; d<2; ++d)
+	{
+		if (strcmp(address, ADDRESSES[d]) != 0)
+			continue;
+
+		DirectionLatency &l = step.m_bridge[d];
+		l.m_count = readInt64(args);
+		l.m_p50 = readInt64(args + 8);
+		l.m_p99 = readInt64(args + 16);
+		l.m_p999 = readInt64(args + 24);
+		l.m_max = readInt64(args + 32);
+	}
+}
+
+static void onStats(const char *address, const char *tags, const char *args, const char *end, void *context)
+{
+	bool *done = (bool*)context;
+	if (strcmp(address, "/osc2midi/stats/end") == 0)
+	{
+		*done = true;
+		return;
+	}
+
+	// /osc2midi/stats/<in|out>/dropped/<reason>
+	const char *prefix = "/osc2midi/stats/";
+	if (strncmp(address, prefix, strlen(prefix)) != 0 || !strstr(address, "/dropped/") || strcmp(tags, ",h") != 0 || end - args < 8)
+		return;
+
+	const char *name = address + strlen(prefix);
+	unsigned i;
+	for (i=0; i<g_dropCount; ++i)
+	{
+		if (strcmp(g_drops[i].m_name, name) == 0)
+			break;
+	}
+	if (i == g_dropCount)
+	{
+		if (g_dropCount == MAX_DROPS)
+			return;
+		snprintf(g_drops[i].m_name, sizeof(g_drops[i].m_name), "%s", name);
+		++g_dropCount;
+	}
+	g_drops[i].m_value = readInt64(args);
+}
+
+// Waits for the replies to a query, until done is set or the timeout passes.
+static void awaitReplies(MessageHandler handler, void *context, bool *done, int timeoutMs)
+{
+	uint64_t deadline = nowNs() + (uint64_t)timeoutMs * 1000000;
+	while (nowNs() < deadline && !(done && *done))
+	{
+		pollfd fd = { g_socket, POLLIN, 0 };
+		poll(&fd, 1, 10);
+		receive(handler, context);
+	}
+}
+
+static void queryBridge(Step &step)
+{
+	// Getting the latency also resets it for the next step.
+	sendOsc("/osc2midi/latency", ",i", NULL, 1);
+	awaitReplies(&onLatency, &step, NULL, 200);
+
+	Counter previous[MAX_DROPS];
+	unsigned previousCount = g_dropCount;
+	memcpy(previous, g_drops, sizeof(previous));
+
+	bool done = false;
+	sendOsc("/osc2midi/stats", ",", NULL, 0);
+	awaitReplies(&onStats, &done, &done, 1000);
+
+	step.m_dropCount = 0;
+	for (unsigned i=0; i<g_dropCount; ++i)
+	{
+		uint64_t before = i < previousCount ? previous[i].m_value : 0;
+		if (g_drops[i].m_value == before)
+			continue;
+		step.m_drops[step.m_dropCount] = g_drops[i];
+		step.m_drops[step.m_dropCount++].m_value -= before;
+	}
+}
+
+static void printLatency(FILE *f, const DirectionLatency &l)
+{
+	fprintf(f, "{ \"count\": %llu, \"p50\": %llu, \"p99\": %llu, \"p999\": %llu, \"max\": %llu }",
+		(unsigned long long)l.m_count,
+		(unsigned long long)l.m_p50,
+		(unsigned long long)l.m_p99,
+		(unsigned long long)l.m_p999,
+		(unsigned long long)l.m_max
+		);
+}
+
+static void printStep(FILE *f, const Options &options, const Step &step, bool last)
+{
+	uint64_t sent = totalOf(step.m_sent);
+	uint64_t received = totalOf(step.m_received);
+	double seconds = (step.m_lastReceive - step.m_firstSend) / 1e9;
+
+	fprintf(f, "\t\t{\n");
+	fprintf(f, "\t\t\t\"offered_rate\": %u,\n", step.m_rate);
+	fprintf(f, "\t\t\t\"sent\": %llu,\n", (unsigned long long)sent);
+	fprintf(f, "\t\t\t\"received\": %llu,\n", (unsigned long long)received);
+	fprintf(f, "\t\t\t\"loss\": %.6f,\n", sent ? 1.0 - (double)received / sent : 0.0);
+	fprintf(f, "\t\t\t\"throughput\": %.1f,\n", seconds > 0.0 ? received / seconds : 0.0);
+
+	const LatencyHistogram &h = step.m_latency;
+	fprintf(f, "\t\t\t\"latency_ns\": { \"count\": %llu, \"p50\": %llu, \"p90\": %llu, \"p99\": %llu, \"p999\": %llu, \"max\": %llu },\n",
+		(unsigned long long)h.getCount(),
+		(unsigned long long)h.getPercentile(50.0),
+		(unsigned long long)h.getPercentile(90.0),
+		(unsigned long long)h.getPercentile(99.0),
+		(unsigned long long)h.getPercentile(99.9),
+		(unsigned long long)h.getMax()
+		);
+
+	fprintf(f, "\t\t\t\"types\": {");
+	bool first = true;
+	for (unsigned i=0; i<EVENT_TYPE_COUNT; ++i)
+	{
+		if (!options.m_mix[i])
+			continue;
+		fprintf(f, "%s \"%s\": { \"sent\": %llu, \"received\": %llu }", first ? "" : ",", EVENT_NAMES[i],
+			(unsigned long long)step.m_sent[i], (unsigned long long)step.m_received[i]);
+		first = false;
+	}
+	fprintf(f, " },\n");
+
+	fprintf(f, "\t\t\t\"bridge_latency_ns\": { \"in\": ");
+	printLatency(f, step.m_bridge[0]);
+	fprintf(f, ", \"out\": ");
+	printLatency(f, step.m_bridge[1]);
+	fprintf(f, " },\n");
+
+	fprintf(f, "\t\t\t\"drops\": {");
+	for (unsigned i=0; i<step.m_dropCount; ++i)
+		fprintf(f, "%s \"%s\": %llu", i ? "," : "", step.m_drops[i].m_name, (unsigned long long)step.m_drops[i].m_value);
+	fprintf(f, "%s}\n", step.m_dropCount ? " " : "");
+
+	fprintf(f, "\t\t}%s\n", last ? "" : ",");
+}
+
+static pid_t startBridge(const Options &options, char **extra, int extraCount, uint16_t port)
+{
+	char portString[8];
+	snprintf(portString, sizeof(portString), "%u", port);
+
+	// The echoes come back right away and carry the bridge's tag, or its own client as
+	// the source through snd-seq-dummy, -l 0 turns off all of the loop detection.
+	const char *argv[64];
+	int n = 0;
+	argv[n++] = options.m_bridge;
+	argv[n++] = "-l";
+	argv[n++] = "0";
+	for (int i=0; i<extraCount && n < 60; ++i)
+		argv[n++] = extra[i];
+	argv[n++] = "osc2midi-loopbench";
+	argv[n++] = "127.0.0.1";
+	argv[n++] = portString;
+	argv[n] = NULL;
+
+	pid_t pid = fork();
+	if (pid == 0)
+	{
+		execv(options.m_bridge, (char *const *)argv);
+		fprintf(stderr, "Failed to start '%s'! (%d)\n", options.m_bridge, errno);
+		_exit(127);
+	}
+	return pid;
+}
+
+static int parseRates(Options &options, const char *str)
+{
+	options.m_rateCount = 0;
+	while (*str)
+	{
+		char *endPtr;
+		unsigned long rate = strtoul(str, &endPtr, 10);
+		if (endPtr == str || rate < 1 || rate > 10000000 || options.m_rateCount == MAX_RATES)
+			return -EINVAL;
+		options.m_rates[options.m_rateCount++] = rate;
+		if (*endPtr == ',')
+			++endPtr;
+		else if (*endPtr != '\0')
+			return -EINVAL;
+		str = endPtr;
+	}
+	return options.m_rateCount ? 0 : -EINVAL;
+}
+
+static int parseMix(Options &options, const char *str)
+{
+	memset(options.m_mix, 0, sizeof(options.m_mix));
+
+	char buffer[128];
+	snprintf(buffer, sizeof(buffer), "%s", str);
+
+	unsigned total = 0;
+	char *save;
+	for (char *t = strtok_r(buffer, ",", &save); t; t = strtok_r(NULL, ",", &save))
+	{
+		char *eq = strchr(t, '=');
+		if (!eq)
+			return -EINVAL;
+		*eq = '\0';
+
+		unsigned i;
+		for (i=0; i<EVENT_TYPE_COUNT; ++i)
+		{
+			if (strcmp(t, EVENT_NAMES[i]) == 0)
+				break;
+		}
+		char *endPtr;
+		unsigned long weight = strtoul(eq + 1, &endPtr, 10);
+		if (i == EVENT_TYPE_COUNT || endPtr == eq + 1 || *endPtr != '\0' || weight > 1000)
+			return -EINVAL;
+
+		options.m_mix[i] = weight;
+		total += weight;
+	}
+
+	options.m_mixString = str;
+	return total ? 0 : -EINVAL;
+}
+
+static void printUsage()
+{
+	printf("Usage: osc2midi-loopbench [options] [-- bridge options]\n"
+		"Options:\n"
+		"\t-b, --bridge PATH    The osc2midi binary to run (default ./osc2midi).\n"
+		"\t-r, --rates LIST     Comma separated offered rates in events/s to step through\n"
+		"\t                     (default 1000,10000,100000).\n"
+		"\t-d, --duration SECONDS\n"
+		"\t                     Duration of each step (default 5).\n"
+		"\t-m, --mix MIX        Weights of the event types, such as the default\n"
+		"\t                     note=4,cc=4,bend=1,clock=1. sysex is available too.\n"
+		"\t-w, --wait SECONDS   Wait after the bridge starts, for connecting its port\n"
+		"\t                     through snd-seq-dummy (default 0).\n"
+		"\t-o, --output FILE    Write the JSON report to FILE instead of stdout.\n"
+		"\t-S, --signals MS     Send the bridge SIGHUP, SIGUSR1 and SIGUSR2 in turn every MS\n"
+		"\t                     milliseconds, SIGUSR2 needs -T in the bridge options.\n"
+		"\t-h, --help           Print this help and exit.\n"
+		"The bridge's port must loop its output back, use a loopback build\n"
+		"(make SEQ_BACKEND=loopback) or connect it to itself through snd-seq-dummy.\n"
+		"Fails if the bridge exits before the end, or with an error or a signal.\n"
+		"\n"
+		);
+}
+
+static const option OPTIONS[] = {
+	{ "bridge",    required_argument, NULL, 'b' },
+	{ "rates",     required_argument, NULL, 'r' },
+	{ "duration",  required_argument, NULL, 'd' },
+	{ "mix",       required_argument, NULL, 'm' },
+	{ "wait",      required_argument, NULL, 'w' },
+	{ "output",    required_argument, NULL, 'o' },
+	{ "signals",   required_argument, NULL, 'S' },
+	{ "help",      no_argument,       NULL, 'h' },
+	{ NULL,        0,                 NULL, 0   }
+};
+
+int main(int argc, char **argv)
+{
+	Options options;
+	memset(&options, 0, sizeof(options));
+	options.m_bridge = "./osc2midi";
+	options.m_duration = 5.0;
+	parseRates(options, "1000,10000,100000");
+	parseMix(options, "note=4,cc=4,bend=1,clock=1");
+
+	int opt;
+	while ((opt = getopt_long(argc, argv, "b:r:d:m:w:o:S:h", OPTIONS, NULL)) != -1)
+	{
+		switch (opt)
+		{
+		case 'b':
+			options.m_bridge = optarg;
+			break;
+		case 'r':
+			if (parseRates(options, optarg) < 0)
+			{
+				fprintf(stderr, "Invalid rates '%s'!\n", optarg);
+				return EINVAL;
+			}
+			break;
+		case 'd':
+		case 'w':
+			{
+				char *endPtr;
+				double seconds = strtod(optarg, &endPtr);
+				if (endPtr == optarg || *endPtr != '\0' || seconds < (opt == 'd' ? 0.1 : 0.0) || seconds > 3600.0)
+				{
+					fprintf(stderr, "Invalid duration '%s'!\n", optarg);
+					return EINVAL;
+				}
+				(opt == 'd' ? options.m_duration : options.m_wait) = seconds;
+			}
+			break;
+		case 'm':
+			if (parseMix(options, optarg) < 0)
+			{
+				fprintf(stderr, "Invalid mix '%s'!\n", optarg);
+				return EINVAL;
+			}
+			break;
+		case 'o':
+			options.m_output = optarg;
+			break;
+		case 'S':
+			{
+				char *endPtr;
+				options.m_signalMs = strtoul(optarg, &endPtr, 10);
+				if (endPtr == optarg || *endPtr != '\0' || options.m_signalMs < 1 || options.m_signalMs > 3600000)
+				{
+					fprintf(stderr, "Invalid signal interval '%s'!\n", optarg);
+					return EINVAL;
+				}
+			}
+			break;
+		case 'h':
+		default:
+			printUsage();
+			return 0;
+		}
+	}
+
+	g_socket = socket(AF_INET, SOCK_DGRAM, 0);
+	if (g_socket < 0)
+	{
+		fprintf(stderr, "Failed creating a UDP socket! (%d)\n", errno);
+		return errno;
+	}
+
+	int size = 8 * 1024 * 1024;
+	setsockopt(g_socket, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+	setsockopt(g_socket, SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+
+	sockaddr_in addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	socklen_t len = sizeof(addr);
+	if (bind(g_socket, (const sockaddr*)&addr, sizeof(addr)) < 0 || getsockname(g_socket, (sockaddr*)&addr, &len) < 0)
+	{
+		fprintf(stderr, "Failed binding the UDP socket! (%d)\n", errno);
+		return errno;
+	}
+
+	pid_t pid = startBridge(options, argv + optind, argc - optind, ntohs(addr.sin_port));
+	g_bridgePid = pid;
+	if (pid < 0)
+	{
+		fprintf(stderr, "Failed to fork! (%d)\n", errno);
+		return errno;
+	}
+
+	// The bridge says hello from its own port.
+	pollfd fd = { g_socket, POLLIN, 0 };
+	len = sizeof(g_bridgeAddr);
+	char buffer[256];
+	if (poll(&fd, 1, 5000) <= 0 || recvfrom(g_socket, buffer, sizeof(buffer), 0, (sockaddr*)&g_bridgeAddr, &len) <= 0)
+	{
+		fprintf(stderr, "The bridge didn't say hello!\n");
+		kill(pid, SIGTERM);
+		waitpid(pid, NULL, 0);
+		return ETIMEDOUT;
+	}
+
+	if (options.m_wait > 0.0)
+		usleep((useconds_t)(options.m_wait * 1e6));
+
+	g_signalInterval = (uint64_t)options.m_signalMs * 1000000;
+	g_nextSignal = nowNs() + g_signalInterval;
+
+	FILE *f = options.m_output ? fopen(options.m_output, "w") : stdout;
+	if (!f)
+	{
+		fprintf(stderr, "Failed to open '%s'! (%d)\n", options.m_output, errno);
+		f = stdout;
+	}
+
+	fprintf(f, "{\n\t\"bridge\": \"%s\",\n\t\"mix\": \"%s\",\n\t\"duration_s\": %.3f,\n\t\"steps\": [\n",
+		options.m_bridge, options.m_mixString, options.m_duration);
+
+	// Start the bridge counters from a clean slate.
+	Step warmup = Step();
+	queryBridge(warmup);
+
+	for (unsigned i=0; i<options.m_rateCount; ++i)
+	{
+		Step step = Step();
+		step.m_rate = options.m_rates[i];
+
+		runStep(options, step);
+		bool running = tendBridge(true);
+		if (running)
+			queryBridge(step);
+		printStep(f, options, step, i + 1 == options.m_rateCount || !running);
+		fflush(f);
+
+		if (!running)
+			break;
+	}
+
+	fprintf(f, "\t]\n}\n");
+	if (f != stdout)
+		fclose(f);
+
+	if (g_bridgeStatus != -1)
+	{
+		if (WIFSIGNALED(g_bridgeStatus))
+			fprintf(stderr, "The bridge was killed by signal %d!\n", WTERMSIG(g_bridgeStatus));
+		else
+			fprintf(stderr, "The bridge exited early! (%d)\n", WEXITSTATUS(g_bridgeStatus));
+		return ECHILD;
+	}
+
+	sendOsc("/osc2midi/bye", ",", NULL, 0);
+	for (int i=0; i<100; ++i)
+	{
+		int status;
+		if (waitpid(pid, &status, WNOHANG) == pid)
+		{
+			if (WIFSIGNALED(status) || WEXITSTATUS(status) != 0)
+			{
+				fprintf(stderr, "The bridge failed on exit! (%d)\n", WIFSIGNALED(status) ? WTERMSIG(status) : WEXITSTATUS(status));
+				return ECHILD;
+			}
+			return 0;
+		}
+		usleep(20000);
+	}
+	kill(pid, SIGTERM);
+	waitpid(pid, NULL, 0);
+
+	return 0;
+}
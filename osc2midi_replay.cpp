@@ -0,0 +1,400 @@
+/*
+ * osc2midi - a bridge between OSC and (ALSA) MIDI.
+ * Copyright (C) 2018  Vilniaus Blokas UAB, https://blokas.io/
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2 of the
+ * License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <getopt.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <alsa/asoundlib.h>
+
+#include "capture.h"
+
+// Sends the datagrams a bridge received in a capture to a bridge again, at their
+// original pace, scaled or as fast as possible. Every peer of the capture gets a
+// socket of its own, so the bridge sees the same sessions. With --alsa, the events
+// the bridge read from its ALSA port are written to that port again too, from a
+// client of our own. The records of what the bridge sent are for the comparison
+// with --print.
+
+enum { MAX_PEERS = 64 };
+
+static const char *const KIND_NAMES[CAPTURE_KIND_COUNT] = {
+	"udp-in",
+	"udp-out",
+	"seq-in",
+	"seq-out",
+};
+
+struct ReplayPeer
+{
+	uint32_t m_addr;
+	uint16_t m_port;
+	int m_socket;
+};
+
+static ReplayPeer g_peers[MAX_PEERS];
+static unsigned g_peerCount;
+
+static snd_seq_t *g_seq;
+static int g_seqPort;
+static snd_midi_event_t *g_encoder;
+
+static volatile sig_atomic_t g_done;
+
+static void onSignal(int)
+{
+	g_done = 1;
+}
+
+static uint64_t nowNs()
+{
+	timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// Returns the socket for the captured peer, creating it when first seen. Past
+// MAX_PEERS, the last socket is shared.
+static int getPeerSocket(uint32_t addr, uint16_t port)
+{
+	for (unsigned i=0; i<g_peerCount; ++i)
+	{
+		if (g_peers[i].m_addr == addr && g_peers[i].m_port == port)
+			return g_peers[i].m_socket;
+	}
+
+	if (g_peerCount == MAX_PEERS)
+		return g_peers[MAX_PEERS - 1].m_socket;
+
+	int s = socket(AF_INET, SOCK_DGRAM, 0);
+	if (s < 0)
+		return -errno;
+
+	ReplayPeer &peer = g_peers[g_peerCount++];
+	peer.m_addr = addr;
+	peer.m_port = port;
+	peer.m_socket = s;
+	return s;
+}
+
+// Opens a client with a port connected to the bridge's port at address, such as 128:0.
+static int seqOpen(const char *address)
+{
+	int result = snd_seq_open(&g_seq, "default", SND_SEQ_OPEN_OUTPUT, 0);
+	if (result < 0)
+	{
+		fprintf(stderr, "Failed to open the ALSA sequencer! (%d)\n", -result);
+		g_seq = NULL;
+		return result;
+	}
+
+	snd_seq_set_client_name(g_seq, "osc2midi-replay");
+
+	snd_seq_addr_t dest;
+	result = snd_seq_parse_address(g_seq, &dest, address);
+	if (result < 0)
+	{
+		fprintf(stderr, "Invalid ALSA address '%s'! (%d)\n", address, -result);
+		return result;
+	}
+
+	g_seqPort = snd_seq_create_simple_port(g_seq, "replay", SND_SEQ_PORT_CAP_READ | SND_SEQ_PORT_CAP_SUBS_READ,
+		SND_SEQ_PORT_TYPE_MIDI_GENERIC | SND_SEQ_PORT_TYPE_APPLICATION);
+	if (g_seqPort < 0)
+	{
+		fprintf(stderr, "Failed to create the ALSA port! (%d)\n", -g_seqPort);
+		return g_seqPort;
+	}
+
+	result = snd_seq_connect_to(g_seq, g_seqPort, dest.client, dest.port);
+	if (result < 0)
+	{
+		fprintf(stderr, "Failed to connect to '%s'! (%d)\n", address, -result);
+		return result;
+	}
+
+	// Large enough for the longest SysEx the bridge captures in one event.
+	return snd_midi_event_new(256, &g_encoder);
+}
+
+static void seqClose()
+{
+	if (g_encoder)
+		snd_midi_event_free(g_encoder);
+	if (g_seq)
+		snd_seq_close(g_seq);
+	g_encoder = NULL;
+	g_seq = NULL;
+}
+
+// Writes the MIDI bytes of a captured event as a single ALSA event.
+static int seqSend(const uint8_t *data, size_t length)
+{
+	snd_seq_event_t ev;
+	snd_seq_ev_clear(&ev);
+	snd_midi_event_reset_encode(g_encoder);
+	if (snd_midi_event_encode(g_encoder, data, length, &ev) < 0 || ev.type == SND_SEQ_EVENT_NONE)
+		return -EINVAL;
+
+	snd_seq_ev_set_source(&ev, g_seqPort);
+	snd_seq_ev_set_subs(&ev);
+	snd_seq_ev_set_direct(&ev);
+	return snd_seq_event_output_direct(g_seq, &ev);
+}
+
+static void printRecord(const CaptureHeader &header, const CaptureRecord &r, const uint8_t *data)
+{
+	uint64_t t = r.m_time - header.m_monotonicTime;
+	printf("%llu.%09llu %-7s ", (unsigned long long)(t / 1000000000), (unsigned long long)(t % 1000000000),
+		r.m_kind < CAPTURE_KIND_COUNT ? KIND_NAMES[r.m_kind] : "?");
+
+	if (r.m_kind == CAPTURE_UDP_IN || r.m_kind == CAPTURE_UDP_OUT)
+	{
+		in_addr a;
+		a.s_addr = r.m_addr;
+		printf("%s:%u %u", inet_ntoa(a), ntohs(r.m_port), r.m_length);
+
+		// The address, or #bundle, and for /osc2midi/event its argument.
+		size_t n = strnlen((const char*)data, r.m_length);
+		printf(" %.*s", (int)n, (const char*)data);
+		if (n == 15 && memcmp(data, "/osc2midi/event", 15) == 0 && r.m_length >= 32)
+			printf(" %.8s", (const char*)data + 20);
+	}
+	else
+	{
+		uint32_t a = ntohl(r.m_addr);
+		printf("%u:%u", a >> 8, a & 0xff);
+		for (unsigned i=0; i<r.m_length; ++i)
+			printf(" %02x", data[i]);
+	}
+	printf("\n");
+}
+
+static int parseAddress(sockaddr_in &addr, const char *host, const char *port)
+{
+	char *endPtr;
+	unsigned long p = strtoul(port, &endPtr, 10);
+	if (endPtr == port || *endPtr != '\0' || p < 1 || p > 65535)
+		return -EINVAL;
+
+	addrinfo hints;
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_INET;
+	hints.ai_socktype = SOCK_DGRAM;
+
+	addrinfo *result;
+	if (getaddrinfo(host, NULL, &hints, &result) != 0)
+		return -ENOENT;
+
+	memcpy(&addr, result->ai_addr, sizeof(addr));
+	addr.sin_port = htons(p);
+	freeaddrinfo(result);
+	return 0;
+}
+
+static void printUsage()
+{
+	printf("Usage: osc2midi-replay [options] <capture> <host> <port>\n"
+		"       osc2midi-replay --print <capture>\n"
+		"Options:\n"
+		"\t-s, --speed FACTOR   Replay FACTOR times as fast as captured, 0 sends as fast as\n"
+		"\t                     possible (default 1).\n"
+		"\t-n, --repeat N       Replay the capture N times (default 1).\n"
+		"\t-a, --alsa CLIENT:PORT\n"
+		"\t                     Also replay the events the bridge read from ALSA, writing\n"
+		"\t                     them to the bridge's port at CLIENT:PORT. Otherwise only\n"
+		"\t                     the datagrams it received are replayed.\n"
+		"\t-p, --print          Print the records of the capture as text and exit.\n"
+		"\t-h, --help           Print this help and exit.\n"
+		"\n"
+		);
+}
+
+static const option OPTIONS[] = {
+	{ "speed",     required_argument, NULL, 's' },
+	{ "repeat",    required_argument, NULL, 'n' },
+	{ "alsa",      required_argument, NULL, 'a' },
+	{ "print",     no_argument,       NULL, 'p' },
+	{ "help",      no_argument,       NULL, 'h' },
+	{ NULL,        0,                 NULL, 0   }
+};
+
+int main(int argc, char **argv)
+{
+	double speed = 1.0;
+	unsigned long repeat = 1;
+	bool print = false;
+	const char *alsa = NULL;
+
+	int opt;
+	while ((opt = getopt_long(argc, argv, "s:n:a:ph", OPTIONS, NULL)) != -1)
+	{
+		char *endPtr;
+		switch (opt)
+		{
+		case 's':
+			speed = strtod(optarg, &endPtr);
+			if (endPtr == optarg || *endPtr != '\0' || speed < 0.0)
+			{
+				fprintf(stderr, "Invalid speed '%s'!\n", optarg);
+				return EINVAL;
+			}
+			break;
+		case 'n':
+			repeat = strtoul(optarg, &endPtr, 10);
+			if (endPtr == optarg || *endPtr != '\0' || repeat < 1)
+			{
+				fprintf(stderr, "Invalid repeat count '%s'!\n", optarg);
+				return EINVAL;
+			}
+			break;
+		case 'a':
+			alsa = optarg;
+			break;
+		case 'p':
+			print = true;
+			break;
+		case 'h':
+		default:
+			printUsage();
+			return 0;
+		}
+	}
+
+	if (argc - optind != (print ? 1 : 3))
+	{
+		printUsage();
+		return EINVAL;
+	}
+
+	CaptureReader reader;
+	int result = reader.open(argv[optind]);
+	if (result < 0)
+	{
+		fprintf(stderr, "Failed to open the capture '%s'! (%d)\n", argv[optind], -result);
+		return -result;
+	}
+
+	const CaptureHeader &header = reader.getHeader();
+	CaptureRecord r;
+	const uint8_t *data;
+
+	if (print)
+	{
+		while (reader.next(r, data))
+			printRecord(header, r, data);
+		return 0;
+	}
+
+	sockaddr_in addr;
+	if (parseAddress(addr, argv[optind + 1], argv[optind + 2]) < 0)
+	{
+		fprintf(stderr, "Invalid address '%s:%s'!\n", argv[optind + 1], argv[optind + 2]);
+		return EINVAL;
+	}
+
+	if (alsa && seqOpen(alsa) < 0)
+	{
+		seqClose();
+		return EIO;
+	}
+
+	struct sigaction sa;
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = &onSignal;
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+
+	uint64_t sent = 0, events = 0, errors = 0, maxLateNs = 0;
+	uint64_t start = nowNs();
+
+	for (unsigned long i=0; i<repeat && !g_done; ++i)
+	{
+		reader.rewind();
+
+		uint64_t first = 0;
+		uint64_t pass = nowNs();
+		while (!g_done && reader.next(r, data))
+		{
+			if (r.m_kind != CAPTURE_UDP_IN && (r.m_kind != CAPTURE_SEQ_IN || !g_seq))
+				continue;
+
+			if (!first)
+				first = r.m_time;
+
+			if (speed > 0.0)
+			{
+				uint64_t due = pass + (uint64_t)((r.m_time - first) / speed);
+				uint64_t now = nowNs();
+				if (due > now)
+				{
+					timespec ts = { (time_t)(due / 1000000000), (long)(due % 1000000000) };
+					clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+				}
+				else if (now - due > maxLateNs)
+				{
+					maxLateNs = now - due;
+				}
+			}
+
+			if (r.m_kind == CAPTURE_SEQ_IN)
+			{
+				if (seqSend(data, r.m_length) < 0)
+					++errors;
+				else
+					++events;
+				continue;
+			}
+
+			int s = getPeerSocket(r.m_addr, r.m_port);
+			if (s < 0 || sendto(s, data, r.m_length, 0, (const sockaddr*)&addr, sizeof(addr)) < 0)
+				++errors;
+			else
+				++sent;
+		}
+	}
+
+	seqClose();
+
+	double seconds = (nowNs() - start) / 1e9;
+
+	for (unsigned i=0; i<g_peerCount; ++i)
+		close(g_peers[i].m_socket);
+
+	printf("{\n");
+	printf("\t\"speed\": %g,\n", speed);
+	printf("\t\"peers\": %u,\n", g_peerCount);
+	printf("\t\"seconds\": %.3f,\n", seconds);
+	printf("\t\"sent\": %llu,\n", (unsigned long long)sent);
+	printf("\t\"rate\": %.1f,\n", seconds > 0.0 ? sent / seconds : 0.0);
+	printf("\t\"alsa_events\": %llu,\n", (unsigned long long)events);
+	printf("\t\"send_errors\": %llu,\n", (unsigned long long)errors);
+	printf("\t\"max_late_ns\": %llu\n", (unsigned long long)maxLateNs);
+	printf("}\n");
+
+	return 0;
+}
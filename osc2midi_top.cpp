@@ -0,0 +1,279 @@
+/*
+ * osc2midi - a bridge between OSC and (ALSA) MIDI.
+ * Copyright (C) 2018  Vilniaus Blokas UAB, https://blokas.io/
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2 of the
+ * License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <getopt.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "metrics.h"
+#include "overload_shedder.h"
+
+#define HOMEPAGE_URL "https://blokas.io/"
+
+static volatile sig_atomic_t g_done;
+
+static void onSignal(int)
+{
+	g_done = 1;
+}
+
+static double rate(uint64_t now, uint64_t then, double seconds)
+{
+	return seconds > 0.0 ? (now - then) / seconds : 0.0;
+}
+
+static uint64_t sum(const uint64_t *values, unsigned count)
+{
+	uint64_t total = 0;
+	for (unsigned i=0; i<count; ++i)
+		total += values[i];
+	return total;
+}
+
+static const MetricsPeer *findPeer(const MetricsData &data, const char *address)
+{
+	for (unsigned i=0; i<data.m_peerCount && i<METRICS_MAX_PEERS; ++i)
+	{
+		if (strcmp(data.m_peers[i].m_address, address) == 0)
+			return &data.m_peers[i];
+	}
+	return NULL;
+}
+
+static void print(const MetricsData &cur, const MetricsData &prev, uint32_t pid, bool batch)
+{
+	double seconds = (cur.m_timestamp - prev.m_timestamp) / 1000.0;
+	uint64_t uptime = (cur.m_timestamp - cur.m_startTime) / 1000;
+	const DirectionStats &in = cur.m_stats.m_dir[MIDI_DIR_IN];
+	const DirectionStats &out = cur.m_stats.m_dir[MIDI_DIR_OUT];
+	const DirectionStats &prevIn = prev.m_stats.m_dir[MIDI_DIR_IN];
+	const DirectionStats &prevOut = prev.m_stats.m_dir[MIDI_DIR_OUT];
+
+	if (!batch)
+		printf("\033[H\033[2J");
+
+	unsigned level = cur.m_shedLevel < OverloadShedder::SHED_LEVEL_COUNT ? cur.m_shedLevel : 0;
+	printf("osc2midi pid %u, up %llu:%02llu:%02llu, shedding: %s, queue %u (max %u)\n\n",
+		pid,
+		(unsigned long long)(uptime / 3600),
+		(unsigned long long)(uptime / 60 % 60),
+		(unsigned long long)(uptime % 60),
+		OverloadShedder::getLevelName((OverloadShedder::Level)level),
+		cur.m_stats.m_input.m_queueDepth,
+		cur.m_stats.m_input.m_maxQueueDepth
+		);
+
+	printf("%-18s %12s %12s %14s %14s\n", "", "in/s", "out/s", "in", "out");
+	for (unsigned i=0; i<STAT_TYPE_COUNT; ++i)
+	{
+		printf("%-18s %12.1f %12.1f %14llu %14llu\n",
+			stat_get_type_name((StatType)i),
+			rate(in.m_events[i], prevIn.m_events[i], seconds),
+			rate(out.m_events[i], prevOut.m_events[i], seconds),
+			(unsigned long long)in.m_events[i],
+			(unsigned long long)out.m_events[i]
+			);
+	}
+	for (unsigned i=0; i<DROP_REASON_COUNT; ++i)
+	{
+		char name[32];
+		snprintf(name, sizeof(name), "dropped %s", stat_get_drop_name((StatDrop)i));
+		printf("%-18s %12.1f %12.1f %14llu %14llu\n",
+			name,
+			rate(in.m_dropped[i], prevIn.m_dropped[i], seconds),
+			rate(out.m_dropped[i], prevOut.m_dropped[i], seconds),
+			(unsigned long long)in.m_dropped[i],
+			(unsigned long long)out.m_dropped[i]
+			);
+	}
+	printf("%-18s %12.1f %12.1f %14llu %14llu\n",
+		"sysex bytes",
+		rate(in.m_sysexBytes, prevIn.m_sysexBytes, seconds),
+		rate(out.m_sysexBytes, prevOut.m_sysexBytes, seconds),
+		(unsigned long long)in.m_sysexBytes,
+		(unsigned long long)out.m_sysexBytes
+		);
+	printf("%-18s %12.1f %12.1f %14llu %14llu\n",
+		"total events",
+		rate(sum(in.m_events, STAT_TYPE_COUNT), sum(prevIn.m_events, STAT_TYPE_COUNT), seconds),
+		rate(sum(out.m_events, STAT_TYPE_COUNT), sum(prevOut.m_events, STAT_TYPE_COUNT), seconds),
+		(unsigned long long)sum(in.m_events, STAT_TYPE_COUNT),
+		(unsigned long long)sum(out.m_events, STAT_TYPE_COUNT)
+		);
+
+	printf("\n%-22s %10s %10s %10s %10s %12s\n", "peer", "packets/s", "events/s", "dropped/s", "errors/s", "packets");
+	for (unsigned i=0; i<cur.m_peerCount && i<METRICS_MAX_PEERS; ++i)
+	{
+		const MetricsPeer &p = cur.m_peers[i];
+		const MetricsPeer *before = findPeer(prev, p.m_address);
+		PeerStats zero;
+		memset(&zero, 0, sizeof(zero));
+		const PeerStats &q = before ? before->m_stats : zero;
+
+		printf("%-22s %10.1f %10.1f %10.1f %10.1f %12llu\n",
+			p.m_address,
+			rate(p.m_stats.m_packets, q.m_packets, seconds),
+			rate(p.m_stats.m_events, q.m_events, seconds),
+			rate(p.m_stats.m_dropped, q.m_dropped, seconds),
+			rate(p.m_stats.m_parseErrors, q.m_parseErrors, seconds),
+			(unsigned long long)p.m_stats.m_packets
+			);
+	}
+
+	printf("\npackets: %.1f/s, %llu total, parse errors: %.1f/s, %llu total\n",
+		rate(cur.m_stats.m_input.m_packets, prev.m_stats.m_input.m_packets, seconds),
+		(unsigned long long)cur.m_stats.m_input.m_packets,
+		rate(cur.m_stats.m_input.m_parseErrors, prev.m_stats.m_input.m_parseErrors, seconds),
+		(unsigned long long)cur.m_stats.m_input.m_parseErrors
+		);
+
+	if (batch)
+		printf("\n");
+	fflush(stdout);
+}
+
+static void printUsage()
+{
+	printf("Usage: osc2midi-top [options] [FILE]\n"
+		"Shows the live event rates of osc2midi, read from the metrics FILE it publishes\n"
+		"with --metrics, " METRICS_DEFAULT_PATH " by default.\n"
+		"Options:\n"
+		"\t-i, --interval SECONDS Refresh interval (default 1).\n"
+		"\t-b, --batch            Don't clear the screen between refreshes.\n"
+		"\t-n, --count N          Exit after N refreshes.\n"
+		"\t-h, --help             Print this help and exit.\n"
+		"\n"
+		"Copyright (C) Blokas Labs " HOMEPAGE_URL "\n"
+		);
+}
+
+static const option OPTIONS[] = {
+	{ "interval", required_argument, NULL, 'i' },
+	{ "batch",    no_argument,       NULL, 'b' },
+	{ "count",    required_argument, NULL, 'n' },
+	{ "help",     no_argument,       NULL, 'h' },
+	{ NULL,       0,                 NULL, 0   }
+};
+
+int main(int argc, char **argv)
+{
+	double interval = 1.0;
+	bool batch = false;
+	long count = -1;
+
+	int opt;
+	while ((opt = getopt_long(argc, argv, "i:bn:h", OPTIONS, NULL)) != -1)
+	{
+		switch (opt)
+		{
+		case 'i':
+			{
+				char *endPtr;
+				interval = strtod(optarg, &endPtr);
+				if (endPtr == optarg || *endPtr != '\0' || interval < 0.01 || interval > 3600.0)
+				{
+					fprintf(stderr, "Invalid interval '%s'!\n", optarg);
+					return EINVAL;
+				}
+			}
+			break;
+		case 'b':
+			batch = true;
+			break;
+		case 'n':
+			{
+				char *endPtr;
+				count = strtol(optarg, &endPtr, 10);
+				if (endPtr == optarg || *endPtr != '\0' || count < 1)
+				{
+					fprintf(stderr, "Invalid count '%s'!\n", optarg);
+					return EINVAL;
+				}
+			}
+			break;
+		case 'h':
+		default:
+			printUsage();
+			return 0;
+		}
+	}
+
+	if (argc - optind > 1)
+	{
+		printUsage();
+		return EINVAL;
+	}
+
+	const char *path = argc - optind == 1 ? argv[optind] : METRICS_DEFAULT_PATH;
+
+	MetricsReader reader;
+	int result = reader.open(path);
+	if (result < 0)
+	{
+		fprintf(stderr, "Failed to open '%s'! (%d)\n", path, -result);
+		return -result;
+	}
+
+	struct sigaction sa;
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = &onSignal;
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+
+	static MetricsData prev, cur;
+	if (!reader.read(prev))
+	{
+		fprintf(stderr, "Failed to read '%s'!\n", path);
+		return EAGAIN;
+	}
+
+	timespec ts;
+	ts.tv_sec = (time_t)interval;
+	ts.tv_nsec = (long)((interval - ts.tv_sec) * 1000000000.0);
+
+	while (!g_done && count != 0)
+	{
+		nanosleep(&ts, NULL);
+		if (g_done)
+			break;
+
+		if (kill(reader.getPid(), 0) < 0 && errno == ESRCH)
+		{
+			fprintf(stderr, "osc2midi (pid %u) is no longer running.\n", reader.getPid());
+			return ESRCH;
+		}
+
+		if (!reader.read(cur))
+			continue;
+
+		print(cur, prev, reader.getPid(), batch);
+		prev = cur;
+
+		if (count > 0)
+			--count;
+	}
+
+	return 0;
+}
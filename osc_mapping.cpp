@@ -0,0 +1,326 @@
+/*
+ * osc2midi - a bridge between OSC and (ALSA) MIDI.
+ * Copyright (C) 2018  Vilniaus Blokas UAB, https://blokas.io/
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2 of the
+ * License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include "osc_mapping.h"
+#include "osc_message.h"
+#include "config_reader.h"
+
+#include <math.h>
+#include <string.h>
+#include <errno.h>
+
+OscMapping::OscMapping()
+{
+	clear();
+}
+
+void OscMapping::clear()
+{
+	for (unsigned i=0; i<HASH_SIZE; ++i)
+	{
+		m_slots[i].m_hash = 0;
+		m_slots[i].m_address = 0;
+		m_slots[i].m_target = NO_TARGET;
+	}
+	m_targetCount = 0;
+	m_stringsUsed = 0;
+}
+
+bool OscMapping::isEmpty() const
+{
+	return m_targetCount == 0;
+}
+
+// FNV-1a.
+uint32_t OscMapping::hash(const char *str)
+{
+	uint32_t h = 2166136261u;
+	while (*str)
+	{
+		h ^= (uint8_t)*str++;
+		h *= 16777619u;
+	}
+	return h;
+}
+
+const OscMapping::Slot *OscMapping::find(const char *address, uint32_t h) const
+{
+	for (unsigned i=h & (HASH_SIZE-1); ; i = (i+1) & (HASH_SIZE-1))
+	{
+		const Slot &slot = m_slots[i];
+		if (slot.m_target == NO_TARGET)
+			return &slot;
+		if (slot.m_hash == h && strcmp(m_strings + slot.m_address, address) == 0)
+			return &slot;
+	}
+}
+
+int OscMapping::add(const char *address, const Target &target)
+{
+	if (m_targetCount >= MAX_MAPPINGS)
+		return -ENOSPC;
+
+	uint32_t h = hash(address);
+	Slot &slot = const_cast<Slot&>(*find(address, h));
+
+	uint16_t index = m_targetCount;
+	m_targets[index] = target;
+	m_targets[index].m_next = NO_TARGET;
+
+	if (slot.m_target == NO_TARGET)
+	{
+		size_t n = strlen(address) + 1;
+		if (m_stringsUsed + n > STRINGS_SIZE)
+			return -ENOSPC;
+
+		memcpy(m_strings + m_stringsUsed, address, n);
+		slot.m_hash = h;
+		slot.m_address = m_stringsUsed;
+		slot.m_target = index;
+		m_stringsUsed += n;
+	}
+	else
+	{
+		uint16_t i = slot.m_target;
+		while (m_targets[i].m_next != NO_TARGET)
+			i = m_targets[i].m_next;
+		m_targets[i].m_next = index;
+	}
+
+	++m_targetCount;
+	return 0;
+}
+
+struct MappingMessage
+{
+	const char *m_name;
+	uint8_t m_status;
+	bool m_hasNumber;
+	bool m_optionalNumber;
+};
+
+static const MappingMessage MAPPING_MESSAGES[] = {
+	{ "note",      0x90, true,  false },
+	{ "cc",        0xb0, true,  false },
+	{ "program",   0xc0, true,  true  },
+	{ "pressure",  0xd0, false, false },
+	{ "pitchbend", 0xe0, false, false },
+	{ "start",     0xfa, false, false },
+	{ "continue",  0xfb, false, false },
+	{ "stop",      0xfc, false, false },
+};
+
+int OscMapping::load(const char *fileName)
+{
+	clear();
+
+	ConfigReader reader;
+	int result = reader.open(fileName);
+	if (result < 0)
+		return result;
+
+	char *tokens[ConfigReader::MAX_TOKENS];
+	int n;
+	while ((n = reader.readLine(tokens)) > 0)
+	{
+		if (tokens[0][0] != '/' || n < 2)
+		{
+			reader.error("Expected '<address> <message>'!");
+			result = -EINVAL;
+			goto error;
+		}
+
+		const MappingMessage *message = NULL;
+		for (unsigned i=0; i<sizeof(MAPPING_MESSAGES)/sizeof(MAPPING_MESSAGES[0]); ++i)
+		{
+			if (strcmp(tokens[1], MAPPING_MESSAGES[i].m_name) == 0)
+			{
+				message = &MAPPING_MESSAGES[i];
+				break;
+			}
+		}
+
+		if (!message)
+		{
+			reader.error("Unknown message '%s'!", tokens[1]);
+			result = -EINVAL;
+			goto error;
+		}
+
+		Target target;
+		memset(&target, 0, sizeof(target));
+		target.m_status = message->m_status;
+		target.m_number = -1;
+
+		int i = 2;
+		if (message->m_hasNumber)
+		{
+			int number;
+			if (i < n && ConfigReader::parseInt(tokens[i], 0, 127, number))
+			{
+				target.m_number = number;
+				++i;
+			}
+			else if (!message->m_optionalNumber)
+			{
+				reader.error("'%s' needs a number 0 - 127!", message->m_name);
+				result = -EINVAL;
+				goto error;
+			}
+		}
+
+		int channel = 1, arg = 0;
+		float min = 0.0f, max = 1.0f;
+		for (; i<n; ++i)
+		{
+			char *key, *value;
+			if (ConfigReader::splitKeyValue(tokens[i], key, value))
+			{
+				if (strcmp(key, "channel") == 0 && ConfigReader::parseInt(value, 1, 16, channel))
+					continue;
+				if (strcmp(key, "arg") == 0 && ConfigReader::parseInt(value, 0, 7, arg))
+					continue;
+				if (strcmp(key, "min") == 0 && ConfigReader::parseFloat(value, min))
+					continue;
+				if (strcmp(key, "max") == 0 && ConfigReader::parseFloat(value, max))
+					continue;
+			}
+
+			reader.error("Invalid argument '%s'!", tokens[i]);
+			result = -EINVAL;
+			goto error;
+		}
+
+		if (min == max)
+		{
+			reader.error("min and max must differ!");
+			result = -EINVAL;
+			goto error;
+		}
+
+		if (message->m_status < 0xf0)
+			target.m_status |= channel - 1;
+		target.m_arg = arg;
+		target.m_min = min;
+		target.m_scale = 1.0f / (max - min);
+
+		result = add(tokens[0], target);
+		if (result < 0)
+		{
+			reader.error("Too many mappings!");
+			goto error;
+		}
+	}
+
+	return 0;
+
+error:
+	clear();
+	return result;
+}
+
+unsigned OscMapping::getAddresses(const char **out, unsigned max) const
+{
+	unsigned n = 0;
+	for (unsigned i=0; i<HASH_SIZE; ++i)
+	{
+		if (m_slots[i].m_target == NO_TARGET)
+			continue;
+		if (n < max)
+			out[n] = m_strings + m_slots[i].m_address;
+		++n;
+	}
+	return n;
+}
+
+unsigned OscMapping::map(const char *address, const OscMessage &msg, midi_event_t out[MAX_EVENTS]) const
+{
+	if (m_targetCount == 0)
+		return 0;
+
+	const Slot *slot = find(address, hash(address));
+
+	unsigned count = 0;
+	for (uint16_t i = slot->m_target; i != NO_TARGET && count < MAX_EVENTS; i = m_targets[i].m_next)
+	{
+		const Target &t = m_targets[i];
+
+		float v;
+		if (msg.getArgCount() == 0)
+			v = 1.0f;
+		else if (msg.getFloat(t.m_arg, v))
+			v = (v - t.m_min) * t.m_scale;
+		else
+			continue;
+
+		v = v < 0.0f ? 0.0f : v > 1.0f ? 1.0f : v;
+		int value = (int)lrintf(v * 127.0f);
+
+		midi_event_t &ev = out[count];
+		ev.m_event = t.m_status >> 4;
+		ev.m_data[0] = t.m_status;
+		ev.m_data[1] = 0;
+		ev.m_data[2] = 0;
+
+		switch (t.m_status & 0xf0)
+		{
+		case 0x90:
+			if (value == 0)
+			{
+				ev.m_event = 0x08;
+				ev.m_data[0] = 0x80 | (t.m_status & 0x0f);
+			}
+			ev.m_data[1] = t.m_number;
+			ev.m_data[2] = value;
+			break;
+		case 0xb0:
+			ev.m_data[1] = t.m_number;
+			ev.m_data[2] = value;
+			break;
+		case 0xc0:
+			if (t.m_number >= 0)
+			{
+				if (value == 0)
+					continue;
+				value = t.m_number;
+			}
+			ev.m_data[1] = value;
+			break;
+		case 0xd0:
+			ev.m_data[1] = value;
+			break;
+		case 0xe0:
+			{
+				int bend = (int)lrintf(v * 16383.0f);
+				ev.m_data[1] = bend & 0x7f;
+				ev.m_data[2] = bend >> 7;
+			}
+			break;
+		case 0xf0:
+			if (value == 0)
+				continue;
+			ev.m_event = 0x0f;
+			break;
+		}
+
+		++count;
+	}
+
+	return count;
+}
@@ -0,0 +1,116 @@
+/*
+ * osc2midi - a bridge between OSC and (ALSA) MIDI.
+ * Copyright (C) 2018  Vilniaus Blokas UAB, https://blokas.io/
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2 of the
+ * License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef OSC_MAPPING_H
+#define OSC_MAPPING_H
+
+#include <stdint.h>
+
+#include "midi_serialization.h"
+
+class OscMessage;
+
+// Maps arbitrary OSC addresses to MIDI events, for example the controls of a
+// TouchOSC layout. The literal addresses are kept in an open addressing hash
+// table, so dispatch time doesn't depend on the number of mappings.
+//
+// Mapping file format, one mapping per line, an address may be listed multiple
+// times to produce several events:
+//
+// <address> <message> [channel=N] [arg=N] [min=X] [max=X]
+//
+// Messages:
+//
+// note <note>       - Note On with the scaled velocity, Note Off when it's 0.
+// cc <controller>   - Control Change with the scaled value.
+// program [program] - Program Change, fixed one is sent when the value is non 0.
+// pressure          - Channel Pressure.
+// pitchbend         - Pitch Bend, min maps to -8192, max to 8191.
+// start, continue, stop - Sent when the value is non 0.
+//
+// arg is the index of the argument to use (default 0), its value is scaled from
+// [min; max] (default 0.0 - 1.0) to the range of the message. A message without
+// arguments has value of max.
+//
+// Example:
+//
+// /1/fader3 cc 7 channel=2
+// /1/push1 note 60
+// /1/xy1 cc 10 arg=0
+// /1/xy1 cc 11 arg=1
+class OscMapping
+{
+public:
+	enum { MAX_EVENTS = 8 };
+
+	OscMapping();
+
+	void clear();
+
+	// Returns 0 on success, negative error code otherwise.
+	int load(const char *fileName);
+
+	bool isEmpty() const;
+
+	// Returns the number of events written to out, 0 if the address is not mapped.
+	// The address may differ from the message's one, when it was matched by a pattern.
+	unsigned map(const char *address, const OscMessage &msg, midi_event_t out[MAX_EVENTS]) const;
+
+	// Returns the number of mapped addresses, writing up to max of them to out.
+	unsigned getAddresses(const char **out, unsigned max) const;
+
+private:
+	enum
+	{
+		MAX_MAPPINGS = 1024,
+		HASH_SIZE    = 2048, // Power of 2, at least twice MAX_MAPPINGS.
+		STRINGS_SIZE = 32768,
+		NO_TARGET    = 0xffff,
+	};
+
+	struct Target
+	{
+		uint8_t m_status;  // Channel included.
+		int16_t m_number;  // Note, controller or program, -1 if from the value.
+		uint8_t m_arg;
+		float m_min;
+		float m_scale;     // 1 / (max - min).
+		uint16_t m_next;   // Next target for the same address.
+	};
+
+	struct Slot
+	{
+		uint32_t m_hash;
+		uint16_t m_address; // Offset in m_strings.
+		uint16_t m_target;  // NO_TARGET if the slot is empty.
+	};
+
+	static uint32_t hash(const char *str);
+
+	const Slot *find(const char *address, uint32_t h) const;
+	int add(const char *address, const Target &target);
+
+	Target m_targets[MAX_MAPPINGS];
+	Slot m_slots[HASH_SIZE];
+	char m_strings[STRINGS_SIZE];
+	unsigned m_targetCount;
+	unsigned m_stringsUsed;
+};
+
+#endif // OSC_MAPPING_H
@@ -0,0 +1,199 @@
+/*
+ * osc2midi - a bridge between OSC and (ALSA) MIDI.
+ * Copyright (C) 2018  Vilniaus Blokas UAB, https://blokas.io/
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2 of the
+ * License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include "osc_message.h"
+
+#include <string.h>
+#include <arpa/inet.h>
+
+static const char NO_TYPES[] = "";
+
+static inline uint32_t read_u32(const char *p)
+{
+	uint32_t v;
+	memcpy(&v, p, sizeof(v));
+	return ntohl(v);
+}
+
+static inline uint64_t read_u64(const char *p)
+{
+	return ((uint64_t)read_u32(p) << 32) | read_u32(p + 4);
+}
+
+// Returns the size of the padded OSC string at p, 0 if it's not terminated before end.
+static size_t padded_string_size(const char *p, const char *end)
+{
+	const char *z = (const char*)memchr(p, '\0', end - p);
+	if (!z)
+		return 0;
+
+	size_t n = z - p + 1;
+	return (n + 3) & ~3;
+}
+
+OscMessage::OscMessage()
+	:m_address(NULL)
+	,m_types(NO_TYPES)
+	,m_argCount(0)
+{
+}
+
+bool OscMessage::parse(const char *buffer, size_t len)
+{
+	const char *end = buffer + len;
+
+	m_address = NULL;
+	m_types = NO_TYPES;
+	m_argCount = 0;
+
+	if (len < 4 || buffer[0] != '/' || (len & 0x3))
+		return false;
+
+	size_t n = padded_string_size(buffer, end);
+	if (n == 0 || n > len)
+		return false;
+
+	m_address = buffer;
+	const char *p = buffer + n;
+
+	// Type tags are optional in the older implementations.
+	if (p == end || *p != ',')
+		return true;
+
+	n = padded_string_size(p, end);
+	if (n == 0 || p + n > end)
+		return false;
+
+	m_types = p + 1;
+	p += n;
+
+	for (const char *t = m_types; *t && m_argCount < MAX_ARGS; ++t)
+	{
+		size_t size;
+		switch (*t)
+		{
+		case 'i':
+		case 'f':
+		case 'c':
+		case 'r':
+		case 'm':
+			size = 4;
+			break;
+		case 'h':
+		case 't':
+		case 'd':
+			size = 8;
+			break;
+		case 's':
+		case 'S':
+			size = padded_string_size(p, end);
+			if (size == 0)
+				return false;
+			break;
+		case 'b':
+			if (end - p < 4)
+				return false;
+			size = 4 + ((read_u32(p) + 3) & ~3u);
+			break;
+		case 'T':
+		case 'F':
+		case 'N':
+		case 'I':
+			size = 0;
+			break;
+		default:
+			return false;
+		}
+
+		if ((size_t)(end - p) < size)
+			return false;
+
+		m_args[m_argCount++] = p;
+		p += size;
+	}
+
+	return true;
+}
+
+bool OscMessage::getFloat(int index, float &value) const
+{
+	if (index < 0 || index >= m_argCount)
+		return false;
+
+	const char *p = m_args[index];
+	switch (m_types[index])
+	{
+	case 'i':
+		value = (float)(int32_t)read_u32(p);
+		return true;
+	case 'f':
+		{
+			uint32_t v = read_u32(p);
+			memcpy(&value, &v, sizeof(value));
+		}
+		return true;
+	case 'h':
+		value = (float)(int64_t)read_u64(p);
+		return true;
+	case 'd':
+		{
+			uint64_t v = read_u64(p);
+			double d;
+			memcpy(&d, &v, sizeof(d));
+			value = (float)d;
+		}
+		return true;
+	case 'T':
+		value = 1.0f;
+		return true;
+	case 'F':
+	case 'N':
+		value = 0.0f;
+		return true;
+	default:
+		return false;
+	}
+}
+
+bool OscMessage::getInt(int index, int32_t &value) const
+{
+	if (index < 0 || index >= m_argCount)
+		return false;
+
+	if (m_types[index] == 'i')
+	{
+		value = (int32_t)read_u32(m_args[index]);
+		return true;
+	}
+
+	float f;
+	if (!getFloat(index, f))
+		return false;
+
+	value = (int32_t)f;
+	return true;
+}
+
+const char *OscMessage::getString(int index) const
+{
+	if (index < 0 || index >= m_argCount || (m_types[index] != 's' && m_types[index] != 'S'))
+		return NULL;
+
+	return m_args[index];
+}
@@ -0,0 +1,60 @@
+/*
+ * osc2midi - a bridge between OSC and (ALSA) MIDI.
+ * Copyright (C) 2018  Vilniaus Blokas UAB, https://blokas.io/
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2 of the
+ * License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef OSC_MESSAGE_H
+#define OSC_MESSAGE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// A view of an OSC message within a received packet, nothing is copied.
+class OscMessage
+{
+public:
+	enum { MAX_ARGS = 8 };
+
+	OscMessage();
+
+	// Returns false if the packet is not a well formed OSC message. Arguments beyond
+	// MAX_ARGS are ignored.
+	bool parse(const char *buffer, size_t len);
+
+	const char *getAddress() const { return m_address; }
+
+	// Type tags without the leading ','.
+	const char *getTypes() const { return m_types; }
+
+	int getArgCount() const { return m_argCount; }
+
+	char getType(int index) const { return m_types[index]; }
+
+	// Converts i, f, d, h, T, F and N arguments.
+	bool getFloat(int index, float &value) const;
+	bool getInt(int index, int32_t &value) const;
+
+	const char *getString(int index) const;
+
+private:
+	const char *m_address;
+	const char *m_types;
+	const char *m_args[MAX_ARGS];
+	int m_argCount;
+};
+
+#endif // OSC_MESSAGE_H
@@ -0,0 +1,354 @@
+/*
+ * osc2midi - a bridge between OSC and (ALSA) MIDI.
+ * Copyright (C) 2018  Vilniaus Blokas UAB, https://blokas.io/
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2 of the
+ * License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include "osc_pattern.h"
+
+#include <string.h>
+
+OscPattern::OscPattern()
+	:m_opCount(0)
+	,m_classCount(0)
+	,m_altCount(0)
+{
+	m_text[0] = '\0';
+}
+
+bool OscPattern::isPattern(const char *address)
+{
+	return strpbrk(address, "*?[]{}") != NULL;
+}
+
+bool OscPattern::compile(const char *pattern)
+{
+	m_opCount = 0;
+	m_classCount = 0;
+	m_altCount = 0;
+
+	size_t len = strlen(pattern);
+	if (len >= MAX_LENGTH)
+		return false;
+
+	memcpy(m_text, pattern, len + 1);
+
+	for (unsigned i=0; i<len; )
+	{
+		if (m_opCount >= MAX_OPS)
+			return false;
+
+		Op &op = m_ops[m_opCount++];
+		char c = m_text[i];
+
+		switch (c)
+		{
+		case '?':
+			op.m_type = OP_ANY;
+			++i;
+			break;
+		case '*':
+			op.m_type = OP_STAR;
+			while (m_text[i] == '*')
+				++i;
+			break;
+		case '[':
+			{
+				if (m_classCount >= MAX_CLASSES)
+					return false;
+
+				uint32_t *bits = m_classes[m_classCount];
+				memset(bits, 0, sizeof(m_classes[0]));
+				op.m_type = OP_CLASS;
+				op.m_offset = m_classCount++;
+
+				bool negate = m_text[++i] == '!';
+				if (negate)
+					++i;
+
+				unsigned start = i;
+				while (i < len && m_text[i] != ']')
+				{
+					uint8_t lo = m_text[i], hi = lo;
+					if (m_text[i+1] == '-' && i+2 < len && m_text[i+2] != ']')
+					{
+						hi = m_text[i+2];
+						i += 2;
+					}
+					for (unsigned ch=lo; ch<=hi; ++ch)
+						bits[ch >> 5] |= 1u << (ch & 31);
+					++i;
+				}
+
+				if (i >= len || i == start)
+					return false;
+				++i;
+
+				if (negate)
+				{
+					for (unsigned k=0; k<8; ++k)
+						bits[k] = ~bits[k];
+				}
+
+				// Never match the separator or the terminator.
+				bits['/' >> 5] &= ~(1u << ('/' & 31));
+				bits[0] &= ~1u;
+			}
+			break;
+		case '{':
+			{
+				op.m_type = OP_ALT;
+				op.m_offset = m_altCount;
+				op.m_length = 0;
+				++i;
+
+				for (;;)
+				{
+					if (m_altCount >= MAX_ALTS)
+						return false;
+
+					unsigned start = i;
+					while (i < len && m_text[i] != ',' && m_text[i] != '}')
+						++i;
+
+					if (i >= len)
+						return false;
+
+					m_alts[m_altCount].m_offset = start;
+					m_alts[m_altCount].m_length = i - start;
+					++m_altCount;
+					++op.m_length;
+
+					if (m_text[i++] == '}')
+						break;
+				}
+			}
+			break;
+		case ']':
+		case '}':
+			return false;
+		default:
+			op.m_type = OP_LITERAL;
+			op.m_offset = i;
+			while (i < len && !strchr("*?[]{}", m_text[i]))
+				++i;
+			op.m_length = i - op.m_offset;
+			break;
+		}
+	}
+
+	return true;
+}
+
+bool OscPattern::matchFrom(unsigned op, const char *s) const
+{
+	for (; op < m_opCount; ++op)
+	{
+		const Op &o = m_ops[op];
+		switch (o.m_type)
+		{
+		case OP_LITERAL:
+			if (strncmp(s, m_text + o.m_offset, o.m_length) != 0)
+				return false;
+			s += o.m_length;
+			break;
+		case OP_ANY:
+			if (*s == '\0' || *s == '/')
+				return false;
+			++s;
+			break;
+		case OP_CLASS:
+			{
+				uint8_t c = *s;
+				if ((m_classes[o.m_offset][c >> 5] & (1u << (c & 31))) == 0)
+					return false;
+				++s;
+			}
+			break;
+		case OP_ALT:
+			for (unsigned i=0; i<o.m_length; ++i)
+			{
+				const Alt &alt = m_alts[o.m_offset + i];
+				if (strncmp(s, m_text + alt.m_offset, alt.m_length) == 0 && matchFrom(op + 1, s + alt.m_length))
+					return true;
+			}
+			return false;
+		case OP_STAR:
+			for (;; ++s)
+			{
+				if (matchFrom(op + 1, s))
+					return true;
+				if (*s == '\0' || *s == '/')
+					return false;
+			}
+		}
+	}
+
+	return *s == '\0';
+}
+
+bool OscPattern::match(const char *address) const
+{
+	return matchFrom(0, address);
+}
+
+void OscAddressSet::clear()
+{
+	memset(m_bits, 0, sizeof(m_bits));
+}
+
+void OscAddressSet::add(unsigned index)
+{
+	if (index < MAX_ADDRESSES)
+		m_bits[index >> 6] |= 1ull << (index & 63);
+}
+
+int OscAddressSet::next(unsigned from) const
+{
+	for (unsigned w = from >> 6; w < MAX_ADDRESSES / 64; ++w)
+	{
+		uint64_t bits = m_bits[w];
+		if (w == from >> 6)
+			bits &= ~0ull << (from & 63);
+		if (bits)
+			return (w << 6) | __builtin_ctzll(bits);
+	}
+	return -1;
+}
+
+// FNV-1a.
+static uint32_t hash_string(const char *str)
+{
+	uint32_t h = 2166136261u;
+	while (*str)
+	{
+		h ^= (uint8_t)*str++;
+		h *= 16777619u;
+	}
+	return h;
+}
+
+OscPatternCache::OscPatternCache()
+	:m_addresses(NULL)
+	,m_addressCount(0)
+{
+	setAddresses(NULL, 0);
+}
+
+void OscPatternCache::setAddresses(const char *const *addresses, unsigned count)
+{
+	m_addresses = addresses;
+	m_addressCount = count < (unsigned)OscAddressSet::MAX_ADDRESSES ? count : (unsigned)OscAddressSet::MAX_ADDRESSES;
+
+	memset(m_buckets, NONE, sizeof(m_buckets));
+	m_head = m_tail = NONE;
+	m_used = 0;
+}
+
+void OscPatternCache::unlink(uint8_t i)
+{
+	Entry &e = m_entries[i];
+	if (e.m_prev != NONE)
+		m_entries[e.m_prev].m_next = e.m_next;
+	else
+		m_head = e.m_next;
+	if (e.m_next != NONE)
+		m_entries[e.m_next].m_prev = e.m_prev;
+	else
+		m_tail = e.m_prev;
+}
+
+void OscPatternCache::pushFront(uint8_t i)
+{
+	Entry &e = m_entries[i];
+	e.m_prev = NONE;
+	e.m_next = m_head;
+	if (m_head != NONE)
+		m_entries[m_head].m_prev = i;
+	m_head = i;
+	if (m_tail == NONE)
+		m_tail = i;
+}
+
+void OscPatternCache::removeFromBucket(uint8_t i)
+{
+	uint8_t *p = &m_buckets[m_entries[i].m_hash & (HASH_BUCKETS-1)];
+	while (*p != NONE)
+	{
+		if (*p == i)
+		{
+			*p = m_entries[i].m_hashNext;
+			return;
+		}
+		p = &m_entries[*p].m_hashNext;
+	}
+}
+
+const OscAddressSet *OscPatternCache::resolve(const char *pattern)
+{
+	if (strlen(pattern) >= OscPattern::MAX_LENGTH)
+		return NULL;
+
+	uint32_t h = hash_string(pattern);
+	uint8_t &bucket = m_buckets[h & (HASH_BUCKETS-1)];
+
+	for (uint8_t i = bucket; i != NONE; i = m_entries[i].m_hashNext)
+	{
+		Entry &e = m_entries[i];
+		if (e.m_hash == h && strcmp(e.m_key, pattern) == 0)
+		{
+			if (m_head != i)
+			{
+				unlink(i);
+				pushFront(i);
+			}
+			return e.m_valid ? &e.m_matches : NULL;
+		}
+	}
+
+	uint8_t i;
+	if (m_used < CACHE_SIZE)
+	{
+		i = m_used++;
+	}
+	else
+	{
+		i = m_tail;
+		unlink(i);
+		removeFromBucket(i);
+	}
+
+	Entry &e = m_entries[i];
+	e.m_hash = h;
+	strcpy(e.m_key, pattern);
+	e.m_valid = e.m_pattern.compile(pattern);
+	e.m_matches.clear();
+
+	if (e.m_valid)
+	{
+		for (unsigned k=0; k<m_addressCount; ++k)
+		{
+			if (e.m_pattern.match(m_addresses[k]))
+				e.m_matches.add(k);
+		}
+	}
+
+	e.m_hashNext = bucket;
+	bucket = i;
+	pushFront(i);
+
+	return e.m_valid ? &e.m_matches : NULL;
+}
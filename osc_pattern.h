@@ -0,0 +1,144 @@
+/*
+ * osc2midi - a bridge between OSC and (ALSA) MIDI.
+ * Copyright (C) 2018  Vilniaus Blokas UAB, https://blokas.io/
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2 of the
+ * License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef OSC_PATTERN_H
+#define OSC_PATTERN_H
+
+#include <stdint.h>
+
+// OSC 1.0 address pattern: '?', '*', "[a-z]", "[!abc]" and "{foo,bar}". Like in
+// most of the implementations, '?' and '*' don't match '/', so each part of the
+// address is matched separately.
+class OscPattern
+{
+public:
+	enum { MAX_LENGTH = 128 };
+
+	OscPattern();
+
+	// Returns false if the pattern is malformed or too complex.
+	bool compile(const char *pattern);
+
+	bool match(const char *address) const;
+
+	static bool isPattern(const char *address);
+
+private:
+	enum OpType
+	{
+		OP_LITERAL,
+		OP_ANY,
+		OP_STAR,
+		OP_CLASS,
+		OP_ALT,
+	};
+
+	struct Op
+	{
+		uint8_t m_type;
+		uint8_t m_offset; // OP_LITERAL - into m_text, OP_CLASS - class index, OP_ALT - first alternative.
+		uint8_t m_length; // OP_LITERAL - length, OP_ALT - number of alternatives.
+	};
+
+	struct Alt
+	{
+		uint8_t m_offset;
+		uint8_t m_length;
+	};
+
+	enum
+	{
+		MAX_OPS     = 64,
+		MAX_CLASSES = 8,
+		MAX_ALTS    = 32,
+	};
+
+	bool matchFrom(unsigned op, const char *s) const;
+
+	char m_text[MAX_LENGTH];
+	Op m_ops[MAX_OPS];
+	uint32_t m_classes[MAX_CLASSES][8];
+	Alt m_alts[MAX_ALTS];
+	uint8_t m_opCount;
+	uint8_t m_classCount;
+	uint8_t m_altCount;
+};
+
+// Set of indices into the address space given to OscPatternCache.
+class OscAddressSet
+{
+public:
+	enum { MAX_ADDRESSES = 1088 };
+
+	void clear();
+	void add(unsigned index);
+
+	// Returns the first index >= from in the set, -1 if there's none.
+	int next(unsigned from) const;
+
+private:
+	uint64_t m_bits[MAX_ADDRESSES / 64];
+};
+
+// Compiled patterns along with the addresses they resolve to, kept in an LRU
+// keyed by the pattern string. A repeated pattern costs a single hash lookup.
+class OscPatternCache
+{
+public:
+	OscPatternCache();
+
+	// The strings must stay valid until the next call, resets the cache.
+	void setAddresses(const char *const *addresses, unsigned count);
+
+	// Returns NULL if the pattern is invalid.
+	const OscAddressSet *resolve(const char *pattern);
+
+private:
+	enum
+	{
+		CACHE_SIZE   = 64,
+		HASH_BUCKETS = 128,
+		NONE         = 0xff,
+	};
+
+	struct Entry
+	{
+		uint32_t m_hash;
+		bool m_valid;
+		uint8_t m_prev, m_next; // LRU order.
+		uint8_t m_hashNext;
+		OscPattern m_pattern;
+		OscAddressSet m_matches;
+		char m_key[OscPattern::MAX_LENGTH];
+	};
+
+	void unlink(uint8_t i);
+	void pushFront(uint8_t i);
+	void removeFromBucket(uint8_t i);
+
+	const char *const *m_addresses;
+	unsigned m_addressCount;
+
+	Entry m_entries[CACHE_SIZE];
+	uint8_t m_buckets[HASH_BUCKETS];
+	uint8_t m_head, m_tail;
+	uint8_t m_used;
+};
+
+#endif // OSC_PATTERN_H
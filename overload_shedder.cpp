@@ -0,0 +1,112 @@
+/*
+ * osc2midi - a bridge between OSC and (ALSA) MIDI.
+ * Copyright (C) 2018  Vilniaus Blokas UAB, https://blokas.io/
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2 of the
+ * License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include "overload_shedder.h"
+
+#include <string.h>
+
+// Minimum time between raising the level, to let the previous step take effect.
+static const unsigned RAISE_INTERVAL_MS = 100;
+
+// Time the load has to stay low before lowering the level.
+static const unsigned LOWER_INTERVAL_MS = 2000;
+
+static const char *const LEVEL_NAMES[OverloadShedder::SHED_LEVEL_COUNT] = {
+	"none",
+	"active sensing",
+	"redundant cc",
+	"aftertouch",
+};
+
+OverloadShedder::OverloadShedder()
+	:m_budget(0)
+	,m_watermark(0)
+	,m_average(0)
+	,m_level(SHED_NONE)
+	,m_lastChange(0)
+{
+	memset(m_shed, 0, sizeof(m_shed));
+}
+
+void OverloadShedder::setBudget(unsigned us)
+{
+	m_budget = us;
+	if (us == 0)
+		m_level = SHED_NONE;
+}
+
+void OverloadShedder::setWatermark(unsigned events)
+{
+	m_watermark = events;
+}
+
+bool OverloadShedder::sample(unsigned busyUs, unsigned queued, uint64_t now)
+{
+	if (m_budget == 0)
+		return false;
+
+	// Exponential moving average over ~8 iterations.
+	m_average += busyUs - (m_average >> 3);
+	unsigned average = m_average >> 3;
+
+	bool over = average > m_budget || (m_watermark && queued > m_watermark);
+	bool under = average < m_budget / 2 && (m_watermark == 0 || queued <= m_watermark / 2);
+
+	if (over)
+	{
+		if (m_level + 1 < SHED_LEVEL_COUNT && now - m_lastChange >= RAISE_INTERVAL_MS)
+		{
+			m_level = (Level)(m_level + 1);
+			m_lastChange = now;
+			return true;
+		}
+		return false;
+	}
+
+	if (!under)
+	{
+		// Not low enough yet, restart the countdown to lowering the level.
+		m_lastChange = now;
+		return false;
+	}
+
+	if (m_level != SHED_NONE && now - m_lastChange >= LOWER_INTERVAL_MS)
+	{
+		m_level = (Level)(m_level - 1);
+		m_lastChange = now;
+		return true;
+	}
+
+	return false;
+}
+
+OverloadShedder::Level OverloadShedder::getLevel() const
+{
+	return m_level;
+}
+
+uint64_t OverloadShedder::getShed(Level level) const
+{
+	return m_shed[level];
+}
+
+const char *OverloadShedder::getLevelName(Level level)
+{
+	return LEVEL_NAMES[level];
+}
@@ -0,0 +1,107 @@
+/*
+ * osc2midi - a bridge between OSC and (ALSA) MIDI.
+ * Copyright (C) 2018  Vilniaus Blokas UAB, https://blokas.io/
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2 of the
+ * License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef OVERLOAD_SHEDDER_H
+#define OVERLOAD_SHEDDER_H
+
+#include <stdint.h>
+
+// Sheds low priority traffic in both directions when the event loop can't keep
+// up. The load is measured, not configured: the time spent handling each loop
+// iteration is averaged and compared to the budget, along with the count of
+// events waiting in the ALSA input queue. While overloaded, the shedding level
+// rises step by step, first dropping Active Sensing, then Control Changes that
+// don't change the value, then polyphonic and channel pressure. Notes, real-time
+// and the rest of the messages are always kept. The level falls back once the
+// load stays under half of the limits for a while.
+class OverloadShedder
+{
+public:
+	enum Level
+	{
+		SHED_NONE,
+		SHED_SENSING,
+		SHED_REDUNDANT_CC,
+		SHED_AFTERTOUCH,
+
+		SHED_LEVEL_COUNT
+	};
+
+	OverloadShedder();
+
+	// Budget of a loop iteration in microseconds, 0 disables the shedding.
+	void setBudget(unsigned us);
+
+	// Count of events queued in the ALSA input considered as overload.
+	void setWatermark(unsigned events);
+
+	// Feeds the measurements of a loop iteration, returns true if the level changed.
+	bool sample(unsigned busyUs, unsigned queued, uint64_t now);
+
+	Level getLevel() const;
+
+	// Returns true if the raw MIDI message should be dropped at the current level,
+	// redundant tells whether it's a Control Change not changing the value.
+	inline bool shed(const uint8_t msg[3], bool redundant);
+
+	// Returns true if redundancy matters for the message at the current level.
+	inline bool checksRedundancy(const uint8_t msg[3]) const;
+
+	// Count of messages dropped at each level.
+	uint64_t getShed(Level level) const;
+
+	static const char *getLevelName(Level level);
+
+private:
+	unsigned m_budget;
+	unsigned m_watermark;
+	unsigned m_average; // Microseconds, in 1/8.
+	Level m_level;
+	uint64_t m_lastChange;
+	uint64_t m_shed[SHED_LEVEL_COUNT];
+};
+
+inline bool OverloadShedder::checksRedundancy(const uint8_t msg[3]) const
+{
+	return m_level >= SHED_REDUNDANT_CC && (msg[0] & 0xf0) == 0xb0;
+}
+
+inline bool OverloadShedder::shed(const uint8_t msg[3], bool redundant)
+{
+	if (m_level == SHED_NONE)
+		return false;
+
+	Level level;
+	if (msg[0] == 0xfe)
+		level = SHED_SENSING;
+	else if ((msg[0] & 0xf0) == 0xb0 && redundant)
+		level = SHED_REDUNDANT_CC;
+	else if ((msg[0] & 0xf0) == 0xa0 || (msg[0] & 0xf0) == 0xd0)
+		level = SHED_AFTERTOUCH;
+	else
+		return false;
+
+	if (level > m_level)
+		return false;
+
+	++m_shed[level];
+	return true;
+}
+
+#endif // OVERLOAD_SHEDDER_H
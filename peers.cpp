@@ -0,0 +1,155 @@
+/*
+ * osc2midi - a bridge between OSC and (ALSA) MIDI.
+ * Copyright (C) 2018  Vilniaus Blokas UAB, https://blokas.io/
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2 of the
+ * License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include "peers.h"
+
+#include <string.h>
+
+ActiveNotes::ActiveNotes()
+{
+	clear();
+}
+
+void ActiveNotes::clear()
+{
+	memset(m_bits, 0, sizeof(m_bits));
+	m_count = 0;
+}
+
+void ActiveNotes::update(const uint8_t msg[3])
+{
+	unsigned index = ((msg[0] & 0x0f) << 7) | (msg[1] & 0x7f);
+	uint64_t &word = m_bits[index >> 6];
+	uint64_t bit = 1ull << (index & 63);
+
+	switch (msg[0] & 0xf0)
+	{
+	case 0x90:
+		// Velocity 0 is Note Off.
+		if (msg[2] != 0)
+		{
+			m_count += (word & bit) == 0;
+			word |= bit;
+			break;
+		}
+		// Fall through.
+	case 0x80:
+		m_count -= (word & bit) != 0;
+		word &= ~bit;
+		break;
+	}
+}
+
+bool ActiveNotes::isEmpty() const
+{
+	return m_count == 0;
+}
+
+int ActiveNotes::next(unsigned from) const
+{
+	for (unsigned w = from >> 6; w < sizeof(m_bits) / sizeof(m_bits[0]); ++w)
+	{
+		uint64_t bits = m_bits[w];
+		if (w == from >> 6)
+			bits &= ~0ull << (from & 63);
+		if (bits)
+			return (w << 6) | __builtin_ctzll(bits);
+	}
+	return -1;
+}
+
+PeerTable::PeerTable()
+	:m_used(0)
+	,m_last(0)
+{
+}
+
+bool PeerTable::sameAddress(const sockaddr_in &a, const sockaddr_in &b)
+{
+	return a.sin_addr.s_addr == b.sin_addr.s_addr && a.sin_port == b.sin_port;
+}
+
+Peer *PeerTable::lookup(const sockaddr_in &addr)
+{
+	// Packets mostly arrive in runs from the same sender.
+	if ((m_used & (1u << m_last)) && sameAddress(m_peers[m_last].m_addr, addr))
+		return &m_peers[m_last];
+
+	for (uint32_t used = m_used; used; used &= used - 1)
+	{
+		unsigned i = __builtin_ctz(used);
+		if (sameAddress(m_peers[i].m_addr, addr))
+		{
+			m_last = i;
+			return &m_peers[i];
+		}
+	}
+
+	return NULL;
+}
+
+Peer *PeerTable::add(const sockaddr_in &addr, uint64_t now)
+{
+	if (m_used == ~0u)
+		return NULL;
+
+	unsigned i = __builtin_ctz(~m_used);
+	m_used |= 1u << i;
+	m_last = i;
+
+	Peer &peer = m_peers[i];
+	peer.m_addr = addr;
+	peer.m_lastSeen = now;
+	peer.m_notes.clear();
+	peer.m_limiter.reset(now);
+	memset(&peer.m_stats, 0, sizeof(peer.m_stats));
+	return &peer;
+}
+
+void PeerTable::remove(Peer *peer)
+{
+	m_used &= ~(1u << (peer - m_peers));
+}
+
+Peer *PeerTable::getOldest()
+{
+	Peer *oldest = NULL;
+	for (uint32_t used = m_used; used; used &= used - 1)
+	{
+		Peer *peer = &m_peers[__builtin_ctz(used)];
+		if (!oldest || peer->m_lastSeen < oldest->m_lastSeen)
+			oldest = peer;
+	}
+	return oldest;
+}
+
+unsigned PeerTable::getCount() const
+{
+	return __builtin_popcount(m_used);
+}
+
+Peer *PeerTable::get(unsigned index)
+{
+	return &m_peers[index];
+}
+
+bool PeerTable::isUsed(unsigned index) const
+{
+	return index < MAX_PEERS && (m_used & (1u << index));
+}
@@ -0,0 +1,90 @@
+/*
+ * osc2midi - a bridge between OSC and (ALSA) MIDI.
+ * Copyright (C) 2018  Vilniaus Blokas UAB, https://blokas.io/
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2 of the
+ * License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef PEERS_H
+#define PEERS_H
+
+#include <stdint.h>
+#include <netinet/in.h>
+
+#include "rate_limiter.h"
+#include "stats.h"
+
+// Notes currently held on by a sender, 16 channels x 128 notes.
+class ActiveNotes
+{
+public:
+	ActiveNotes();
+
+	void clear();
+
+	// Tracks Note On and Note Off in a raw MIDI message, the rest is ignored.
+	void update(const uint8_t msg[3]);
+
+	bool isEmpty() const;
+
+	// Returns the first (channel << 7) | note >= from that is on, -1 if there's none.
+	int next(unsigned from) const;
+
+private:
+	uint64_t m_bits[16 * 128 / 64];
+	unsigned m_count;
+};
+
+struct Peer
+{
+	sockaddr_in m_addr;
+	uint64_t m_lastSeen; // Milliseconds, monotonic.
+	ActiveNotes m_notes;
+	RateLimiter m_limiter;
+	PeerStats m_stats;
+};
+
+// Senders of the incoming OSC traffic, looked up by their address.
+class PeerTable
+{
+public:
+	enum { MAX_PEERS = 32 };
+
+	PeerTable();
+
+	Peer *lookup(const sockaddr_in &addr);
+
+	// Returns NULL if the table is full.
+	Peer *add(const sockaddr_in &addr, uint64_t now);
+
+	void remove(Peer *peer);
+
+	Peer *getOldest();
+
+	unsigned getCount() const;
+
+	// Slots may be empty, check with isUsed.
+	Peer *get(unsigned index);
+	bool isUsed(unsigned index) const;
+
+private:
+	static bool sameAddress(const sockaddr_in &a, const sockaddr_in &b);
+
+	Peer m_peers[MAX_PEERS];
+	uint32_t m_used; // Bit per slot.
+	unsigned m_last; // Most recently looked up slot.
+};
+
+#endif // PEERS_H
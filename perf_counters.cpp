@@ -0,0 +1,203 @@
+/*
+ * osc2midi - a bridge between OSC and (ALSA) MIDI.
+ * Copyright (C) 2018  Vilniaus Blokas UAB, https://blokas.io/
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2 of the
+ * License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include "perf_counters.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+static const char *const COUNTER_NAMES[PERF_COUNTER_COUNT] = {
+	"cycles",
+	"instructions",
+	"cachemisses",
+	"contextswitches",
+};
+
+static const struct
+{
+	uint32_t m_type;
+	uint64_t m_config;
+} COUNTER_EVENTS[PERF_COUNTER_COUNT] = {
+	{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+	{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+	{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+	{ PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES },
+};
+
+static int perf_open(PerfCounter counter, int groupFd, bool excludeKernel)
+{
+	perf_event_attr attr;
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = COUNTER_EVENTS[counter].m_type;
+	attr.config = COUNTER_EVENTS[counter].m_config;
+	attr.read_format = PERF_FORMAT_GROUP;
+	attr.disabled = groupFd < 0;
+	attr.exclude_kernel = excludeKernel;
+	attr.exclude_hv = 1;
+
+	// Counts this thread on any CPU.
+	return syscall(SYS_perf_event_open, &attr, 0, -1, groupFd, 0);
+}
+
+PerfCounters::PerfCounters()
+	:m_window(0)
+	,m_leader(-1)
+	,m_slotCount(0)
+{
+	for (unsigned i=0; i<PERF_COUNTER_COUNT; ++i)
+	{
+		m_fds[i] = -1;
+		m_slot[i] = -1;
+	}
+	memset(m_start, 0, sizeof(m_start));
+	memset(m_current, 0, sizeof(m_current));
+	memset(m_cost, 0, sizeof(m_cost));
+	memset(m_windows, 0, sizeof(m_windows));
+}
+
+PerfCounters::~PerfCounters()
+{
+	for (unsigned i=0; i<PERF_COUNTER_COUNT; ++i)
+	{
+		if (m_fds[i] >= 0)
+			close(m_fds[i]);
+	}
+}
+
+int PerfCounters::init(unsigned window)
+{
+	if (window == 0)
+		return 0;
+
+	// Counting the kernel side too, such as the socket and ALSA syscalls, unless
+	// perf_event_paranoid restricts it to user space.
+	bool excludeKernel = false;
+
+	for (unsigned i=0; i<PERF_COUNTER_COUNT; ++i)
+	{
+		int fd = perf_open((PerfCounter)i, m_leader, excludeKernel);
+		if (fd < 0 && (errno == EACCES || errno == EPERM) && !excludeKernel)
+		{
+			excludeKernel = true;
+			fd = perf_open((PerfCounter)i, m_leader, excludeKernel);
+		}
+
+		if (fd < 0)
+		{
+			fprintf(stderr, "Counter '%s' is not available! (%d)\n", COUNTER_NAMES[i], errno);
+			continue;
+		}
+
+		if (m_leader < 0)
+			m_leader = fd;
+		m_fds[i] = fd;
+		m_slot[i] = m_slotCount++;
+	}
+
+	if (m_leader < 0)
+	{
+		fprintf(stderr, "Failed opening the performance counters!\n");
+		return -ENODEV;
+	}
+
+	if (excludeKernel)
+		fprintf(stderr, "Performance counters are limited to user space by perf_event_paranoid.\n");
+
+	ioctl(m_leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+	ioctl(m_leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+
+	m_window = window;
+	return 0;
+}
+
+bool PerfCounters::isEnabled() const
+{
+	return m_window != 0;
+}
+
+bool PerfCounters::isAvailable(PerfCounter counter) const
+{
+	return m_slot[counter] >= 0;
+}
+
+bool PerfCounters::read(uint64_t values[PERF_COUNTER_COUNT])
+{
+	// PERF_FORMAT_GROUP layout: the count of values followed by the values.
+	uint64_t buffer[1 + PERF_COUNTER_COUNT];
+	ssize_t n = ::read(m_leader, buffer, sizeof(buffer));
+	if (n < (ssize_t)(sizeof(uint64_t) * (1 + m_slotCount)))
+		return false;
+
+	for (unsigned i=0; i<PERF_COUNTER_COUNT; ++i)
+		values[i] = m_slot[i] >= 0 ? buffer[1 + m_slot[i]] : 0;
+	return true;
+}
+
+void PerfCounters::begin()
+{
+	if (m_window == 0)
+		return;
+
+	if (!read(m_start))
+		memset(m_start, 0, sizeof(m_start));
+}
+
+void PerfCounters::end(MidiDirection dir, unsigned events)
+{
+	if (m_window == 0 || events == 0)
+		return;
+
+	uint64_t values[PERF_COUNTER_COUNT];
+	if (!read(values))
+		return;
+
+	Window &w = m_current[dir];
+	for (unsigned i=0; i<PERF_COUNTER_COUNT; ++i)
+		w.m_counts[i] += values[i] - m_start[i];
+	w.m_events += events;
+
+	if (w.m_events < m_window)
+		return;
+
+	for (unsigned i=0; i<PERF_COUNTER_COUNT; ++i)
+		m_cost[dir][i] = (float)w.m_counts[i] / w.m_events;
+	++m_windows[dir];
+	memset(&w, 0, sizeof(w));
+}
+
+float PerfCounters::getCost(MidiDirection dir, PerfCounter counter) const
+{
+	return m_cost[dir][counter];
+}
+
+uint64_t PerfCounters::getWindows(MidiDirection dir) const
+{
+	return m_windows[dir];
+}
+
+const char *PerfCounters::getCounterName(PerfCounter counter)
+{
+	return COUNTER_NAMES[counter];
+}
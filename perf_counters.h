@@ -0,0 +1,86 @@
+/*
+ * osc2midi - a bridge between OSC and (ALSA) MIDI.
+ * Copyright (C) 2018  Vilniaus Blokas UAB, https://blokas.io/
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2 of the
+ * License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef PERF_COUNTERS_H
+#define PERF_COUNTERS_H
+
+#include <stdint.h>
+
+#include "midi_serialization.h"
+
+enum PerfCounter
+{
+	PERF_CYCLES,
+	PERF_INSTRUCTIONS,
+	PERF_CACHE_MISSES,
+	PERF_CONTEXT_SWITCHES,
+
+	PERF_COUNTER_COUNT
+};
+
+// Counts the hardware events spent handling the MIDI events in each direction
+// using perf_event_open, averaged over windows of a fixed count of MIDI events.
+// Counters the CPU or the kernel doesn't provide are left out.
+class PerfCounters
+{
+public:
+	PerfCounters();
+	~PerfCounters();
+
+	// Returns 0 on success, negative error code otherwise. 0 window disables the counters.
+	int init(unsigned window);
+
+	bool isEnabled() const;
+	bool isAvailable(PerfCounter counter) const;
+
+	// Surround the handling of events.
+	void begin();
+	void end(MidiDirection dir, unsigned events);
+
+	// Per event cost within the last complete window, count of windows measured so far.
+	float getCost(MidiDirection dir, PerfCounter counter) const;
+	uint64_t getWindows(MidiDirection dir) const;
+
+	static const char *getCounterName(PerfCounter counter);
+
+private:
+	bool read(uint64_t values[PERF_COUNTER_COUNT]);
+
+	unsigned m_window;
+	int m_fds[PERF_COUNTER_COUNT];
+	int m_leader;
+
+	// Position of each counter within the group read, -1 if not available.
+	int m_slot[PERF_COUNTER_COUNT];
+	unsigned m_slotCount;
+
+	uint64_t m_start[PERF_COUNTER_COUNT];
+
+	struct Window
+	{
+		unsigned m_events;
+		uint64_t m_counts[PERF_COUNTER_COUNT];
+	};
+
+	Window m_current[MIDI_DIR_COUNT];
+	float m_cost[MIDI_DIR_COUNT][PERF_COUNTER_COUNT];
+	uint64_t m_windows[MIDI_DIR_COUNT];
+};
+
+#endif // PERF_COUNTERS_H
@@ -0,0 +1,70 @@
+/*
+ * osc2midi - a bridge between OSC and (ALSA) MIDI.
+ * Copyright (C) 2018  Vilniaus Blokas UAB, https://blokas.io/
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2 of the
+ * License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef PROBES_H
+#define PROBES_H
+
+// USDT probes for bpftrace, perf and SystemTap, in the osc2midi provider. A disabled
+// probe is a single nop, its arguments are only evaluated into registers. Building
+// without <sys/sdt.h> (systemtap-sdt-dev) leaves the probes out entirely.
+//
+// Example:
+//
+// bpftrace -e 'usdt:/usr/bin/osc2midi:osc2midi:drop { @[arg0, arg1] = count(); }'
+
+#if defined(__has_include)
+#	if __has_include(<sys/sdt.h>)
+#		include <sys/sdt.h>
+#		define OSC2MIDI_HAVE_SDT
+#	endif
+#endif
+
+#ifdef OSC2MIDI_HAVE_SDT
+
+// A datagram was received. Arguments: length, IPv4 address, port (host byte order).
+#	define PROBE_RECEIVE(len, addr, port) STAP_PROBE3(osc2midi, receive, len, addr, port)
+
+// An event got decoded from OSC (dir 0) or from ALSA (dir 1). Arguments: direction,
+// USB MIDI event as a 32 bit int, e.g. 0x09903c40.
+#	define PROBE_DECODE(dir, event) STAP_PROBE2(osc2midi, decode, dir, event)
+
+// An event was written to ALSA. Arguments: status, data 1, data 2.
+#	define PROBE_ALSA_OUTPUT(status, d1, d2) STAP_PROBE3(osc2midi, alsa_output, status, d1, d2)
+
+// An event was sent over OSC. Arguments: USB MIDI event, message length, sendto result.
+#	define PROBE_OSC_SEND(event, len, result) STAP_PROBE3(osc2midi, osc_send, event, len, result)
+
+// An event got dropped. Arguments: direction, reason (StatDrop), sender's port or 0.
+#	define PROBE_DROP(dir, reason, port) STAP_PROBE3(osc2midi, drop, dir, reason, port)
+
+// An event loop iteration ended. Arguments: microseconds spent, ALSA input queue depth.
+#	define PROBE_LOOP_ITERATION(us, queued) STAP_PROBE2(osc2midi, loop_iteration, us, queued)
+
+#else
+
+#	define PROBE_RECEIVE(len, addr, port)
+#	define PROBE_DECODE(dir, event)
+#	define PROBE_ALSA_OUTPUT(status, d1, d2)
+#	define PROBE_OSC_SEND(event, len, result)
+#	define PROBE_DROP(dir, reason, port)
+#	define PROBE_LOOP_ITERATION(us, queued)
+
+#endif
+
+#endif // PROBES_H
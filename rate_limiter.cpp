@@ -0,0 +1,354 @@
+/*
+ * osc2midi - a bridge between OSC and (ALSA) MIDI.
+ * Copyright (C) 2018  Vilniaus Blokas UAB, https://blokas.io/
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2 of the
+ * License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include "rate_limiter.h"
+#include "config_reader.h"
+
+#include <string.h>
+#include <errno.h>
+
+static const char *const RATE_CLASS_NAMES[RATE_CLASS_COUNT] = {
+	"note",
+	"cc",
+	"sysex",
+	"other",
+};
+
+RateLimits::RateLimits()
+{
+	clear();
+}
+
+void RateLimits::clear()
+{
+	memset(m_policies, 0, sizeof(m_policies));
+}
+
+bool RateLimits::isEmpty() const
+{
+	for (unsigned i=0; i<RATE_CLASS_COUNT; ++i)
+	{
+		if (m_policies[i].m_rate != 0)
+			return false;
+	}
+	return true;
+}
+
+const RatePolicy &RateLimits::getPolicy(RateClass c) const
+{
+	return m_policies[c];
+}
+
+const char *RateLimits::getClassName(RateClass c)
+{
+	return RATE_CLASS_NAMES[c];
+}
+
+RateClass RateLimits::classify(const midi_event_t &ev)
+{
+	switch (midi_event_status(ev) & 0xf0)
+	{
+	case 0x80:
+	case 0x90:
+	case 0xa0:
+		return RATE_NOTE;
+	case 0xb0:
+		return RATE_CC;
+	case 0xf0:
+		return midi_event_status(ev) == 0xf0 ? RATE_SYSEX : RATE_OTHER;
+	default:
+		return RATE_OTHER;
+	}
+}
+
+int RateLimits::load(const char *fileName)
+{
+	clear();
+
+	ConfigReader reader;
+	int result = reader.open(fileName);
+	if (result < 0)
+		return result;
+
+	char *tokens[ConfigReader::MAX_TOKENS];
+	int n;
+	while ((n = reader.readLine(tokens)) > 0)
+	{
+		int c;
+		for (c=0; c<RATE_CLASS_COUNT; ++c)
+		{
+			if (strcmp(tokens[0], RATE_CLASS_NAMES[c]) == 0)
+				break;
+		}
+
+		if (c == RATE_CLASS_COUNT)
+		{
+			reader.error("Unknown class '%s', expected note, cc, sysex or other!", tokens[0]);
+			clear();
+			return -EINVAL;
+		}
+
+		RatePolicy policy;
+		memset(&policy, 0, sizeof(policy));
+		int burst = 0;
+
+		for (int i=1; i<n; ++i)
+		{
+			char *key, *value;
+			int v;
+			if (ConfigReader::splitKeyValue(tokens[i], key, value))
+			{
+				if (strcmp(key, "rate") == 0 && ConfigReader::parseInt(value, 1, 100000000, v))
+				{
+					policy.m_rate = v;
+					continue;
+				}
+				if (strcmp(key, "burst") == 0 && ConfigReader::parseInt(value, 1, 100000000, burst))
+					continue;
+				if (strcmp(key, "policy") == 0 && (strcmp(value, "drop") == 0 || strcmp(value, "coalesce") == 0))
+				{
+					policy.m_coalesce = value[0] == 'c';
+					continue;
+				}
+			}
+
+			reader.error("Invalid argument '%s'!", tokens[i]);
+			clear();
+			return -EINVAL;
+		}
+
+		if (policy.m_rate == 0)
+		{
+			reader.error("Missing rate!");
+			clear();
+			return -EINVAL;
+		}
+
+		policy.m_burst = burst ? burst : (policy.m_rate >= 10 ? policy.m_rate / 10 : 1);
+		m_policies[c] = policy;
+	}
+
+	return 0;
+}
+
+void RateLimiter::TokenBucket::refill(const RatePolicy &policy, uint64_t now)
+{
+	uint64_t max = (uint64_t)policy.m_burst * 1000;
+	uint64_t elapsed = now - m_last;
+	m_last = now;
+
+	// Events per second times milliseconds gives thousandths of an event.
+	m_tokens += elapsed * policy.m_rate;
+	if (m_tokens > max)
+		m_tokens = max;
+}
+
+bool RateLimiter::TokenBucket::take(const RatePolicy &policy, uint64_t now)
+{
+	refill(policy, now);
+
+	if (m_tokens < 1000)
+		return false;
+
+	m_tokens -= 1000;
+	return true;
+}
+
+RateLimiter::RateLimiter()
+{
+	reset(0);
+}
+
+void RateLimiter::reset(uint64_t now)
+{
+	for (unsigned i=0; i<RATE_CLASS_COUNT; ++i)
+	{
+		m_buckets[i].m_tokens = ~0ull >> 1; // Clamped to the burst on first use.
+		m_buckets[i].m_last = now;
+	}
+	memset(m_passed, 0, sizeof(m_passed));
+	memset(m_dropped, 0, sizeof(m_dropped));
+	memset(m_coalesced, 0, sizeof(m_coalesced));
+	// The program, channel pressure and pitch bend slots are past the last whole word.
+	static_assert(PENDING_WORDS * 64 >= SLOT_COUNT, "Pending bits don't cover every slot.");
+	memset(m_pendingBits, 0, sizeof(m_pendingBits));
+	m_pendingCount = 0;
+}
+
+int RateLimiter::slotOf(const midi_event_t &ev)
+{
+	uint8_t status = midi_event_status(ev);
+	unsigned ch = status & 0x0f;
+
+	switch (status & 0xf0)
+	{
+	case 0xb0:
+		return (ch << 7) | (ev.m_data[1] & 0x7f);
+	case 0xc0:
+		return SLOT_PROGRAM + ch;
+	case 0xd0:
+		return SLOT_PRESSURE + ch;
+	case 0xe0:
+		return SLOT_PITCHBEND + ch;
+	default:
+		return -1;
+	}
+}
+
+midi_event_t RateLimiter::eventOf(unsigned slot) const
+{
+	midi_event_t ev;
+	uint16_t value = m_pending[slot];
+	uint8_t cable = m_pendingCable[slot] << 4;
+
+	if (slot < SLOT_PROGRAM)
+	{
+		ev.m_event = cable | 0x0b;
+		ev.m_data[0] = 0xb0 | (slot >> 7);
+		ev.m_data[1] = slot & 0x7f;
+		ev.m_data[2] = value;
+	}
+	else if (slot < SLOT_PRESSURE)
+	{
+		ev.m_event = cable | 0x0c;
+		ev.m_data[0] = 0xc0 | (slot - SLOT_PROGRAM);
+		ev.m_data[1] = value;
+		ev.m_data[2] = 0;
+	}
+	else if (slot < SLOT_PITCHBEND)
+	{
+		ev.m_event = cable | 0x0d;
+		ev.m_data[0] = 0xd0 | (slot - SLOT_PRESSURE);
+		ev.m_data[1] = value;
+		ev.m_data[2] = 0;
+	}
+	else
+	{
+		ev.m_event = cable | 0x0e;
+		ev.m_data[0] = 0xe0 | (slot - SLOT_PITCHBEND);
+		ev.m_data[1] = value & 0x7f;
+		ev.m_data[2] = value >> 7;
+	}
+
+	return ev;
+}
+
+RateLimiter::Verdict RateLimiter::check(const RateLimits &limits, const midi_event_t &ev, uint64_t now)
+{
+	RateClass c = RateLimits::classify(ev);
+	const RatePolicy &policy = limits.getPolicy(c);
+
+	if (policy.m_rate == 0 || m_buckets[c].take(policy, now))
+	{
+		++m_passed[c];
+		return RATE_PASS;
+	}
+
+	uint8_t status = midi_event_status(ev);
+	if ((status & 0xf0) == 0x80 || ((status & 0xf0) == 0x90 && ev.m_data[2] == 0))
+	{
+		++m_passed[c];
+		return RATE_PASS;
+	}
+
+	int slot = policy.m_coalesce ? slotOf(ev) : -1;
+	if (slot < 0)
+	{
+		++m_dropped[c];
+		return RATE_DROP;
+	}
+
+	uint64_t bit = 1ull << (slot & 63);
+	if ((m_pendingBits[slot >> 6] & bit) == 0)
+	{
+		m_pendingBits[slot >> 6] |= bit;
+		++m_pendingCount;
+	}
+	else
+	{
+		// The previously pending value got replaced.
+		++m_coalesced[c];
+	}
+
+	m_pending[slot] = slot >= SLOT_PITCHBEND ? ((ev.m_data[2] & 0x7f) << 7) | (ev.m_data[1] & 0x7f) : (slot >= SLOT_PROGRAM ? ev.m_data[1] : ev.m_data[2]) & 0x7f;
+	m_pendingCable[slot] = ev.m_event >> 4;
+	return RATE_COALESCED;
+}
+
+bool RateLimiter::hasPending() const
+{
+	return m_pendingCount != 0;
+}
+
+unsigned RateLimiter::getWait(const RateLimits &limits, uint64_t now) const
+{
+	bool pending[RATE_CLASS_COUNT] = { false };
+	for (unsigned w=0; w<PENDING_WORDS; ++w)
+	{
+		if (m_pendingBits[w])
+			pending[(w << 6) < SLOT_PROGRAM ? RATE_CC : RATE_OTHER] = true;
+	}
+
+	unsigned wait = ~0u;
+	for (unsigned c=0; c<RATE_CLASS_COUNT; ++c)
+	{
+		if (!pending[c])
+			continue;
+
+		const RatePolicy &policy = limits.getPolicy((RateClass)c);
+		if (policy.m_rate == 0)
+			return 0;
+
+		TokenBucket bucket = m_buckets[c];
+		bucket.refill(policy, now);
+		if (bucket.m_tokens >= 1000)
+			return 0;
+
+		unsigned w = (1000 - bucket.m_tokens + policy.m_rate - 1) / policy.m_rate;
+		if (w < wait)
+			wait = w;
+	}
+
+	return wait;
+}
+
+unsigned RateLimiter::flush(const RateLimits &limits, uint64_t now, midi_event_t *out, unsigned max)
+{
+	unsigned n = 0;
+
+	for (unsigned w=0; w<PENDING_WORDS && m_pendingCount && n < max; ++w)
+	{
+		while (m_pendingBits[w] && n < max)
+		{
+			unsigned slot = (w << 6) | __builtin_ctzll(m_pendingBits[w]);
+			RateClass c = slot < SLOT_PROGRAM ? RATE_CC : RATE_OTHER;
+			const RatePolicy &policy = limits.getPolicy(c);
+
+			if (policy.m_rate != 0 && !m_buckets[c].take(policy, now))
+				break;
+
+			m_pendingBits[w] &= m_pendingBits[w] - 1;
+			--m_pendingCount;
+			++m_passed[c];
+			out[n++] = eventOf(slot);
+		}
+	}
+
+	return n;
+}
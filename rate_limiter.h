@@ -0,0 +1,143 @@
+/*
+ * osc2midi - a bridge between OSC and (ALSA) MIDI.
+ * Copyright (C) 2018  Vilniaus Blokas UAB, https://blokas.io/
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2 of the
+ * License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef RATE_LIMITER_H
+#define RATE_LIMITER_H
+
+#include <stdint.h>
+
+#include "midi_serialization.h"
+
+enum RateClass
+{
+	RATE_NOTE,  // Note On / Off, polyphonic pressure.
+	RATE_CC,    // Control Change.
+	RATE_SYSEX, // SysEx packets, up to 3 bytes each.
+	RATE_OTHER, // Everything else.
+
+	RATE_CLASS_COUNT
+};
+
+struct RatePolicy
+{
+	uint32_t m_rate;  // Events per second, 0 - unlimited.
+	uint32_t m_burst; // Events.
+	bool m_coalesce;
+};
+
+// Rate limit policies per message class, loaded from a file:
+//
+// <note|cc|sysex|other> rate=<events per second> [burst=N] [policy=drop|coalesce]
+//
+// Over the limit events get dropped, or with coalesce, the last value of each
+// controller, program, channel pressure and pitch bend is held back and sent
+// once the rate allows. Note Off is never dropped. burst defaults to rate / 10.
+//
+// Example:
+//
+// note rate=2000 burst=500
+// cc rate=1000 policy=coalesce
+class RateLimits
+{
+public:
+	RateLimits();
+
+	void clear();
+
+	// Returns 0 on success, negative error code otherwise.
+	int load(const char *fileName);
+
+	bool isEmpty() const;
+
+	const RatePolicy &getPolicy(RateClass c) const;
+
+	static RateClass classify(const midi_event_t &ev);
+
+	static const char *getClassName(RateClass c);
+
+private:
+	RatePolicy m_policies[RATE_CLASS_COUNT];
+};
+
+// Per sender token buckets, along with the events held back for coalescing.
+class RateLimiter
+{
+public:
+	enum Verdict
+	{
+		RATE_PASS,
+		RATE_DROP,
+		RATE_COALESCED,
+	};
+
+	RateLimiter();
+
+	void reset(uint64_t now);
+
+	// Constant time.
+	Verdict check(const RateLimits &limits, const midi_event_t &ev, uint64_t now);
+
+	bool hasPending() const;
+
+	// Milliseconds until the rate allows sending some of the pending events.
+	unsigned getWait(const RateLimits &limits, uint64_t now) const;
+
+	// Writes up to max of the pending events the rate allows now to out.
+	unsigned flush(const RateLimits &limits, uint64_t now, midi_event_t *out, unsigned max);
+
+	uint64_t getPassed(RateClass c) const { return m_passed[c]; }
+	uint64_t getDropped(RateClass c) const { return m_dropped[c]; }
+	uint64_t getCoalesced(RateClass c) const { return m_coalesced[c]; }
+
+private:
+	struct TokenBucket
+	{
+		uint64_t m_tokens; // In 1/1000 of an event.
+		uint64_t m_last;
+
+		void refill(const RatePolicy &policy, uint64_t now);
+		bool take(const RatePolicy &policy, uint64_t now);
+	};
+
+	// Pending slots: 0-2047 controllers ((channel << 7) | controller), then 16 programs,
+	// 16 channel pressures and 16 pitch bends.
+	enum
+	{
+		SLOT_PROGRAM   = 16 * 128,
+		SLOT_PRESSURE  = SLOT_PROGRAM + 16,
+		SLOT_PITCHBEND = SLOT_PRESSURE + 16,
+		SLOT_COUNT     = SLOT_PITCHBEND + 16,
+		PENDING_WORDS  = (SLOT_COUNT + 63) / 64,
+	};
+
+	static int slotOf(const midi_event_t &ev);
+	midi_event_t eventOf(unsigned slot) const;
+
+	TokenBucket m_buckets[RATE_CLASS_COUNT];
+	uint64_t m_passed[RATE_CLASS_COUNT];
+	uint64_t m_dropped[RATE_CLASS_COUNT];
+	uint64_t m_coalesced[RATE_CLASS_COUNT];
+
+	uint64_t m_pendingBits[PENDING_WORDS];
+	uint16_t m_pending[SLOT_COUNT]; // Up to 14 bit value.
+	uint8_t m_pendingCable[SLOT_COUNT];
+	unsigned m_pendingCount;
+};
+
+#endif // RATE_LIMITER_H
@@ -0,0 +1,162 @@
+/*
+ * osc2midi - a bridge between OSC and (ALSA) MIDI.
+ * Copyright (C) 2018  Vilniaus Blokas UAB, https://blokas.io/
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2 of the
+ * License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include "semantic_osc.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <arpa/inet.h>
+
+static inline char *put_int(char *p, int32_t v)
+{
+	uint32_t n = htonl((uint32_t)v);
+	memcpy(p, &n, sizeof(n));
+	return p + sizeof(n);
+}
+
+static inline char *put_float(char *p, float v)
+{
+	uint32_t n;
+	memcpy(&n, &v, sizeof(n));
+	return put_int(p, (int32_t)n);
+}
+
+// Appends an OSC string, padded with zeros to a multiple of 4 bytes.
+static char *put_string(char *p, const char *str)
+{
+	size_t n = strlen(str) + 1;
+	memcpy(p, str, n);
+	p += n;
+	while (n++ & 0x3)
+		*p++ = '\0';
+	return p;
+}
+
+SemanticOsc::SemanticOsc()
+	:m_format(FORMAT_INT)
+{
+	memset(m_status, 0, sizeof(m_status));
+	memset(m_cc, 0, sizeof(m_cc));
+}
+
+void SemanticOsc::build(Template &t, const char *address, const char *types)
+{
+	char *p = put_string(t.m_data, address);
+	p = put_string(p, types);
+	t.m_length = p - t.m_data;
+}
+
+void SemanticOsc::init(Format format)
+{
+	m_format = format;
+
+	const char *v = format == FORMAT_FLOAT ? "f" : "i";
+	char types[8];
+	char address[32];
+
+	for (int ch=0; ch<16; ++ch)
+	{
+		snprintf(types, sizeof(types), ",i%s", v);
+
+		snprintf(address, sizeof(address), "/ch/%d/noteoff", ch + 1);
+		build(m_status[0x00 | ch], address, types);
+
+		snprintf(address, sizeof(address), "/ch/%d/note", ch + 1);
+		build(m_status[0x10 | ch], address, types);
+
+		snprintf(address, sizeof(address), "/ch/%d/polypressure", ch + 1);
+		build(m_status[0x20 | ch], address, types);
+
+		snprintf(types, sizeof(types), ",%s", v);
+
+		for (int cc=0; cc<128; ++cc)
+		{
+			snprintf(address, sizeof(address), "/ch/%d/cc/%d", ch + 1, cc);
+			build(m_cc[ch][cc], address, types);
+		}
+
+		snprintf(address, sizeof(address), "/ch/%d/program", ch + 1);
+		build(m_status[0x40 | ch], address, ",i");
+
+		snprintf(address, sizeof(address), "/ch/%d/pressure", ch + 1);
+		build(m_status[0x50 | ch], address, types);
+
+		snprintf(address, sizeof(address), "/ch/%d/pitchbend", ch + 1);
+		build(m_status[0x60 | ch], address, types);
+	}
+
+	build(m_status[0x71], "/mtc", ",i");
+	build(m_status[0x72], "/songpos", ",i");
+	build(m_status[0x73], "/songsel", ",i");
+	build(m_status[0x76], "/tune", ",");
+	build(m_status[0x78], "/clock", ",");
+	build(m_status[0x7a], "/start", ",");
+	build(m_status[0x7b], "/continue", ",");
+	build(m_status[0x7c], "/stop", ",");
+	build(m_status[0x7e], "/sensing", ",");
+	build(m_status[0x7f], "/reset", ",");
+}
+
+size_t SemanticOsc::encode(char buffer[MAX_MESSAGE_SIZE], const midi_event_t &ev) const
+{
+	uint8_t status = midi_event_status(ev);
+	uint8_t d1 = ev.m_data[1] & 0x7f;
+	uint8_t d2 = ev.m_data[2] & 0x7f;
+
+	const Template &t = (status & 0xf0) == 0xb0 ? m_cc[status & 0x0f][d1] : m_status[status & 0x7f];
+	if (t.m_length == 0)
+		return 0;
+
+	memcpy(buffer, t.m_data, t.m_length);
+	char *p = buffer + t.m_length;
+	bool f = m_format == FORMAT_FLOAT;
+
+	switch (status & 0xf0)
+	{
+	case 0x80:
+	case 0x90:
+	case 0xa0:
+		p = put_int(p, d1);
+		p = f ? put_float(p, d2 / 127.0f) : put_int(p, d2);
+		break;
+	case 0xb0:
+		p = f ? put_float(p, d2 / 127.0f) : put_int(p, d2);
+		break;
+	case 0xc0:
+		p = put_int(p, d1);
+		break;
+	case 0xd0:
+		p = f ? put_float(p, d1 / 127.0f) : put_int(p, d1);
+		break;
+	case 0xe0:
+		{
+			int bend = ((d2 << 7) | d1) - 8192;
+			p = f ? put_float(p, bend / 8192.0f) : put_int(p, bend);
+		}
+		break;
+	case 0xf0:
+		if (status == 0xf2)
+			p = put_int(p, (d2 << 7) | d1);
+		else if (status == 0xf1 || status == 0xf3)
+			p = put_int(p, d1);
+		break;
+	}
+
+	return p - buffer;
+}
@@ -0,0 +1,71 @@
+/*
+ * osc2midi - a bridge between OSC and (ALSA) MIDI.
+ * Copyright (C) 2018  Vilniaus Blokas UAB, https://blokas.io/
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2 of the
+ * License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef SEMANTIC_OSC_H
+#define SEMANTIC_OSC_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "midi_serialization.h"
+
+// Encodes events as human readable OSC messages, for example:
+//
+// /ch/1/note ii 60 100
+// /ch/1/noteoff ii 60 0
+// /ch/3/cc/74 f 0.5
+// /ch/2/pitchbend i -8192
+// /clock
+//
+// Every address along with its type tags is built in init(), indexed by status
+// and controller number, so encoding is a copy of the prefix plus the arguments.
+class SemanticOsc
+{
+public:
+	enum Format
+	{
+		FORMAT_INT,   // Values as they are, pitch bend centered at 0.
+		FORMAT_FLOAT, // Values normalized to 0.0 - 1.0, pitch bend to -1.0 - 1.0.
+	};
+
+	enum { MAX_MESSAGE_SIZE = 48 };
+
+	SemanticOsc();
+
+	void init(Format format);
+
+	// Returns the length of the message written to buffer, 0 if the event has no
+	// semantic address (SysEx).
+	size_t encode(char buffer[MAX_MESSAGE_SIZE], const midi_event_t &ev) const;
+
+private:
+	struct Template
+	{
+		uint8_t m_length;
+		char m_data[32];
+	};
+
+	void build(Template &t, const char *address, const char *types);
+
+	Format m_format;
+	Template m_status[128];  // Indexed by status & 0x7f.
+	Template m_cc[16][128];  // Indexed by channel and controller.
+};
+
+#endif // SEMANTIC_OSC_H
@@ -0,0 +1,171 @@
+/*
+ * osc2midi - a bridge between OSC and (ALSA) MIDI.
+ * Copyright (C) 2018  Vilniaus Blokas UAB, https://blokas.io/
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2 of the
+ * License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef SEQ_ALSA_H
+#define SEQ_ALSA_H
+
+#include <alsa/asoundlib.h>
+#include <errno.h>
+#include <poll.h>
+
+// The ALSA sequencer backend, see seq_backend.h. Everything is inline, so the
+// calls compile to the same code as using snd_seq_* directly.
+class AlsaSeq
+{
+public:
+	AlsaSeq()
+		:m_seq(NULL)
+	{
+	}
+
+	bool isOpen() const
+	{
+		return m_seq != NULL;
+	}
+
+	int open()
+	{
+		return snd_seq_open(&m_seq, "default", SND_SEQ_OPEN_DUPLEX, 0);
+	}
+
+	void close()
+	{
+		if (m_seq)
+		{
+			snd_seq_close(m_seq);
+			m_seq = NULL;
+		}
+	}
+
+	int setClientName(const char *name)
+	{
+		return snd_seq_set_client_name(m_seq, name);
+	}
+
+	int getClientId() const
+	{
+		return snd_seq_client_id(m_seq);
+	}
+
+	// Returns the port number or a negative error code.
+	int createPort(const char *name, unsigned caps, unsigned type)
+	{
+		return snd_seq_create_simple_port(m_seq, name, caps, type);
+	}
+
+	void deletePort(int port)
+	{
+		snd_seq_delete_simple_port(m_seq, port);
+	}
+
+	// Returns the queue number or a negative error code.
+	int allocQueue(const char *name)
+	{
+		return snd_seq_alloc_named_queue(m_seq, name);
+	}
+
+	void freeQueue(int queue)
+	{
+		snd_seq_free_queue(m_seq, queue);
+	}
+
+	// Stamps the events delivered to the port with the real time of the queue, and starts the queue.
+	int setTimestamping(int port, int queue)
+	{
+		snd_seq_port_info_t *info;
+		snd_seq_port_info_alloca(&info);
+		int result = snd_seq_get_port_info(m_seq, port, info);
+		if (result >= 0)
+		{
+			snd_seq_port_info_set_timestamping(info, 1);
+			snd_seq_port_info_set_timestamp_real(info, 1);
+			snd_seq_port_info_set_timestamp_queue(info, queue);
+			result = snd_seq_set_port_info(m_seq, port, info);
+		}
+		if (result >= 0)
+			result = snd_seq_start_queue(m_seq, queue, NULL);
+		if (result >= 0)
+			result = snd_seq_drain_output(m_seq);
+		return result;
+	}
+
+	int clearEventFilter()
+	{
+		snd_seq_client_info_t *info;
+		snd_seq_client_info_alloca(&info);
+		int result = snd_seq_get_client_info(m_seq, info);
+		if (result >= 0)
+		{
+			snd_seq_client_info_event_filter_clear(info);
+			result = snd_seq_set_client_info(m_seq, info);
+		}
+		return result;
+	}
+
+	// Once any type is added, only the added event types get delivered.
+	int addEventFilter(snd_seq_event_type_t type)
+	{
+		return snd_seq_set_client_event_filter(m_seq, type);
+	}
+
+	// Returns 0 on success, negative error code if there isn't exactly one descriptor.
+	int getPollDescriptor(pollfd &fd)
+	{
+		int n = snd_seq_poll_descriptors_count(m_seq, POLLIN);
+		if (n != 1)
+			return -EINVAL;
+		snd_seq_poll_descriptors(m_seq, &fd, 1, POLLIN);
+		return 0;
+	}
+
+	int input(snd_seq_event_t *&ev)
+	{
+		return snd_seq_event_input(m_seq, &ev);
+	}
+
+	int inputPending(bool fetch)
+	{
+		return snd_seq_event_input_pending(m_seq, fetch ? 1 : 0);
+	}
+
+	void freeEvent(snd_seq_event_t *ev)
+	{
+		snd_seq_free_event(ev);
+	}
+
+	int output(snd_seq_event_t *ev)
+	{
+		return snd_seq_event_output(m_seq, ev);
+	}
+
+	int outputDirect(snd_seq_event_t *ev)
+	{
+		return snd_seq_event_output_direct(m_seq, ev);
+	}
+
+	int drainOutput()
+	{
+		return snd_seq_drain_output(m_seq);
+	}
+
+private:
+	snd_seq_t *m_seq;
+};
+
+#endif // SEQ_ALSA_H
@@ -0,0 +1,48 @@
+/*
+ * osc2midi - a bridge between OSC and (ALSA) MIDI.
+ * Copyright (C) 2018  Vilniaus Blokas UAB, https://blokas.io/
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2 of the
+ * License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef SEQ_BACKEND_H
+#define SEQ_BACKEND_H
+
+// The sequencer the bridge talks to, selected at build time so there's no
+// indirection on the event path. SeqBackend is AlsaSeq, or LoopbackSeq when
+// built with OSC2MIDI_SEQ_LOOPBACK defined (make SEQ_BACKEND=loopback).
+//
+// Both provide the same members, mirroring the snd_seq_* calls the bridge
+// makes, returning 0 or a positive value on success and a negative error code
+// otherwise:
+//
+//   isOpen, open, close, setClientName, getClientId,
+//   createPort, deletePort, allocQueue, freeQueue, setTimestamping,
+//   clearEventFilter, addEventFilter, getPollDescriptor,
+//   input, inputPending, freeEvent, output, outputDirect, drainOutput
+
+#ifdef OSC2MIDI_SEQ_LOOPBACK
+
+#include "seq_loopback.h"
+typedef LoopbackSeq SeqBackend;
+
+#else // OSC2MIDI_SEQ_LOOPBACK
+
+#include "seq_alsa.h"
+typedef AlsaSeq SeqBackend;
+
+#endif // OSC2MIDI_SEQ_LOOPBACK
+
+#endif // SEQ_BACKEND_H
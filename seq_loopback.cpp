@@ -0,0 +1,246 @@
+/*
+ * osc2midi - a bridge between OSC and (ALSA) MIDI.
+ * Copyright (C) 2018  Vilniaus Blokas UAB, https://blokas.io/
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2 of the
+ * License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include "seq_backend.h"
+
+#ifdef OSC2MIDI_SEQ_LOOPBACK
+
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+LoopbackSeq::LoopbackSeq()
+	:m_eventFd(-1)
+	,m_queue(-1)
+	,m_queueStart(0)
+	,m_filtering(false)
+	,m_head(0)
+	,m_tail(0)
+	,m_captured(0)
+	,m_overruns(0)
+{
+	memset(m_filter, 0, sizeof(m_filter));
+}
+
+LoopbackSeq::~LoopbackSeq()
+{
+	close();
+}
+
+bool LoopbackSeq::isOpen() const
+{
+	return m_eventFd >= 0;
+}
+
+int LoopbackSeq::open()
+{
+	// Readable while there are events waiting, to be polled like the ALSA descriptor.
+	m_eventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (m_eventFd < 0)
+		return -errno;
+
+	m_head = m_tail = 0;
+	return 0;
+}
+
+void LoopbackSeq::close()
+{
+	if (m_eventFd >= 0)
+	{
+		::close(m_eventFd);
+		m_eventFd = -1;
+	}
+}
+
+int LoopbackSeq::setClientName(const char *)
+{
+	return 0;
+}
+
+int LoopbackSeq::getClientId() const
+{
+	return CLIENT_ID;
+}
+
+int LoopbackSeq::createPort(const char *, unsigned, unsigned)
+{
+	return 0;
+}
+
+void LoopbackSeq::deletePort(int)
+{
+}
+
+int LoopbackSeq::allocQueue(const char *)
+{
+	return 0;
+}
+
+void LoopbackSeq::freeQueue(int)
+{
+	m_queue = -1;
+}
+
+int LoopbackSeq::setTimestamping(int, int queue)
+{
+	timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	m_queueStart = (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+	m_queue = queue;
+	return 0;
+}
+
+int LoopbackSeq::clearEventFilter()
+{
+	m_filtering = false;
+	memset(m_filter, 0, sizeof(m_filter));
+	return 0;
+}
+
+int LoopbackSeq::addEventFilter(snd_seq_event_type_t type)
+{
+	m_filtering = true;
+	m_filter[type / 32] |= 1u << (type % 32);
+	return 0;
+}
+
+bool LoopbackSeq::isFiltered(snd_seq_event_type_t type) const
+{
+	return m_filtering && !(m_filter[type / 32] & (1u << (type % 32)));
+}
+
+int LoopbackSeq::getPollDescriptor(pollfd &fd)
+{
+	fd.fd = m_eventFd;
+	fd.events = POLLIN;
+	fd.revents = 0;
+	return 0;
+}
+
+int LoopbackSeq::input(snd_seq_event_t *&ev)
+{
+	if (m_head == m_tail)
+	{
+		ev = NULL;
+		return -EAGAIN;
+	}
+
+	ev = &m_ring[m_tail++ & (RING_SIZE-1)].m_event;
+
+	// Drained, stop polling as readable.
+	if (m_head == m_tail)
+	{
+		uint64_t value;
+		ssize_t n = read(m_eventFd, &value, sizeof(value));
+		(void)n;
+	}
+
+	return 1;
+}
+
+int LoopbackSeq::inputPending(bool)
+{
+	return m_head - m_tail;
+}
+
+void LoopbackSeq::freeEvent(snd_seq_event_t *)
+{
+}
+
+int LoopbackSeq::output(snd_seq_event_t *ev)
+{
+	return outputDirect(ev);
+}
+
+int LoopbackSeq::outputDirect(snd_seq_event_t *ev)
+{
+	++m_captured;
+	if (isFiltered(ev->type))
+		return 0;
+
+	int result = inject(*ev);
+	if (result == -EAGAIN)
+		++m_overruns;
+	return result;
+}
+
+int LoopbackSeq::drainOutput()
+{
+	return 0;
+}
+
+int LoopbackSeq::inject(const snd_seq_event_t &ev)
+{
+	if (m_head - m_tail >= RING_SIZE - 1)
+		return -EAGAIN;
+
+	bool variable = snd_seq_ev_is_variable(&ev);
+	if (variable && ev.data.ext.len > MAX_EVENT_DATA)
+		return -EMSGSIZE;
+
+	Slot &slot = m_ring[m_head & (RING_SIZE-1)];
+	slot.m_event = ev;
+
+	snd_seq_event_t &e = slot.m_event;
+	if (variable)
+	{
+		memcpy(slot.m_data, ev.data.ext.ptr, ev.data.ext.len);
+		e.data.ext.ptr = slot.m_data;
+	}
+
+	e.source.client = PEER_CLIENT_ID;
+	e.source.port = 0;
+	e.dest.client = CLIENT_ID;
+	e.dest.port = 0;
+
+	if (m_queue >= 0)
+	{
+		timespec ts;
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		uint64_t t = (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec - m_queueStart;
+
+		e.queue = m_queue;
+		e.flags = (e.flags & ~(SND_SEQ_TIME_STAMP_MASK | SND_SEQ_TIME_MODE_MASK)) | SND_SEQ_TIME_STAMP_REAL | SND_SEQ_TIME_MODE_ABS;
+		e.time.time.tv_sec = t / 1000000000;
+		e.time.time.tv_nsec = t % 1000000000;
+	}
+
+	if (m_head++ == m_tail)
+	{
+		uint64_t one = 1;
+		ssize_t n = write(m_eventFd, &one, sizeof(one));
+		(void)n;
+	}
+
+	return 0;
+}
+
+uint64_t LoopbackSeq::getCaptured() const
+{
+	return m_captured;
+}
+
+uint64_t LoopbackSeq::getOverruns() const
+{
+	return m_overruns;
+}
+
+#endif // OSC2MIDI_SEQ_LOOPBACK
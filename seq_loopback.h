@@ -0,0 +1,116 @@
+/*
+ * osc2midi - a bridge between OSC and (ALSA) MIDI.
+ * Copyright (C) 2018  Vilniaus Blokas UAB, https://blokas.io/
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2 of the
+ * License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef SEQ_LOOPBACK_H
+#define SEQ_LOOPBACK_H
+
+#include <alsa/asoundlib.h>
+#include <stdint.h>
+#include <poll.h>
+
+// An in-memory stand-in for the ALSA sequencer, see seq_backend.h. Needs no
+// /dev/snd/seq, for benchmarking and testing the bridge in build containers.
+//
+// Every event the bridge outputs is captured, then delivered back to it as if
+// an external client subscribed to the port echoed it, honoring the event
+// filter and the timestamping. A single UDP peer can so drive both directions.
+// The echoes keep the bridge's tag, like a real ALSA pass through client does,
+// so the feedback loop detection has to be disabled with -l 0. Other events can be injected with inject().
+class LoopbackSeq
+{
+public:
+	enum
+	{
+		RING_SIZE      = 4096, // Power of 2.
+		MAX_EVENT_DATA = 256,  // Of variable length events, longer ones are dropped.
+
+		CLIENT_ID      = 128,
+		PEER_CLIENT_ID = 129,
+	};
+
+	LoopbackSeq();
+	~LoopbackSeq();
+
+	bool isOpen() const;
+
+	int open();
+	void close();
+
+	int setClientName(const char *name);
+	int getClientId() const;
+
+	int createPort(const char *name, unsigned caps, unsigned type);
+	void deletePort(int port);
+
+	int allocQueue(const char *name);
+	void freeQueue(int queue);
+	int setTimestamping(int port, int queue);
+
+	int clearEventFilter();
+	int addEventFilter(snd_seq_event_type_t type);
+
+	int getPollDescriptor(pollfd &fd);
+
+	int input(snd_seq_event_t *&ev);
+	int inputPending(bool fetch);
+	void freeEvent(snd_seq_event_t *ev);
+
+	int output(snd_seq_event_t *ev);
+	int outputDirect(snd_seq_event_t *ev);
+	int drainOutput();
+
+	// Delivers an event to the bridge, as sent by PEER_CLIENT_ID. Returns 0 on
+	// success, -EAGAIN if the input is full, -EMSGSIZE if the data is too long.
+	int inject(const snd_seq_event_t &ev);
+
+	// Count of events output by the bridge, and of the events lost because the input was full.
+	uint64_t getCaptured() const;
+	uint64_t getOverruns() const;
+
+private:
+	LoopbackSeq(const LoopbackSeq &);
+	LoopbackSeq &operator=(const LoopbackSeq &);
+
+	bool isFiltered(snd_seq_event_type_t type) const;
+
+	int m_eventFd;
+
+	int m_queue;
+	uint64_t m_queueStart; // CLOCK_MONOTONIC ns.
+
+	bool m_filtering;
+	uint32_t m_filter[256 / 32];
+
+	struct Slot
+	{
+		snd_seq_event_t m_event;
+		uint8_t m_data[MAX_EVENT_DATA];
+	};
+
+	// One slot is kept spare, so the last event returned by input() stays valid
+	// until the next call, like with ALSA.
+	Slot m_ring[RING_SIZE];
+	uint32_t m_head;
+	uint32_t m_tail;
+
+	uint64_t m_captured;
+	uint64_t m_overruns;
+};
+
+#endif // SEQ_LOOPBACK_H
@@ -0,0 +1,51 @@
+/*
+ * osc2midi - a bridge between OSC and (ALSA) MIDI.
+ * Copyright (C) 2018  Vilniaus Blokas UAB, https://blokas.io/
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2 of the
+ * License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include "stats.h"
+
+static const char *const TYPE_NAMES[STAT_TYPE_COUNT] = {
+	"noteoff",
+	"noteon",
+	"polypressure",
+	"cc",
+	"program",
+	"chanpressure",
+	"pitchbend",
+	"sysex",
+	"system",
+	"realtime",
+};
+
+static const char *const DROP_NAMES[DROP_REASON_COUNT] = {
+	"rules",
+	"transform",
+	"rate",
+	"shed",
+	"loop",
+};
+
+const char *stat_get_type_name(StatType type)
+{
+	return TYPE_NAMES[type];
+}
+
+const char *stat_get_drop_name(StatDrop reason)
+{
+	return DROP_NAMES[reason];
+}
@@ -0,0 +1,127 @@
+/*
+ * osc2midi - a bridge between OSC and (ALSA) MIDI.
+ * Copyright (C) 2018  Vilniaus Blokas UAB, https://blokas.io/
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2 of the
+ * License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdint.h>
+
+#include "midi_serialization.h"
+
+#define CACHE_LINE_SIZE 64
+
+enum StatType
+{
+	STAT_NOTE_OFF,
+	STAT_NOTE_ON,
+	STAT_POLY_PRESSURE,
+	STAT_CC,
+	STAT_PROGRAM,
+	STAT_CHAN_PRESSURE,
+	STAT_PITCH_BEND,
+	STAT_SYSEX,
+	STAT_SYSTEM,   // System Common, other than SysEx.
+	STAT_REALTIME,
+
+	STAT_TYPE_COUNT
+};
+
+enum StatDrop
+{
+	DROP_RULES,
+	DROP_TRANSFORM,
+	DROP_RATE,
+	DROP_SHED,
+	DROP_LOOP,
+
+	DROP_REASON_COUNT
+};
+
+// The counters are only ever incremented on the hot path, each group on its own
+// cache lines, so readers polling them don't slow down the event handling.
+struct DirectionStats
+{
+	uint64_t m_events[STAT_TYPE_COUNT];
+	uint64_t m_dropped[DROP_REASON_COUNT];
+	uint64_t m_sysexBytes;
+} __attribute__((aligned(CACHE_LINE_SIZE)));
+
+struct PeerStats
+{
+	uint64_t m_packets;
+	uint64_t m_events;
+	uint64_t m_dropped;
+	uint64_t m_parseErrors;
+} __attribute__((aligned(CACHE_LINE_SIZE)));
+
+struct Stats
+{
+	DirectionStats m_dir[MIDI_DIR_COUNT];
+
+	struct
+	{
+		uint64_t m_packets;     // UDP datagrams received.
+		uint64_t m_parseErrors; // Malformed OSC messages and events.
+		uint32_t m_queueDepth;  // Events waiting in the ALSA input at the last wakeup.
+		uint32_t m_maxQueueDepth;
+	} m_input __attribute__((aligned(CACHE_LINE_SIZE)));
+};
+
+static inline StatType stat_type(const midi_event_t &ev)
+{
+	uint8_t status = midi_event_status(ev);
+	if (status < 0xf0)
+		return (StatType)((status >> 4) - 0x8 + STAT_NOTE_OFF);
+	if (status == 0xf0)
+		return STAT_SYSEX;
+	return status >= 0xf8 ? STAT_REALTIME : STAT_SYSTEM;
+}
+
+// Returns the count of SysEx bytes carried by the event, 0 for other events.
+static inline unsigned stat_sysex_bytes(const midi_event_t &ev)
+{
+	if (midi_event_status(ev) != 0xf0)
+		return 0;
+
+	switch (ev.m_event & 0x0f)
+	{
+	case 0x4:
+	case 0x7:
+		return 3;
+	case 0x6:
+		return 2;
+	case 0x5:
+		return 1;
+	default:
+		return 0;
+	}
+}
+
+static inline void stat_count_event(DirectionStats &stats, const midi_event_t &ev)
+{
+	StatType type = stat_type(ev);
+	++stats.m_events[type];
+	if (type == STAT_SYSEX)
+		stats.m_sysexBytes += stat_sysex_bytes(ev);
+}
+
+const char *stat_get_type_name(StatType type);
+const char *stat_get_drop_name(StatDrop reason);
+
+#endif // STATS_H
@@ -0,0 +1,107 @@
+/*
+ * osc2midi - a bridge between OSC and (ALSA) MIDI.
+ * Copyright (C) 2018  Vilniaus Blokas UAB, https://blokas.io/
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2 of the
+ * License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include "tracer.h"
+
+#include <stdio.h>
+#include <errno.h>
+#include <unistd.h>
+
+static const char *const STAGE_NAMES[TRACE_STAGE_COUNT] = {
+	"poll",
+	"iteration",
+	"recv",
+	"parse",
+	"alsa read",
+	"encode",
+	"alsa write",
+	"send",
+};
+
+static uint64_t monotonicNs()
+{
+	timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+Tracer::Tracer()
+	:m_rate(0)
+	,m_counter(0)
+	,m_sampled(false)
+	,m_startTicks(0)
+	,m_startNs(0)
+	,m_head(0)
+{
+}
+
+void Tracer::setRate(unsigned rate)
+{
+	m_rate = rate;
+	m_counter = 0;
+	m_sampled = false;
+
+	if (rate != 0 && m_startTicks == 0)
+	{
+		m_startTicks = trace_ticks();
+		m_startNs = monotonicNs();
+	}
+}
+
+bool Tracer::isEnabled() const
+{
+	return m_rate != 0;
+}
+
+int Tracer::dump(const char *path) const
+{
+	FILE *f = fopen(path, "w");
+	if (!f)
+		return -errno;
+
+	// The tick rate is calibrated against the monotonic clock since tracing started.
+	double nsPerTick = 1.0;
+	uint64_t ticks = trace_ticks() - m_startTicks;
+	if (ticks != 0)
+		nsPerTick = (double)(monotonicNs() - m_startNs) / ticks;
+
+	uint32_t head = __atomic_load_n(&m_head, __ATOMIC_ACQUIRE);
+	uint32_t count = head < (uint32_t)RING_SIZE ? head : (uint32_t)RING_SIZE;
+	int pid = getpid();
+
+	fprintf(f, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+	for (uint32_t i = head - count; i != head; ++i)
+	{
+		const Entry &e = m_ring[i % RING_SIZE];
+		fprintf(f, "{\"name\":\"%s\",\"cat\":\"osc2midi\",\"ph\":\"X\",\"pid\":%d,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"arg\":%u}}%s\n",
+			STAGE_NAMES[e.m_stage < TRACE_STAGE_COUNT ? e.m_stage : 0],
+			pid,
+			pid,
+			(e.m_start - m_startTicks) * nsPerTick / 1000.0,
+			e.m_duration * nsPerTick / 1000.0,
+			e.m_arg,
+			i + 1 != head ? "," : ""
+			);
+	}
+	fprintf(f, "]}\n");
+
+	int result = ferror(f) ? -EIO : 0;
+	fclose(f);
+	return result;
+}
@@ -0,0 +1,139 @@
+/*
+ * osc2midi - a bridge between OSC and (ALSA) MIDI.
+ * Copyright (C) 2018  Vilniaus Blokas UAB, https://blokas.io/
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2 of the
+ * License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef TRACER_H
+#define TRACER_H
+
+#include <stdint.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#	include <x86intrin.h>
+#endif
+
+enum TraceStage
+{
+	TRACE_POLL,       // Waiting in poll, ends on wakeup.
+	TRACE_ITERATION,  // Handling everything after a wakeup.
+	TRACE_RECV,       // Reading a datagram, the argument is its length.
+	TRACE_PARSE,      // Parsing and dispatching an OSC message.
+	TRACE_ALSA_READ,  // Reading an ALSA event.
+	TRACE_ENCODE,     // Encoding an event, the argument is the status byte.
+	TRACE_ALSA_WRITE, // Writing an event to ALSA, the argument is the status byte.
+	TRACE_SEND,       // Sending an OSC message, the argument is its length.
+
+	TRACE_STAGE_COUNT
+};
+
+// Cheapest monotonic timestamp available: TSC on x86, the virtual counter on
+// AArch64, the monotonic clock elsewhere. Converted to time when dumping.
+static inline uint64_t trace_ticks()
+{
+#if defined(__x86_64__) || defined(__i386__)
+	return __rdtsc();
+#elif defined(__aarch64__)
+	uint64_t ticks;
+	asm volatile("mrs %0, cntvct_el0" : "=r"(ticks));
+	return ticks;
+#else
+	timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+}
+
+// Records the duration of the pipeline stages into a ring, overwriting the oldest
+// entries. Only one of every rate event loop iterations is traced, the rest cost a
+// single branch per trace point. The ring belongs to the thread running the event
+// loop, the write index is published with release semantics, so a reader never
+// needs a lock. The ring is dumped in Chrome's trace event JSON format, which can
+// be loaded in chrome://tracing or Perfetto.
+class Tracer
+{
+public:
+	Tracer();
+
+	// Traces one of every rate iterations, 0 disables tracing.
+	void setRate(unsigned rate);
+
+	bool isEnabled() const;
+
+	// Called at the start of every event loop iteration.
+	inline void startIteration();
+
+	// Returns the start of a stage, 0 if the iteration isn't traced.
+	inline uint64_t begin() const;
+
+	inline void end(TraceStage stage, uint64_t start, uint16_t arg = 0);
+
+	// Returns 0 on success, negative error code otherwise.
+	int dump(const char *path) const;
+
+private:
+	enum { RING_SIZE = 1 << 16 };
+
+	struct Entry
+	{
+		uint64_t m_start;
+		uint64_t m_duration; // Ticks, a 32 bit count would wrap within a long poll.
+		uint16_t m_stage;
+		uint16_t m_arg;
+	};
+
+	unsigned m_rate;
+	unsigned m_counter;
+	bool m_sampled;
+
+	uint64_t m_startTicks;
+	uint64_t m_startNs;
+
+	uint32_t m_head; // Total entries written, the ring index is head % RING_SIZE.
+	Entry m_ring[RING_SIZE];
+};
+
+inline void Tracer::startIteration()
+{
+	if (m_rate == 0)
+		return;
+
+	m_sampled = ++m_counter >= m_rate;
+	if (m_sampled)
+		m_counter = 0;
+}
+
+inline uint64_t Tracer::begin() const
+{
+	return m_sampled ? trace_ticks() : 0;
+}
+
+inline void Tracer::end(TraceStage stage, uint64_t start, uint16_t arg)
+{
+	if (start == 0)
+		return;
+
+	uint32_t head = m_head;
+	Entry &e = m_ring[head % RING_SIZE];
+	e.m_start = start;
+	e.m_duration = trace_ticks() - start;
+	e.m_stage = stage;
+	e.m_arg = arg;
+	__atomic_store_n(&m_head, head + 1, __ATOMIC_RELEASE);
+}
+
+#endif // TRACER_H
@@ -0,0 +1,199 @@
+/*
+ * osc2midi - a bridge between OSC and (ALSA) MIDI.
+ * Copyright (C) 2018  Vilniaus Blokas UAB, https://blokas.io/
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2 of the
+ * License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include "watchdog.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <execinfo.h>
+#include <link.h>
+
+static const char *const HANDLER_NAMES[WATCH_HANDLER_COUNT] = {
+	"loop",
+	"alsa",
+	"udp",
+	"flush",
+	"expiry",
+};
+
+// There's a single event loop, so a single watchdog the timer signal is routed to.
+static Watchdog *g_instance;
+static uintptr_t g_loadAddress;
+
+static int findLoadAddress(dl_phdr_info *info, size_t, void *)
+{
+	// The first object is the executable itself.
+	g_loadAddress = info->dlpi_addr;
+	return 1;
+}
+
+Watchdog::Watchdog()
+	:m_budgetUs(0)
+	,m_timerCreated(false)
+	,m_iterationStart(0)
+	,m_handlerStart(0)
+	,m_current(WATCH_LOOP)
+	,m_iterations(0)
+	,m_maxUs(0)
+	,m_caught(0)
+	,m_hasStall(false)
+{
+	memset(m_spent, 0, sizeof(m_spent));
+	memset(m_overruns, 0, sizeof(m_overruns));
+	memset(&m_pending, 0, sizeof(m_pending));
+	memset(&m_lastStall, 0, sizeof(m_lastStall));
+}
+
+Watchdog::~Watchdog()
+{
+	if (m_timerCreated)
+		timer_delete(m_timer);
+	if (g_instance == this)
+		g_instance = NULL;
+}
+
+int Watchdog::init(unsigned budgetUs)
+{
+	m_budgetUs = budgetUs;
+	if (budgetUs == 0)
+		return 0;
+
+	dl_iterate_phdr(&findLoadAddress, NULL);
+
+	// The first call may load libgcc, make sure that doesn't happen in the signal handler.
+	void *frames[1];
+	backtrace(frames, 1);
+
+	g_instance = this;
+
+	struct sigaction sa;
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = &onTimer;
+	sa.sa_flags = SA_RESTART;
+	sigaction(SIGALRM, &sa, NULL);
+
+	sigevent sev;
+	memset(&sev, 0, sizeof(sev));
+	sev.sigev_notify = SIGEV_SIGNAL;
+	sev.sigev_signo = SIGALRM;
+	if (timer_create(CLOCK_MONOTONIC, &sev, &m_timer) < 0)
+	{
+		int err = errno;
+		fprintf(stderr, "Failed creating the watchdog timer! (%d)\n", err);
+		m_budgetUs = 0;
+		return -err;
+	}
+	m_timerCreated = true;
+
+	return 0;
+}
+
+bool Watchdog::isEnabled() const
+{
+	return m_budgetUs != 0;
+}
+
+void Watchdog::arm(unsigned us)
+{
+	itimerspec its;
+	memset(&its, 0, sizeof(its));
+	its.it_value.tv_sec = us / 1000000;
+	its.it_value.tv_nsec = (us % 1000000) * 1000;
+	timer_settime(m_timer, 0, &its, NULL);
+}
+
+void Watchdog::onTimer(int)
+{
+	Watchdog *w = g_instance;
+	if (!w || w->m_caught)
+		return;
+
+	void *frames[MAX_FRAMES + 2];
+	int n = backtrace(frames, MAX_FRAMES + 2);
+
+	// Skip the frames of this handler and the signal trampoline.
+	Stall &s = w->m_pending;
+	s.m_handler = w->m_current;
+	s.m_frameCount = 0;
+	for (int i=2; i<n && s.m_frameCount<MAX_FRAMES; ++i)
+		s.m_frames[s.m_frameCount++] = (uintptr_t)frames[i] - g_loadAddress;
+
+	w->m_caught = 1;
+}
+
+void Watchdog::endIteration()
+{
+	if (m_budgetUs == 0)
+		return;
+
+	arm(0);
+	enter(WATCH_LOOP);
+
+	++m_iterations;
+	unsigned us = (unsigned)((m_handlerStart - m_iterationStart) / 1000);
+	if (us > m_maxUs)
+		m_maxUs = us;
+
+	if (us > m_budgetUs)
+	{
+		unsigned worst = 0;
+		for (unsigned i=1; i<WATCH_HANDLER_COUNT; ++i)
+		{
+			if (m_spent[i] > m_spent[worst])
+				worst = i;
+		}
+		++m_overruns[worst];
+
+		if (m_caught)
+		{
+			m_lastStall = m_pending;
+			m_lastStall.m_durationUs = us;
+			m_hasStall = true;
+		}
+	}
+
+	m_caught = 0;
+	memset(m_spent, 0, sizeof(m_spent));
+}
+
+uint64_t Watchdog::getIterations() const
+{
+	return m_iterations;
+}
+
+uint64_t Watchdog::getOverruns(WatchHandler handler) const
+{
+	return m_overruns[handler];
+}
+
+unsigned Watchdog::getMaxUs() const
+{
+	return m_maxUs;
+}
+
+const Watchdog::Stall *Watchdog::getLastStall() const
+{
+	return m_hasStall ? &m_lastStall : NULL;
+}
+
+const char *Watchdog::getHandlerName(WatchHandler handler)
+{
+	return HANDLER_NAMES[handler];
+}
@@ -0,0 +1,132 @@
+/*
+ * osc2midi - a bridge between OSC and (ALSA) MIDI.
+ * Copyright (C) 2018  Vilniaus Blokas UAB, https://blokas.io/
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2 of the
+ * License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef WATCHDOG_H
+#define WATCHDOG_H
+
+#include <stdint.h>
+#include <signal.h>
+#include <time.h>
+
+enum WatchHandler
+{
+	WATCH_LOOP,   // The event loop's own bookkeeping.
+	WATCH_ALSA,   // handleSeqEvent.
+	WATCH_UDP,    // Receiving and handling a datagram.
+	WATCH_FLUSH,  // Sending the events held back by the rate limits.
+	WATCH_EXPIRY, // Closing the expired sessions.
+
+	WATCH_HANDLER_COUNT
+};
+
+// Catches event loop iterations running over a budget. The time spent in each
+// handler of an iteration is measured, an overrun is counted against the handler
+// which took the most. A one-shot timer armed for the budget at the start of the
+// iteration interrupts a stalled one, its signal handler captures a backtrace of
+// where the loop got stuck.
+class Watchdog
+{
+public:
+	enum { MAX_FRAMES = 12 };
+
+	struct Stall
+	{
+		WatchHandler m_handler; // Running when the timer fired.
+		unsigned m_durationUs;  // Of the whole iteration.
+		unsigned m_frameCount;
+		uintptr_t m_frames[MAX_FRAMES]; // Offsets from the executable's load address.
+	};
+
+	Watchdog();
+	~Watchdog();
+
+	// Returns 0 on success, negative error code otherwise. 0 budget disables the watchdog.
+	int init(unsigned budgetUs);
+
+	bool isEnabled() const;
+
+	inline void beginIteration();
+	inline void enter(WatchHandler handler);
+	void endIteration();
+
+	uint64_t getIterations() const;
+	uint64_t getOverruns(WatchHandler handler) const;
+	unsigned getMaxUs() const;
+
+	// Returns NULL if no stall was caught yet.
+	const Stall *getLastStall() const;
+
+	static const char *getHandlerName(WatchHandler handler);
+
+private:
+	static void onTimer(int sig);
+	static inline uint64_t nowNs();
+
+	void arm(unsigned us);
+
+	unsigned m_budgetUs;
+	timer_t m_timer;
+	bool m_timerCreated;
+
+	uint64_t m_iterationStart;
+	uint64_t m_handlerStart;
+	volatile WatchHandler m_current;
+	uint64_t m_spent[WATCH_HANDLER_COUNT];
+
+	uint64_t m_iterations;
+	uint64_t m_overruns[WATCH_HANDLER_COUNT];
+	unsigned m_maxUs;
+
+	// Filled in by the signal handler.
+	volatile sig_atomic_t m_caught;
+	Stall m_pending;
+
+	bool m_hasStall;
+	Stall m_lastStall;
+};
+
+inline uint64_t Watchdog::nowNs()
+{
+	timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+inline void Watchdog::beginIteration()
+{
+	if (m_budgetUs == 0)
+		return;
+
+	m_iterationStart = m_handlerStart = nowNs();
+	m_current = WATCH_LOOP;
+	arm(m_budgetUs);
+}
+
+inline void Watchdog::enter(WatchHandler handler)
+{
+	if (m_budgetUs == 0)
+		return;
+
+	uint64_t now = nowNs();
+	m_spent[m_current] += now - m_handlerStart;
+	m_handlerStart = now;
+	m_current = handler;
+}
+
+#endif // WATCHDOG_H